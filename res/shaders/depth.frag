@@ -0,0 +1,6 @@
+#version 430 core
+
+// Depth-only pass, colour writes are masked off
+void main()
+{
+}
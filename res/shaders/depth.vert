@@ -0,0 +1,13 @@
+#version 430 core
+
+in layout(location = 0) vec3 position;
+
+uniform layout(location = 3) mat4 MVP;
+
+// Must match simple.vert bit for bit, the shading pass tests with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = MVP * vec4(position, 1.0f);
+}
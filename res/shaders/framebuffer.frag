@@ -1,110 +1,51 @@
 #version 430 core
 
+// Variant features, defined by the renderer (see shaderVariants.hpp and the enums in window.hpp)
+#ifndef IMAGE_SPACE_OUTLINES
+#define IMAGE_SPACE_OUTLINES 1  // 0 when the lines come from mesh edges and are already in the screen texture
+#endif
+#ifndef DEBUG_VIEW
+#define DEBUG_VIEW 0            // 4 outlines only, 5 distance to the nearest edge, 6 linear depth
+#endif
+
 out vec4 color;
 in vec2 texCoords;
 
 uniform sampler2D screenTexture;
-uniform sampler2D normalTexture;
 uniform sampler2D depthTexture;
+uniform usampler2D outlineSeedTexture;
 
-const float offset_x = 1.0f / 800.0f;
-const float offset_y = 1.0f / 800.0f;
-
-vec2 offsets[9] = vec2[] (
-    vec2(-offset_x, offset_y),  vec2(0.0f, offset_y),   vec2(offset_x, offset_y),
-    vec2(-offset_x, 0.0f),      vec2(0.0f, 0.0f),       vec2(offset_x, 0.0f),
-    vec2(-offset_x, -offset_y), vec2(0.0f, -offset_y),  vec2(offset_x, -offset_y)
-);
-
-float kernelX[9] = float[] (
-    1.0,    0.0,    -1.0,
-    2.0,    0.0,    -2.0,
-    1.0,    0.0,    -1.0
-);
+// Line width in pixels for edges at linear depth 0 and 1
+uniform float outline_width_near = 1.0;
+uniform float outline_width_far = 1.0;
 
-float kernelY[9] = float[] (
-     1.0,  2.0,  1.0,
-     0.0,  0.0,  0.0,
-    -1.0, -2.0, -1.0
-);
-
-// Simple noise
-float hash(vec2 p) {
-    return fract(sin(dot(p ,vec2(127.1, 311.7))) * 43758.5453);
-}
-
-float noise(vec2 uv) {
-    vec2 i = floor(uv);
-    vec2 f = fract(uv);
-
-    float a = hash(i);
-    float b = hash(i + vec2(1.0, 0.0));
-    float c = hash(i + vec2(0.0, 1.0));
-    float d = hash(i + vec2(1.0, 1.0));
-
-    vec2 u = f * f * (3.0 - 2.0 * f); // smoothstep interpolation
-
-    return mix(a, b, u.x) +
-           (c - a)* u.y * (1.0 - u.x) +
-           (d - b) * u.x * u.y;
-}
+const uint noSeed = 0xFFFFu;
 
 void main(){
-    // apply noise on texCoords
-    vec2 uvJitter = texCoords + 0.003 * vec2(
-        noise(texCoords * 10.0),
-        noise(texCoords * 10.0)
-    );
-
-    vec3 centerNormal = texture(normalTexture, texCoords).rgb;
-    centerNormal = normalize(centerNormal * 2.0 - 1.0); // Convert from [0,1] to [-1,1]
-    float centerDepth = texture(depthTexture, texCoords).r;
-
-    float normalEdge = 0.0;
-    float depthEdge = 0.0;
-    float gx = 0.0;
-    float gy = 0.0;
-    float depthGx = 0.0;
-    float depthGy = 0.0;
-
-    for(int i = 0; i < 9; i++) {
-        // Normal edge
-        vec3 sampleNormal = texture(normalTexture, uvJitter + offsets[i]).rgb;
-        sampleNormal = normalize(sampleNormal * 2.0 - 1.0);
-        
-        // Calculate how much the normal differs from center
-        float normalDiff = 1.0 - dot(centerNormal, sampleNormal);
-        
-        // Apply your original kernels
-        gx += normalDiff * kernelX[i];
-        gy += normalDiff * kernelY[i];
-
-        // Depth edge
-        float sampleDepth = texture(depthTexture, texCoords + offsets[i]).r;
-        float depthDiff = abs(centerDepth - sampleDepth) * 50.0;
-
-        depthGx += depthDiff * kernelX[i];
-        depthGy += depthDiff * kernelY[i];
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    // The width comes from the depth of the edge itself, so one line does not change width across a silhouette
+    float edge = 0.0;
+    float seedDistance = 0.0;
+#if IMAGE_SPACE_OUTLINES
+    uvec2 seed = texelFetch(outlineSeedTexture, pixel, 0).rg;
+    if (seed.x != noSeed) {
+        float seedDepth = clamp(texelFetch(depthTexture, ivec2(seed), 0).r, 0.0, 1.0);
+        float width = mix(outline_width_near, outline_width_far, seedDepth);
+        seedDistance = length(vec2(seed) - vec2(pixel));
+        edge = 1.0 - smoothstep(width - 1.0, width, seedDistance);
     }
-
-    // Calculate edge strengths
-    float normalEdgeStrength = sqrt(gx*gx + gy*gy);
-    float depthEdgeStrength = sqrt(depthGx*depthGx + depthGy*depthGy);
-    
-    // Combine edges
-    float combinedEdge = max(normalEdgeStrength, depthEdgeStrength);
-    
-    // Apply threshold
-    float edge = combinedEdge > 0.3 ? 1.0 : 0.0;
-    
+#endif
+
+#if DEBUG_VIEW == 4
+    color = vec4(vec3(edge), 1.0);
+#elif DEBUG_VIEW == 5
+    color = vec4(vec3(seedDistance / 16.0), 1.0);
+#elif DEBUG_VIEW == 6
+    color = vec4(vec3(texelFetch(depthTexture, pixel, 0).r), 1.0);
+#else
     // Final output
     vec3 originalColor = texture(screenTexture, texCoords).rgb;
     color = vec4(originalColor * (1.0 - edge), 1.0);
-    
-    // Debug views:
-    //color = vec4(vec3(normalEdgeStrength), 1.0); // Normals outlines
-    //color = vec4(vec3(depthEdgeStrength), 1.0);  // Depth outlines
-    //color = vec4(centerNormal*0.5+0.5, 1.0);     // Visualize normals
-    //color = vec4(vec3(centerDepth), 1.0);        // Visualize depth
-    //color = texture(screenTexture, texCoords);  // Visualize initial render
-}
\ No newline at end of file
+#endif
+}
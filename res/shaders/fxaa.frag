@@ -0,0 +1,148 @@
+#version 430 core
+
+// FXAA on the composited image: finds luma edges, walks along them to the ends of
+// the edge and blends across it proportionally, plus a subpixel blend for
+// features smaller than a pixel. Runs after the outlines so the ink is smoothed too.
+out vec4 color;
+in vec2 texCoords;
+
+uniform sampler2D screenTexture;
+uniform vec2 inverse_screen_size;
+
+const float edge_threshold_min = 0.0312;
+const float edge_threshold_max = 0.125;
+const float subpixel_quality = 0.75;
+
+// Step sizes of the edge end search, growing so long edges are found quickly
+const int search_steps = 12;
+const float search_step_size[12] = float[] (1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0);
+
+float luma(vec3 rgb) {
+    return sqrt(dot(rgb, vec3(0.299, 0.587, 0.114)));
+}
+
+float lumaAt(vec2 uv) {
+    return luma(texture(screenTexture, uv).rgb);
+}
+
+float lumaOffset(ivec2 offset) {
+    ivec2 pixel = clamp(ivec2(gl_FragCoord.xy) + offset, ivec2(0), textureSize(screenTexture, 0) - 1);
+    return luma(texelFetch(screenTexture, pixel, 0).rgb);
+}
+
+void main(){
+    vec3 colorCenter = texture(screenTexture, texCoords).rgb;
+    float lumaCenter = luma(colorCenter);
+
+    float lumaDown  = lumaOffset(ivec2( 0, -1));
+    float lumaUp    = lumaOffset(ivec2( 0,  1));
+    float lumaLeft  = lumaOffset(ivec2(-1,  0));
+    float lumaRight = lumaOffset(ivec2( 1,  0));
+
+    float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+    float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+    float lumaRange = lumaMax - lumaMin;
+
+    // Flat areas are left alone
+    if (lumaRange < max(edge_threshold_min, lumaMax * edge_threshold_max)) {
+        color = vec4(colorCenter, 1.0);
+        return;
+    }
+
+    float lumaDownLeft  = lumaOffset(ivec2(-1, -1));
+    float lumaUpRight   = lumaOffset(ivec2( 1,  1));
+    float lumaUpLeft    = lumaOffset(ivec2(-1,  1));
+    float lumaDownRight = lumaOffset(ivec2( 1, -1));
+
+    float lumaDownUp = lumaDown + lumaUp;
+    float lumaLeftRight = lumaLeft + lumaRight;
+    float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+    float lumaDownCorners = lumaDownLeft + lumaDownRight;
+    float lumaRightCorners = lumaDownRight + lumaUpRight;
+    float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+    // Edge orientation
+    float edgeHorizontal = abs(-2.0 * lumaLeft + lumaLeftCorners) + abs(-2.0 * lumaCenter + lumaDownUp) * 2.0 + abs(-2.0 * lumaRight + lumaRightCorners);
+    float edgeVertical   = abs(-2.0 * lumaUp + lumaUpCorners) + abs(-2.0 * lumaCenter + lumaLeftRight) * 2.0 + abs(-2.0 * lumaDown + lumaDownCorners);
+    bool isHorizontal = edgeHorizontal >= edgeVertical;
+
+    // Which side of the pixel the edge lies on
+    float luma1 = isHorizontal ? lumaDown : lumaLeft;
+    float luma2 = isHorizontal ? lumaUp : lumaRight;
+    float gradient1 = luma1 - lumaCenter;
+    float gradient2 = luma2 - lumaCenter;
+    bool is1Steepest = abs(gradient1) >= abs(gradient2);
+    float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+    float stepLength = isHorizontal ? inverse_screen_size.y : inverse_screen_size.x;
+    float lumaLocalAverage;
+    if (is1Steepest) {
+        stepLength = -stepLength;
+        lumaLocalAverage = 0.5 * (luma1 + lumaCenter);
+    } else {
+        lumaLocalAverage = 0.5 * (luma2 + lumaCenter);
+    }
+
+    // Start half a pixel towards the edge and search both ways along it
+    vec2 currentUv = texCoords;
+    if (isHorizontal) {
+        currentUv.y += stepLength * 0.5;
+    } else {
+        currentUv.x += stepLength * 0.5;
+    }
+
+    vec2 offset = isHorizontal ? vec2(inverse_screen_size.x, 0.0) : vec2(0.0, inverse_screen_size.y);
+    vec2 uv1 = currentUv - offset;
+    vec2 uv2 = currentUv + offset;
+
+    float lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+    float lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+    bool reached1 = abs(lumaEnd1) >= gradientScaled;
+    bool reached2 = abs(lumaEnd2) >= gradientScaled;
+
+    if (!reached1) uv1 -= offset;
+    if (!reached2) uv2 += offset;
+
+    for (int i = 2; i < search_steps && !(reached1 && reached2); i++) {
+        if (!reached1) {
+            lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+        }
+        if (!reached2) {
+            lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+        }
+        if (!reached1) uv1 -= offset * search_step_size[i];
+        if (!reached2) uv2 += offset * search_step_size[i];
+    }
+
+    // Blend amount from the position along the edge
+    float distance1 = isHorizontal ? (texCoords.x - uv1.x) : (texCoords.y - uv1.y);
+    float distance2 = isHorizontal ? (uv2.x - texCoords.x) : (uv2.y - texCoords.y);
+    bool isDirection1 = distance1 < distance2;
+    float distanceFinal = min(distance1, distance2);
+    float edgeLength = distance1 + distance2;
+    float pixelOffset = -distanceFinal / edgeLength + 0.5;
+
+    // Only blend if the luma at the closer end varies the same way as at the center
+    bool isLumaCenterSmaller = lumaCenter < lumaLocalAverage;
+    bool correctVariation = ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0) != isLumaCenterSmaller;
+    float finalOffset = correctVariation ? pixelOffset : 0.0;
+
+    // Subpixel aliasing, from the difference to the 3x3 average
+    float lumaAverage = (1.0 / 12.0) * (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+    float subPixelOffset1 = clamp(abs(lumaAverage - lumaCenter) / lumaRange, 0.0, 1.0);
+    float subPixelOffset2 = (-2.0 * subPixelOffset1 + 3.0) * subPixelOffset1 * subPixelOffset1;
+    finalOffset = max(finalOffset, subPixelOffset2 * subPixelOffset2 * subpixel_quality);
+
+    vec2 finalUv = texCoords;
+    if (isHorizontal) {
+        finalUv.y += finalOffset * stepLength;
+    } else {
+        finalUv.x += finalOffset * stepLength;
+    }
+    color = vec4(texture(screenTexture, finalUv).rgb, 1.0);
+
+    // Debug views:
+    //color = vec4(isHorizontal ? 1.0 : 0.0, 0.0, finalOffset * 2.0, 1.0);   // Edge direction and blend amount
+}
@@ -0,0 +1,40 @@
+#version 430 core
+
+// One jump flood step: every pixel keeps the closest seed seen by itself or
+// by the eight pixels step_size away. Steps halve down to 1 between passes.
+layout(location = 0) out uvec2 seed;
+
+uniform usampler2D seedTexture;
+uniform int step_size;
+
+const uint noSeed = 0xFFFFu;
+
+void main(){
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 maxPixel = textureSize(seedTexture, 0) - 1;
+
+    uvec2 closestSeed = uvec2(noSeed);
+    float closestDistance = 1e20;
+    for(int y = -1; y <= 1; y++) {
+        for(int x = -1; x <= 1; x++) {
+            ivec2 samplePixel = pixel + ivec2(x, y) * step_size;
+            if (any(lessThan(samplePixel, ivec2(0))) || any(greaterThan(samplePixel, maxPixel))) {
+                continue;
+            }
+
+            uvec2 candidate = texelFetch(seedTexture, samplePixel, 0).rg;
+            if (candidate.x == noSeed) {
+                continue;
+            }
+
+            vec2 offset = vec2(candidate) - vec2(pixel);
+            float distance = dot(offset, offset);
+            if (distance < closestDistance) {
+                closestDistance = distance;
+                closestSeed = candidate;
+            }
+        }
+    }
+
+    seed = closestSeed;
+}
@@ -0,0 +1,178 @@
+#version 430 core
+
+// Full-screen lighting and crosshatching over the G-buffer written by simple.frag.
+// Runs every frame, while the G-buffer itself is only redrawn when the camera or geometry moves.
+
+// Variant features, defined by the renderer (see shaderVariants.hpp and the enums in window.hpp)
+#ifndef HATCHING_STYLE
+#define HATCHING_STYLE 1    // 0 smooth shading, 1 tonal art map crosshatching
+#endif
+#ifndef SHADOWS
+#define SHADOWS 1           // 0 when no light has a shadow map slot
+#endif
+#ifndef DEBUG_VIEW
+#define DEBUG_VIEW 0        // 1 lighting only, 2 world position, 3 normals, the rest are handled in framebuffer.frag
+#endif
+
+struct LightSource {
+    vec4 position_radius;
+    vec4 color;
+};
+
+out vec4 color;
+in vec2 texCoords;
+
+// Clustered light lists, rebuilt on the CPU every frame (see lightClusters.cpp)
+layout(std430, binding = 0) readonly buffer LightBuffer { LightSource light_source[]; };
+layout(std430, binding = 1) readonly buffer ClusterBuffer { uvec2 cluster_ranges[]; };
+layout(std430, binding = 2) readonly buffer LightIndexBuffer { uint light_indices[]; };
+
+uniform uvec3 cluster_count;
+uniform vec2 screen_size;
+uniform float cluster_near;
+uniform float cluster_far;
+
+uniform vec3 camera_position;
+uniform mat4 inverse_view_projection;
+
+// Tonal art map layout, see tonalArtMap.hpp
+const float tonal_art_map_layers = 12.0;
+const float tonal_art_map_max_brightness = 0.6;
+
+layout(binding = 0) uniform sampler2D albedoSample;
+layout(binding = 1) uniform sampler2D normalSample;
+layout(binding = 2) uniform sampler2DArray hatchSample;
+layout(binding = 3) uniform samplerCubeArrayShadow shadowSample;
+layout(binding = 5) uniform sampler2D depthSample;
+layout(binding = 6) uniform sampler2D hatchCoordinateSample;
+layout(binding = 7) uniform usampler2D objectIDSample;
+
+vec3 fragment_position;
+vec2 hatchCoordinates;
+float ambientOcclusion;  // baked per vertex, 1 where the surface is fully open
+
+float rand(vec2 co) { return fract(sin(dot(co.xy, vec2(12.9898,78.233))) * 43758.5453); }
+float dither(vec2 uv) { return (rand(uv)*2.0-1.0) / 256.0; }
+
+// Froxel containing this pixel, must match the layout in lightClusters.cpp
+uint clusterIndex(float depth) {
+    float z_ndc = depth * 2.0 - 1.0;
+    float view_depth = (2.0 * cluster_near * cluster_far) / (cluster_far + cluster_near - z_ndc * (cluster_far - cluster_near));
+    float slice = log(view_depth / cluster_near) / log(cluster_far / cluster_near) * float(cluster_count.z);
+
+    uvec2 tile = uvec2(gl_FragCoord.xy / screen_size * vec2(cluster_count.xy));
+    tile = min(tile, cluster_count.xy - 1);
+
+    return tile.x + tile.y * cluster_count.x + uint(clamp(slice, 0.0, float(cluster_count.z - 1))) * cluster_count.x * cluster_count.y;
+}
+
+vec4 calculateLight(vec3 normal_out, float depth){
+    // Ambient
+    float ambient_intensity = 0.1;
+    vec3 ambient_color = vec3(255.0, 255.0, 255.0);
+    vec3 ambient = (ambient_color / 255.0) * ambient_intensity * ambientOcclusion;
+
+    // Diffuse and Specular
+    vec3 diffuse = vec3(0.0, 0.0, 0.0);
+    vec3 specular = vec3(0.0, 0.0, 0.0);
+
+    // Only the lights touching this pixel's cluster
+    uvec2 range = cluster_ranges[clusterIndex(depth)];
+
+    for (uint j = 0; j < range.y; j++) {
+        LightSource light = light_source[light_indices[range.x + j]];
+        vec3 light_position = light.position_radius.xyz;
+
+        // Calculate attentuation
+        float d = length(light_position - fragment_position);
+        float la = 0.001;
+        float lb = 0.002;
+        float lc = 0.001;
+        float L = 1 / (la + lb*d + lc*pow(d,2));
+
+        // Fade out towards the radius so the culled lights leave no seams
+        L *= pow(clamp(1.0 - pow(d / light.position_radius.w, 4.0), 0.0, 1.0), 2.0);
+
+        vec3 light_direction = normalize(light_position - fragment_position);
+
+        // Calculate shadows, color.w holds the light's cube map slot or -1 (see shadowMaps.cpp)
+        float shadow_strenght = 1.0;
+#if SHADOWS
+        if (light.color.w >= 0.0) {
+            float bias = max(0.5 * (1.0 - dot(normal_out, light_direction)), 0.05);
+            shadow_strenght = texture(shadowSample, vec4(-light_direction, light.color.w), (d - bias) / light.position_radius.w);
+        }
+#endif
+
+        // Calculate diffuse
+        float diffuse_intensity = max(dot(light_direction, normal_out), 0.0);
+        vec3 diffuse_color = light.color.rgb / 255.0;
+
+        diffuse += diffuse_intensity * diffuse_color * L * shadow_strenght;
+
+        // Calculate specular
+        vec3 reflect_direction = reflect(-light_direction, normal_out);
+        vec3 view_direction = normalize(camera_position - fragment_position);
+        float specular_intensity = pow(max(dot(view_direction, reflect_direction), 0.0), 32);
+        vec3 specular_color = light.color.rgb / 255.0;
+
+        specular += specular_intensity * specular_color * L * shadow_strenght;
+    }
+
+    // Dither
+    float noise = dither(hatchCoordinates);
+
+    return vec4(ambient + diffuse + specular + noise, 1.0);
+}
+
+// Crosshatching from the tonal art map. The tone is picked by brightness as the array
+// layer (layer k holds brightness [k, k+1) * max / layers), strokes follow the surface
+// through the texture coordinates and the mip chain keeps them one texel wide.
+vec4 crosshatch(vec4 base, float brightness, float lod)
+{
+    float layer = clamp(brightness / tonal_art_map_max_brightness, 0.0, 1.0) * tonal_art_map_layers - 0.5;
+    float ink = textureLod(hatchSample, vec3(hatchCoordinates, layer), lod).r;
+    return vec4(base.rgb * ink, base.a);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 albedo = texelFetch(albedoSample, pixel, 0);
+
+    // Background keeps the clear color
+    if (texelFetch(objectIDSample, pixel, 0).r == 0u) {
+        color = albedo;
+        return;
+    }
+
+    // World position from the hardware depth buffer
+    float depth = texelFetch(depthSample, pixel, 0).r;
+    vec4 position = inverse_view_projection * vec4(texCoords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    fragment_position = position.xyz / position.w;
+
+    vec3 normal_out = normalize(texelFetch(normalSample, pixel, 0).rgb * 2.0 - 1.0);
+    vec4 hatch = texelFetch(hatchCoordinateSample, pixel, 0);
+    hatchCoordinates = hatch.xy;
+    ambientOcclusion = hatch.w;
+
+#if DEBUG_VIEW == 1
+    color = calculateLight(normal_out, depth);
+#elif DEBUG_VIEW == 2
+    color = vec4(fract(fragment_position), 1.0);
+#elif DEBUG_VIEW == 3
+    color = vec4(0.5 * normal_out + 0.5, 1.0);
+#else
+    // Compute lighting color
+    vec3 litColor = calculateLight(normal_out, depth).rgb;
+
+#if HATCHING_STYLE == 1
+    // Calculate brightness
+    float brightness = dot(litColor, vec3(0.299, 0.587, 0.114));
+
+    color = crosshatch(albedo, brightness, hatch.z);
+#else
+    color = vec4(albedo.rgb * litColor, albedo.a);
+#endif
+#endif
+}
@@ -0,0 +1,7 @@
+#version 430 core
+
+layout(location = 0) out vec4 color;
+
+void main() {
+    color = vec4(0.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,57 @@
+#version 430 core
+
+// Expands every segment into a quad line_width pixels wide, two triangles per segment
+struct Segment {
+    vec4 start;
+    vec4 end;
+};
+
+layout(std430, binding = 4) readonly buffer SegmentBuffer {
+    Segment segments[];
+};
+
+layout(location = 0) uniform mat4 view_projection;
+layout(location = 1) uniform vec2 screen_size;
+layout(location = 2) uniform float line_width;
+layout(location = 3) uniform vec3 camera_position;
+
+// World space distance the lines are pulled towards the camera, so they win the depth test against their own surface
+uniform float depth_offset = 0.1;
+
+// x picks the endpoint, y the side of the line
+const vec2 corners[6] = vec2[] (
+    vec2(0.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(0.0, -1.0), vec2(1.0, 1.0),  vec2(0.0, 1.0)
+);
+
+vec4 project(vec3 position) {
+    position += normalize(camera_position - position) * depth_offset;
+    return view_projection * vec4(position, 1.0);
+}
+
+void main() {
+    Segment segment = segments[gl_VertexID / 6];
+    vec2 corner = corners[gl_VertexID % 6];
+
+    vec4 clipStart = project(segment.start.xyz);
+    vec4 clipEnd = project(segment.end.xyz);
+
+    // Segments crossing the camera plane are dropped instead of clipped
+    if (clipStart.w <= 0.0 || clipEnd.w <= 0.0) {
+        gl_Position = vec4(0.0, 0.0, 0.0, 0.0);
+        return;
+    }
+
+    vec2 screenStart = clipStart.xy / clipStart.w * screen_size * 0.5;
+    vec2 screenEnd = clipEnd.xy / clipEnd.w * screen_size * 0.5;
+    vec2 direction = screenEnd - screenStart;
+    direction = length(direction) > 0.0 ? normalize(direction) : vec2(1.0, 0.0);
+    vec2 side = vec2(-direction.y, direction.x);
+
+    // Also extend past the endpoints by half the width, so neighbouring segments join without gaps
+    vec2 pixelOffset = (side * corner.y + direction * (corner.x * 2.0 - 1.0)) * line_width * 0.5;
+
+    vec4 position = corner.x == 0.0 ? clipStart : clipEnd;
+    position.xy += pixelOffset / (screen_size * 0.5) * position.w;
+    gl_Position = position;
+}
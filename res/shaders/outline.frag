@@ -0,0 +1,130 @@
+#version 430 core
+
+// Pixel coordinate of this pixel if it lies on an edge, noSeed otherwise
+layout(location = 0) out uvec2 seed;
+in vec2 texCoords;
+
+uniform sampler2D normalTexture;
+uniform sampler2D depthTexture;
+uniform usampler2D objectIDTexture;
+
+// Interior edges need a Sobel response above the threshold, depth differences are scaled first
+uniform float edge_threshold = 0.3;
+uniform float depth_edge_scale = 50.0;
+
+const uint noSeed = 0xFFFFu;
+
+// The kernel constants are defined by initOutlines from outlineKernel.hpp, which the CPU ports share
+const float offset_x = OUTLINE_KERNEL_OFFSET;
+const float offset_y = OUTLINE_KERNEL_OFFSET;
+
+ivec2 pixelOffsets[8] = ivec2[] (
+    ivec2(-1, 1),   ivec2(0, 1),    ivec2(1, 1),
+    ivec2(-1, 0),                   ivec2(1, 0),
+    ivec2(-1, -1),  ivec2(0, -1),   ivec2(1, -1)
+);
+
+vec2 offsets[9] = vec2[] (
+    vec2(-offset_x, offset_y),  vec2(0.0f, offset_y),   vec2(offset_x, offset_y),
+    vec2(-offset_x, 0.0f),      vec2(0.0f, 0.0f),       vec2(offset_x, 0.0f),
+    vec2(-offset_x, -offset_y), vec2(0.0f, -offset_y),  vec2(offset_x, -offset_y)
+);
+
+float kernelX[9] = OUTLINE_KERNEL_X;
+float kernelY[9] = OUTLINE_KERNEL_Y;
+
+// Simple noise, outlineNoise in outlineKernel.hpp
+float hash(vec2 p) {
+    return fract(sin(dot(p ,vec2(127.1, 311.7))) * 43758.5453);
+}
+
+float noise(vec2 uv) {
+    vec2 i = floor(uv);
+    vec2 f = fract(uv);
+
+    float a = hash(i);
+    float b = hash(i + vec2(1.0, 0.0));
+    float c = hash(i + vec2(0.0, 1.0));
+    float d = hash(i + vec2(1.0, 1.0));
+
+    vec2 u = f * f * (3.0 - 2.0 * f); // smoothstep interpolation
+
+    return mix(a, b, u.x) +
+           (c - a)* u.y * (1.0 - u.x) +
+           (d - b) * u.x * u.y;
+}
+
+// Silhouettes between objects (and against the background, ID 0) from plain integer compares
+bool isSilhouette(uint centerID) {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 maxPixel = textureSize(objectIDTexture, 0) - 1;
+    for(int i = 0; i < 8; i++) {
+        ivec2 samplePixel = clamp(pixel + pixelOffsets[i], ivec2(0), maxPixel);
+        if (texelFetch(objectIDTexture, samplePixel, 0).r != centerID) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Creases and folds inside a single object, from normals and linearized depth
+float interiorEdgeStrength(vec3 centerNormal, float centerDepth) {
+    // apply noise on texCoords
+    vec2 uvJitter = texCoords + OUTLINE_JITTER * vec2(
+        noise(texCoords * OUTLINE_NOISE_SCALE),
+        noise(texCoords * OUTLINE_NOISE_SCALE)
+    );
+
+    float normalEdge = 0.0;
+    float depthEdge = 0.0;
+    float gx = 0.0;
+    float gy = 0.0;
+    float depthGx = 0.0;
+    float depthGy = 0.0;
+
+    for(int i = 0; i < 9; i++) {
+        // Normal edge
+        vec3 sampleNormal = texture(normalTexture, uvJitter + offsets[i]).rgb;
+        sampleNormal = normalize(sampleNormal * 2.0 - 1.0);
+        
+        // Calculate how much the normal differs from center
+        float normalDiff = 1.0 - dot(centerNormal, sampleNormal);
+        
+        // Apply your original kernels
+        gx += normalDiff * kernelX[i];
+        gy += normalDiff * kernelY[i];
+
+        // Depth edge
+        float sampleDepth = texture(depthTexture, texCoords + offsets[i]).r;
+        float depthDiff = abs(centerDepth - sampleDepth) * depth_edge_scale;
+
+        depthGx += depthDiff * kernelX[i];
+        depthGy += depthDiff * kernelY[i];
+    }
+
+    // Calculate edge strengths
+    float normalEdgeStrength = sqrt(gx*gx + gy*gy);
+    float depthEdgeStrength = sqrt(depthGx*depthGx + depthGy*depthGy);
+    
+    // Combine edges
+    return max(normalEdgeStrength, depthEdgeStrength);
+}
+
+void main(){
+    vec3 centerNormal = texture(normalTexture, texCoords).rgb;
+    centerNormal = normalize(centerNormal * 2.0 - 1.0); // Convert from [0,1] to [-1,1]
+    float centerDepth = texture(depthTexture, texCoords).r;
+    uint centerID = texelFetch(objectIDTexture, ivec2(gl_FragCoord.xy), 0).r;
+
+    // The normal/depth kernel only runs inside objects
+    bool edge = false;
+    if (isSilhouette(centerID)) {
+        edge = true;
+    }
+    else if (centerID != 0u) {
+        // Apply threshold
+        edge = interiorEdgeStrength(centerNormal, centerDepth) > edge_threshold;
+    }
+
+    seed = edge ? uvec2(gl_FragCoord.xy) : uvec2(noSeed);
+}
@@ -0,0 +1,12 @@
+#version 430 core
+
+in layout(location = 0) vec3 fragment_position;
+
+uniform vec3 light_position;
+uniform float light_radius;
+
+void main()
+{
+    // Store linear distance to the light, normalized by its radius
+    gl_FragDepth = length(fragment_position - light_position) / light_radius;
+}
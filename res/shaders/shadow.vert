@@ -0,0 +1,14 @@
+#version 430 core
+
+in layout(location = 0) vec3 position;
+
+uniform layout(location = 3) mat4 MVP;
+uniform layout(location = 4) mat4 model_matrix;
+
+out layout(location = 0) vec3 position_out;
+
+void main()
+{
+    gl_Position = MVP * vec4(position, 1.0f);
+    position_out = vec3(model_matrix * vec4(position, 1.0f));
+}
@@ -1,97 +1,38 @@
 #version 430 core
 
-struct LightSource {
-    vec3 position;
-    vec3 color;
-};
+// Variant features, defined by the renderer per material (see shaderVariants.hpp)
+#ifndef TEXTURED
+#define TEXTURED 0      // albedo from textureSample, plain white otherwise
+#endif
+#ifndef VERTEX_PULLING
+#define VERTEX_PULLING 0    // per draw data comes from simple.vert instead of uniforms
+#endif
 
 in layout(location = 0) vec3 normal;
 in layout(location = 1) vec2 textureCoordinates;
 in layout(location = 2) vec3 fragment_position;
 in layout(location = 3) mat3 TBN_matrix;
+in layout(location = 7) float ambientOcclusion;
 
-#define number_lights 1
-uniform LightSource light_source[number_lights];
+#if VERTEX_PULLING
+flat in layout(location = 6) uint object_id;
+#else
+uniform layout(location = 8) uint object_id;
+#endif
 
-uniform layout(location = 6) vec3 camera_position;
-uniform layout(location = 7) bool is_texture_map;
+// Hatch tiles per unit of texture coordinates
+uniform float hatch_scale = 8.0;
 
 layout(binding = 0) uniform sampler2D textureSample;
 layout(binding = 1) uniform sampler2D normalSample;
+layout(binding = 2) uniform sampler2DArray hatchSample;
 
-out vec4 color;
-out vec4 normalTexture;
-out vec4 depthTexture;
-
-float rand(vec2 co) { return fract(sin(dot(co.xy, vec2(12.9898,78.233))) * 43758.5453); }
-float dither(vec2 uv) { return (rand(uv)*2.0-1.0) / 256.0; }
-vec3 reject(vec3 from, vec3 onto) {
-    return from - onto*dot(from, onto)/dot(onto, onto);
-}
-vec4 calculateLight(vec3 normal_out){
-    // Ambient
-    float ambient_intensity = 0.1;
-    vec3 ambient_color = vec3(255.0, 255.0, 255.0);
-    vec3 ambient = (ambient_color / 255.0) * ambient_intensity;
-
-    // Diffuse and Specular
-    vec3 diffuse = vec3(0.0, 0.0, 0.0);
-    vec3 specular = vec3(0.0, 0.0, 0.0);
-
-    for (int i = 0; i < number_lights; i++) {
-        // Calculate attentuation
-        float d = length(light_source[i].position - fragment_position);
-        float la = 0.001;
-        float lb = 0.002;
-        float lc = 0.001;
-        float L = 1 / (la + lb*d + lc*pow(d,2));
-
-        // Calculate shadows
-        /*
-        float soft_shadow_radius = float(ball_radius) * 1.3;
-
-        vec3 light_distance = light_source[i].position - fragment_position;
-        vec3 ball_distance = ball_position - fragment_position;
-        float shadow_strenght = 1.0;
-        float rejection_length = length(reject(ball_distance, light_distance));
-        
-        if (length(ball_distance) <= length(light_distance) && dot(light_distance, ball_distance) >= 0) {
-            // Full shadow
-            if (rejection_length <= ball_radius)
-                shadow_strenght = 0.0;
-            // Soft shadow
-            else if (rejection_length <= soft_shadow_radius ) {
-                float t = (rejection_length - float(ball_radius)) / (soft_shadow_radius - float(ball_radius));
-                shadow_strenght = mix(0.0, 1.0, t);
-            }
-        }*/
-
-        // Calculate diffuse
-        vec3 light_direction = normalize(light_source[i].position - fragment_position);
-        float diffuse_intensity = max(dot(light_direction, normal_out), 0.0);
-        // vec3 diffuse_color = vec3(255.0, 255.0, 255.0) / 255.0;
-        vec3 diffuse_color = light_source[i].color / 255.0;
-
-        diffuse += diffuse_intensity * diffuse_color * L;
-
-        // Calculate specular
-        vec3 reflect_direction = reflect(-light_direction, normal_out);
-        vec3 view_direction = normalize(camera_position - fragment_position);
-        float specular_intensity = pow(max(dot(view_direction, reflect_direction), 0.0), 32);
-        // vec3 specular_color = vec3(255.0, 255.0, 255.0) / 255.0;
-        vec3 specular_color = light_source[i].color / 255.0;
-
-        specular += specular_intensity * specular_color * L;
-    }
-
-    // Dither
-    float noise = dither(textureCoordinates);
-
-    // color = vec4(0.5 * normal + 0.5, 1.0);
-    color = vec4(ambient + diffuse + specular + noise, 1.0);
-
-    return color;
-}
+// G-buffer, lit and hatched afterwards by lighting.frag
+layout(location = 0) out vec4 color;
+layout(location = 1) out vec4 normalTexture;
+layout(location = 2) out vec4 depthTexture;
+layout(location = 3) out uint objectIDTexture;
+layout(location = 4) out vec4 hatchCoordinateTexture;
 
 float near = 0.1f;
 float far = 100.0f;
@@ -106,83 +47,20 @@ void main()
     // Normalize normals 2nd time
     vec3 normal_out = normalize(normal);
 
-    if (is_texture_map){
-        // Compute lighting color
-        vec3 litColor = calculateLight(normal_out).rgb;
-
-        // Calculate brightness
-        float brightness = dot(litColor, vec3(0.299, 0.587, 0.114));
-
-        color =  texture(textureSample, textureCoordinates);
-
-        // Add crosshatching
-        if (brightness < 0.5) {
-            if (mod(gl_FragCoord.y, 5.0) <= 1.0) {
-                color = vec4(0.0, 0.0, 0.0, 1.0);
-            }
-        }
+#if TEXTURED
+    color = texture(textureSample, textureCoordinates);
+#else
+    color = vec4(1.0, 1.0, 1.0, 1.0);
+#endif
 
-        if (brightness < 0.35) {
-            if (mod(gl_FragCoord.x, 5.0) <= 1.0) {
-                color = vec4(0.0, 0.0, 0.0, 1.0);
-            }
-        }
-        
-        if (brightness < 0.2) {
-            if (mod(gl_FragCoord.x + gl_FragCoord.y, 5.0) == 0.0) {
-                color = vec4(0.0, 0.0, 0.0, 1.0);
-            }
-        }
-        
-        if (brightness < 0.15) {
-            if (mod(gl_FragCoord.x - gl_FragCoord.y, 5.0) == 0.0) {
-                color = vec4(0.0, 0.0, 0.0, 1.0);
-            }
-        }
-
-        //debug
-        //color = vec4(0.5 * normal_out + 0.5, 1.0);
-        //color = calculateLight(normal_out) * texture(textureSample, textureCoordinates);
-    }
-    else {
-        // Compute lighting color
-        vec3 litColor = calculateLight(normal_out).rgb;
-
-        // Calculate brightness
-        float brightness = dot(litColor, vec3(0.299, 0.587, 0.114));
-        
-        color = vec4(1.0, 1.0, 1.0, 1.0);
-     
-        // Add crosshatching
-        if (brightness < 0.5) {
-            if (mod(gl_FragCoord.y, 5.0) <= 1.0) {
-                color = vec4(0.0, 0.0, 0.0, 1.0);
-            }
-        }
-
-        if (brightness < 0.35) {
-            if (mod(gl_FragCoord.x, 5.0) <= 1.0) {
-                color = vec4(0.0, 0.0, 0.0, 1.0);
-            }
-        }
-        
-        if (brightness < 0.2) {
-            if (mod(gl_FragCoord.x + gl_FragCoord.y, 5.0) == 0.0) {
-                color = vec4(0.0, 0.0, 0.0, 1.0);
-            }
-        }
-        
-        if (brightness < 0.15) {
-            if (mod(gl_FragCoord.x - gl_FragCoord.y, 5.0) == 0.0) {
-                color = vec4(0.0, 0.0, 0.0, 1.0);
-            }
-        }
-
-        // debug
-        //color = calculateLight(normal_out);
-    }
+    // The lighting pass has no derivatives across object boundaries, so the hatch mip level is picked here
+    vec2 hatchCoordinates = textureCoordinates * hatch_scale;
+    float hatchLod = textureQueryLod(hatchSample, hatchCoordinates).y;
 
     // Send normalTexture and linearized depthTexture for post-processing
     normalTexture = vec4(0.5 * normal_out + 0.5, 1.0);
     depthTexture = vec4(vec3(linearizeDepth(gl_FragCoord.z) / far), 1.0);
-}
\ No newline at end of file
+    objectIDTexture = object_id;
+    // The baked occlusion rides along in the spare channel, the lighting pass reads this texel anyway
+    hatchCoordinateTexture = vec4(hatchCoordinates, hatchLod, ambientOcclusion);
+}
@@ -1,24 +1,77 @@
 #version 430 core
 
+// Variant features, defined by the renderer (see shaderVariants.hpp)
+#ifndef VERTEX_PULLING
+#define VERTEX_PULLING 0    // fetch vertices and per draw data from storage buffers, see vertexPulling.hpp
+#endif
+
+#if VERTEX_PULLING
+struct PulledVertex {
+    vec4 position_u;
+    vec4 normal_v;
+    vec4 tangent;       // w is the baked ambient occlusion
+    vec4 bitangent;
+};
+
+struct PulledDraw {
+    mat4 MVP;
+    mat4 model_matrix;
+    mat4 normal_matrix;
+    uvec4 object_id;
+};
+
+layout(std430, binding = 6) readonly buffer PulledVertexBuffer { PulledVertex pulled_vertices[]; };
+layout(std430, binding = 7) readonly buffer PulledDrawBuffer { PulledDraw pulled_draws[]; };
+
+// Advanced per draw through the base instance of the indirect command
+in layout(location = 5) uint draw_index;
+
+flat out layout(location = 6) uint object_id;
+#else
 in layout(location = 0) vec3 position;
 in layout(location = 1) vec3 normal_in;
 in layout(location = 2) vec2 textureCoordinates_in;
 in layout(location = 3) vec3 tangent_in;
 in layout(location = 4) vec3 bitangent_in;
+in layout(location = 6) float ambientOcclusion_in;
 
 uniform layout(location = 3) mat4 MVP;
 uniform layout(location = 4) mat4 model_matrix;
 uniform layout(location = 5) mat3 normal_matrix;
+#endif
 
 out layout(location = 0) vec3 normal_out;
 out layout(location = 1) vec2 textureCoordinates_out;
 out layout(location = 2) vec3 position_out;
 out layout(location = 3) mat3 TBN_matrix;
+out layout(location = 7) float ambientOcclusion_out;
+
+// Keeps depth identical to depth.vert for the GL_EQUAL test after a prepass
+invariant gl_Position;
 
 void main()
 {
+#if VERTEX_PULLING
+    // gl_VertexID already includes the base vertex of the draw
+    PulledVertex vertex = pulled_vertices[gl_VertexID];
+    PulledDraw draw = pulled_draws[draw_index];
+
+    vec3 position = vertex.position_u.xyz;
+    vec3 normal_in = vertex.normal_v.xyz;
+    vec2 textureCoordinates_in = vec2(vertex.position_u.w, vertex.normal_v.w);
+    vec3 tangent_in = vertex.tangent.xyz;
+    vec3 bitangent_in = vertex.bitangent.xyz;
+    float ambientOcclusion_in = vertex.tangent.w;
+
+    mat4 MVP = draw.MVP;
+    mat4 model_matrix = draw.model_matrix;
+    mat3 normal_matrix = mat3(draw.normal_matrix);
+    object_id = draw.object_id.x;
+#endif
+
     normal_out = normalize(normal_matrix * normal_in);
     textureCoordinates_out = textureCoordinates_in;
+    ambientOcclusion_out = ambientOcclusion_in;
     gl_Position = MVP * vec4(position, 1.0f);
     position_out = vec3(model_matrix * vec4(position, 1.0f));
     TBN_matrix = mat3(
@@ -0,0 +1,85 @@
+#include "ambientOcclusion.hpp"
+#include "meshBVH.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utilities/workerPool.hpp>
+
+// Vertices handed to a thread at a time
+static const unsigned int bakeBlockSize = 256;
+
+// Van der Corput sequence, the second coordinate of a Hammersley point set
+static float radicalInverse(unsigned int bits) {
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+    bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+    bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+    return float(bits) * 2.3283064365386963e-10f;
+}
+
+static unsigned int hashIndex(unsigned int value) {
+    value ^= value >> 16;
+    value *= 0x7FEB352Du;
+    value ^= value >> 15;
+    value *= 0x846CA68Bu;
+    value ^= value >> 16;
+    return value;
+}
+
+static float fract(float value) {
+    return value - std::floor(value);
+}
+
+void bakeAmbientOcclusion(Mesh& mesh, WorkerPool& workers) {
+    mesh.ambientOcclusion.assign(mesh.vertices.size(), 1.0f);
+    if (mesh.normals.size() != mesh.vertices.size() || mesh.indices.empty()) {
+        return;
+    }
+
+    MeshBVH bvh;
+    buildMeshBVH(bvh, mesh.vertices, mesh.indices);
+    float diagonal = glm::length(bvh.nodes[0].boundsMax - bvh.nodes[0].boundsMin);
+    // Rays start this far above the surface, so they do not hit the triangles around their vertex
+    float bias = 1e-4f * diagonal;
+
+    unsigned int blockCount = (mesh.vertices.size() + bakeBlockSize - 1) / bakeBlockSize;
+    parallelFor(workers, blockCount, [&](unsigned int block) {
+        unsigned int end = std::min<size_t>((block + 1) * bakeBlockSize, mesh.vertices.size());
+        for (unsigned int vertex = block * bakeBlockSize; vertex < end; vertex++) {
+            glm::vec3 normal = mesh.normals[vertex];
+            float length = glm::length(normal);
+            if (!(length > 0.0f)) {
+                continue;
+            }
+            normal /= length;
+
+            // Tangent frame without a branch on the normal's direction (Duff et al. 2017)
+            float sign = std::copysign(1.0f, normal.z);
+            float a = -1.0f / (sign + normal.z);
+            float b = normal.x * normal.y * a;
+            glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+            glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+
+            // The same point set for every vertex, shifted by a hash of the vertex so neighbours
+            // do not share their errors and the creases show no banding
+            unsigned int hash = hashIndex(vertex);
+            float shiftU = float(hash & 0xFFFF) / 65536.0f;
+            float shiftV = float(hash >> 16) / 65536.0f;
+
+            glm::vec3 origin = mesh.vertices[vertex] + normal * bias;
+            unsigned int open = 0;
+            for (unsigned int ray = 0; ray < ambientOcclusionRays; ray++) {
+                float u = fract((float(ray) + 0.5f) / float(ambientOcclusionRays) + shiftU);
+                float v = fract(radicalInverse(ray) + shiftV);
+                float radius = std::sqrt(u);
+                float angle = 6.28318530718f * v;
+                glm::vec3 direction = tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle))
+                                    + normal * std::sqrt(std::max(1.0f - u, 0.0f));
+                if (!meshBVHOccluded(bvh, origin, direction, ambientOcclusionReach)) {
+                    open++;
+                }
+            }
+            mesh.ambientOcclusion[vertex] = float(open) / float(ambientOcclusionRays);
+        }
+    });
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <utilities/mesh.h>
+#include <utilities/workerPool.hpp>
+
+// Rays per vertex, spread over the hemisphere around the normal in proportion to the cosine
+const unsigned int ambientOcclusionRays = 64;
+// Occluders further away than this, in the mesh's own units, are ignored. Instances scale it
+// along with the mesh, so they darken the same creases at any scale. The props span 4 to 15
+// units and the terrain about 60, where a share of the bounds would reach across its hills.
+const float ambientOcclusionReach = 0.75f;
+
+// Ray traces the mesh against itself on the pool and fills mesh.ambientOcclusion. Only the
+// mesh's own geometry occludes, which keeps the result valid for every instance of it.
+// The result does not depend on the thread count.
+void bakeAmbientOcclusion(Mesh& mesh, WorkerPool& workers);
@@ -0,0 +1,302 @@
+#include "assetCache.hpp"
+#include "ambientOcclusion.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utilities/fileutils.h>
+#include <utilities/imageLoader.hpp>
+#include <utilities/shapes.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bumped whenever the file layout changes
+static const uint32_t assetCacheMagic = 0x33434147; // "GAC3"
+
+// Every entry's data starts on this boundary, so mapped vectors are aligned
+static const size_t assetDataAlignment = 16;
+
+enum AssetKind : uint32_t {
+    ASSET_TEXTURE,
+    ASSET_MODEL
+};
+
+// Fixed size table entries follow the magic and the entry count, the data follows the table
+struct AssetCacheEntry {
+    char path[128];
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    AssetKind kind;
+    uint32_t width;   // textures, RGBA with the bottom row first
+    uint32_t height;
+    uint32_t vertexCount;  // models, followed by the normals, texture coordinates, indices and ambient occlusion
+    uint32_t normalCount;
+    uint32_t textureCoordinateCount;
+    uint32_t indexCount;
+    uint32_t ambientOcclusionCount;
+    float ambientOcclusionReach;  // the bake is redone when ambientOcclusionReach changes
+    uint64_t offset;
+};
+
+static size_t entryBytes(const AssetCacheEntry& entry) {
+    if (entry.kind == ASSET_TEXTURE) {
+        return size_t(entry.width) * entry.height * 4;
+    }
+    return (size_t(entry.vertexCount) + entry.normalCount) * sizeof(glm::vec3)
+         + size_t(entry.textureCoordinateCount) * sizeof(glm::vec2)
+         + size_t(entry.indexCount) * sizeof(unsigned int)
+         + size_t(entry.ambientOcclusionCount) * sizeof(float);
+}
+
+static bool entryIsCurrent(const AssetCacheEntry& entry) {
+    unsigned long long size;
+    long long modified;
+    return fileStamp(entry.path, size, modified) && size == entry.sourceSize && modified == entry.sourceModified
+        && (entry.kind != ASSET_MODEL || entry.ambientOcclusionReach == ambientOcclusionReach);
+}
+
+static const AssetCacheEntry* findEntry(AssetCache& cache, std::string const &path, AssetKind kind) {
+    for (unsigned int i = 0; i < cache.entryCount; i++) {
+        const AssetCacheEntry& entry = cache.entries[i];
+        if (entry.kind == kind && path == entry.path) {
+            return entryIsCurrent(entry) ? &entry : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void openAssetCache(AssetCache& cache, std::string const &path) {
+    cache.data = nullptr;
+    cache.size = 0;
+    cache.entries = nullptr;
+    cache.entryCount = 0;
+
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    cache.contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    const unsigned char* data = cache.contents.data();
+    size_t size = cache.contents.size();
+    if (size == 0) {
+        return;
+    }
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return;
+    }
+    struct stat info;
+    size_t size = fstat(file, &info) == 0 ? size_t(info.st_size) : 0;
+    void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0) : MAP_FAILED;
+    close(file);
+    if (mapping == MAP_FAILED) {
+        return;
+    }
+    const unsigned char* data = static_cast<const unsigned char*>(mapping);
+#endif
+
+    uint32_t magic = 0, count = 0;
+    if (size >= 8) {
+        memcpy(&magic, data, 4);
+        memcpy(&count, data + 4, 4);
+    }
+    size_t tableEnd = 8 + size_t(count) * sizeof(AssetCacheEntry);
+    bool valid = magic == assetCacheMagic && tableEnd <= size;
+    const AssetCacheEntry* entries = reinterpret_cast<const AssetCacheEntry*>(data + 8);
+    for (uint32_t i = 0; valid && i < count; i++) {
+        valid = entries[i].path[sizeof(entries[i].path) - 1] == '\0'
+             && entries[i].offset >= tableEnd && entries[i].offset + entryBytes(entries[i]) <= size;
+    }
+
+    cache.data = data;
+    cache.size = size;
+    if (!valid) {
+        std::cout << "Ignoring the asset cache in " << path << ", it is damaged or from another version" << std::endl;
+        closeAssetCache(cache);
+        return;
+    }
+    cache.entries = entries;
+    cache.entryCount = count;
+}
+
+void closeAssetCache(AssetCache& cache) {
+#ifndef _WIN32
+    if (cache.data) {
+        munmap(const_cast<unsigned char*>(cache.data), cache.size);
+    }
+#endif
+    cache.contents.clear();
+    cache.data = nullptr;
+    cache.size = 0;
+    cache.entries = nullptr;
+    cache.entryCount = 0;
+}
+
+template <class T>
+static void appendBytes(std::vector<unsigned char>& data, const std::vector<T>& values) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values.data());
+    data.insert(data.end(), bytes, bytes + values.size() * sizeof(T));
+}
+
+static bool newEntry(AssetCacheEntry& entry, std::string const &path, AssetKind kind) {
+    memset(&entry, 0, sizeof(entry));
+    unsigned long long size;
+    long long modified;
+    if (path.size() >= sizeof(entry.path) || !fileStamp(path, size, modified)) {
+        return false;
+    }
+    memcpy(entry.path, path.c_str(), path.size());
+    entry.sourceSize = size;
+    entry.sourceModified = modified;
+    entry.kind = kind;
+    if (kind == ASSET_MODEL) {
+        entry.ambientOcclusionReach = ambientOcclusionReach;
+    }
+    return true;
+}
+
+// Started with the first bake and kept for the others, on every core
+static WorkerPool bakeWorkers;
+
+// Imports a model and bakes its ambient occlusion, which is what the cache holds for it
+static Mesh loadBakedModel(std::string const &path) {
+    Mesh mesh = loadModel(path);
+    if (bakeWorkers.threads.empty()) {
+        initWorkerPool(bakeWorkers, 0);
+    }
+    bakeAmbientOcclusion(mesh, bakeWorkers);
+    return mesh;
+}
+
+void buildAssetCache(std::string const &path, std::vector<std::string> const &textures, std::vector<std::string> const &models) {
+    AssetCache existing;
+    openAssetCache(existing, path);
+    bool current = true;
+    for (std::string const &texture : textures) {
+        current = current && findEntry(existing, texture, ASSET_TEXTURE) != nullptr;
+    }
+    for (std::string const &model : models) {
+        current = current && findEntry(existing, model, ASSET_MODEL) != nullptr;
+    }
+    closeAssetCache(existing);
+    if (current) {
+        return;
+    }
+
+    // Files that cannot be cached are left out, loading them later reports the error
+    std::vector<AssetCacheEntry> entries;
+    std::vector<std::vector<unsigned char>> blobs;
+    for (std::string const &texture : textures) {
+        AssetCacheEntry entry;
+        if (!newEntry(entry, texture, ASSET_TEXTURE)) {
+            continue;
+        }
+        PNGImage image = loadPNGFile(texture);
+        entry.width = image.width;
+        entry.height = image.height;
+        if (image.pixels.size() != entryBytes(entry)) {
+            continue;
+        }
+        entries.push_back(entry);
+        blobs.push_back(std::move(image.pixels));
+    }
+    for (std::string const &model : models) {
+        AssetCacheEntry entry;
+        if (!newEntry(entry, model, ASSET_MODEL)) {
+            continue;
+        }
+        Mesh mesh = loadBakedModel(model);
+        entry.vertexCount = mesh.vertices.size();
+        entry.normalCount = mesh.normals.size();
+        entry.textureCoordinateCount = mesh.textureCoordinates.size();
+        entry.indexCount = mesh.indices.size();
+        entry.ambientOcclusionCount = mesh.ambientOcclusion.size();
+        std::vector<unsigned char> blob;
+        appendBytes(blob, mesh.vertices);
+        appendBytes(blob, mesh.normals);
+        appendBytes(blob, mesh.textureCoordinates);
+        appendBytes(blob, mesh.indices);
+        appendBytes(blob, mesh.ambientOcclusion);
+        entries.push_back(entry);
+        blobs.push_back(std::move(blob));
+    }
+
+    size_t offset = 8 + entries.size() * sizeof(AssetCacheEntry);
+    for (size_t i = 0; i < entries.size(); i++) {
+        offset = (offset + assetDataAlignment - 1) / assetDataAlignment * assetDataAlignment;
+        entries[i].offset = offset;
+        offset += blobs[i].size();
+    }
+
+    std::string temporaryPath = temporaryFilePath(path);
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "Could not write the asset cache to " << path << std::endl;
+        return;
+    }
+    uint32_t count = entries.size();
+    file.write(reinterpret_cast<const char*>(&assetCacheMagic), sizeof(assetCacheMagic));
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetCacheEntry));
+    const char padding[assetDataAlignment] = {};
+    for (size_t i = 0; i < entries.size(); i++) {
+        file.write(padding, entries[i].offset - size_t(file.tellp()));
+        file.write(reinterpret_cast<const char*>(blobs[i].data()), blobs[i].size());
+    }
+    file.close();
+    if (!replaceFile(temporaryPath, path)) {
+        std::cout << "Could not write the asset cache to " << path << std::endl;
+        return;
+    }
+
+    std::cout << "Asset cache: decoded " << entries.size() << " textures and models into " << path
+              << " (" << offset / 1024 << " KiB)" << std::endl;
+}
+
+unsigned int loadCachedTexture(AssetCache& cache, std::string const &path) {
+    const AssetCacheEntry* entry = findEntry(cache, path, ASSET_TEXTURE);
+    if (!entry) {
+        return generateTextureID(loadPNGFile(path));
+    }
+    return generateTextureID(entry->width, entry->height, cache.data + entry->offset);
+}
+
+PNGImage loadCachedImage(AssetCache& cache, std::string const &path) {
+    const AssetCacheEntry* entry = findEntry(cache, path, ASSET_TEXTURE);
+    if (!entry) {
+        return loadPNGFile(path);
+    }
+    PNGImage image;
+    image.width = entry->width;
+    image.height = entry->height;
+    image.pixels.assign(cache.data + entry->offset, cache.data + entry->offset + entryBytes(*entry));
+    return image;
+}
+
+template <class T>
+static const unsigned char* copyValues(const unsigned char* data, uint32_t count, std::vector<T>& values) {
+    values.resize(count);
+    memcpy(values.data(), data, count * sizeof(T));
+    return data + count * sizeof(T);
+}
+
+Mesh loadCachedModel(AssetCache& cache, std::string const &path) {
+    const AssetCacheEntry* entry = findEntry(cache, path, ASSET_MODEL);
+    if (!entry) {
+        return loadBakedModel(path);
+    }
+    Mesh mesh;
+    const unsigned char* data = cache.data + entry->offset;
+    data = copyValues(data, entry->vertexCount, mesh.vertices);
+    data = copyValues(data, entry->normalCount, mesh.normals);
+    data = copyValues(data, entry->textureCoordinateCount, mesh.textureCoordinates);
+    data = copyValues(data, entry->indexCount, mesh.indices);
+    copyValues(data, entry->ambientOcclusionCount, mesh.ambientOcclusion);
+    return mesh;
+}
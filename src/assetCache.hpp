@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utilities/imageLoader.hpp>
+#include <utilities/mesh.h>
+
+// Decoded textures and imported models in one file, so PNG decoding and model import happen once
+// instead of in every render process. The file is memory mapped read-only, processes rendering
+// at the same time share its pages.
+struct AssetCacheEntry;
+
+struct AssetCache {
+    const unsigned char* data;  // null when there is no usable cache, every load then reads the source
+    size_t size;
+    const AssetCacheEntry* entries;
+    unsigned int entryCount;
+    std::vector<unsigned char> contents;  // holds the file where it cannot be mapped
+};
+
+// Decodes the given files into the cache at path. Does nothing if the cache already holds
+// every one of them and none changed since. Needs no GL context.
+void buildAssetCache(std::string const &path, std::vector<std::string> const &textures, std::vector<std::string> const &models);
+
+void openAssetCache(AssetCache& cache, std::string const &path);
+void closeAssetCache(AssetCache& cache);
+
+// Both fall back on decoding the source when it is not cached or changed after the cache was built
+unsigned int loadCachedTexture(AssetCache& cache, std::string const &path);
+Mesh loadCachedModel(AssetCache& cache, std::string const &path);
+
+// The decoded pixels of a texture, for renderers that sample it without GL
+PNGImage loadCachedImage(AssetCache& cache, std::string const &path);
@@ -0,0 +1,143 @@
+#include "colorConversion.hpp"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLOR_CONVERSION_SSE2
+#include <emmintrin.h>
+#endif
+
+// BT.601 studio range in 8 bit fixed point. The SSE2 paths use the same integer
+// arithmetic, so both produce identical output.
+static const int lumaR = 66, lumaG = 129, lumaB = 25;
+static const int chromaUR = -38, chromaUG = -74, chromaUB = 112;
+static const int chromaVR = 112, chromaVG = -94, chromaVB = -18;
+
+static inline unsigned char luma(const unsigned char* pixel) {
+    return (unsigned char) (((lumaR * pixel[0] + lumaG * pixel[1] + lumaB * pixel[2] + 128) >> 8) + 16);
+}
+
+// Takes channel sums of four pixels, the extra two bits of the shift average them
+static inline unsigned char chroma(int r, int g, int b, int weightR, int weightG, int weightB) {
+    return (unsigned char) (((weightR * r + weightG * g + weightB * b + 512) >> 10) + 128);
+}
+
+// GL rows start at the bottom of the image
+static inline const unsigned char* sourceRow(const unsigned char* rgba, int width, int height, int y) {
+    return rgba + size_t(height - 1 - y) * width * 4;
+}
+
+#ifdef COLOR_CONVERSION_SSE2
+// Weighted sums of four pixels held as 16 bit channels, two per register, as 32 bit integers
+static inline __m128i dotPixels(__m128i firstPair, __m128i secondPair, __m128i weights) {
+    __m128i first = _mm_madd_epi16(firstPair, weights);    // r+g and b+a terms of both pixels
+    __m128i second = _mm_madd_epi16(secondPair, weights);
+    first = _mm_add_epi32(first, _mm_srli_epi64(first, 32));
+    second = _mm_add_epi32(second, _mm_srli_epi64(second, 32));
+    first = _mm_shuffle_epi32(first, _MM_SHUFFLE(3, 1, 2, 0));
+    second = _mm_shuffle_epi32(second, _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm_unpacklo_epi64(first, second);
+}
+#endif
+
+static void lumaRow(const unsigned char* row, int width, unsigned char* out) {
+    int x = 0;
+#ifdef COLOR_CONVERSION_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(lumaR, lumaG, lumaB, 0, lumaR, lumaG, lumaB, 0);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i offset = _mm_set1_epi16(16);
+    for (; x + 16 <= width; x += 16) {
+        __m128i sums[4];
+        for (int i = 0; i < 4; i++) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*) (row + (x + 4 * i) * 4));
+            __m128i sum = dotPixels(_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero), weights);
+            sums[i] = _mm_srli_epi32(_mm_add_epi32(sum, round), 8);
+        }
+        __m128i low = _mm_add_epi16(_mm_packs_epi32(sums[0], sums[1]), offset);
+        __m128i high = _mm_add_epi16(_mm_packs_epi32(sums[2], sums[3]), offset);
+        _mm_storeu_si128((__m128i*) (out + x), _mm_packus_epi16(low, high));
+    }
+#endif
+    for (; x < width; x++) {
+        out[x] = luma(row + x * 4);
+    }
+}
+
+// One row of chroma from two rows of pixels, which are the same row at the bottom of an odd height
+static void chromaRow(const unsigned char* row0, const unsigned char* row1, int width,
+                      unsigned char* uOut, unsigned char* vOut) {
+    int chromaWidth = (width + 1) / 2;
+    int x = 0;
+#ifdef COLOR_CONVERSION_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i uWeights = _mm_setr_epi16(chromaUR, chromaUG, chromaUB, 0, chromaUR, chromaUG, chromaUB, 0);
+    const __m128i vWeights = _mm_setr_epi16(chromaVR, chromaVG, chromaVB, 0, chromaVR, chromaVG, chromaVB, 0);
+    const __m128i round = _mm_set1_epi32(512);
+    const __m128i offset = _mm_set1_epi16(128);
+    // Eight pixels of both rows make four chroma samples
+    for (; 2 * x + 8 <= width; x += 4) {
+        __m128i blockSums[4];
+        for (int i = 0; i < 2; i++) {
+            __m128i top = _mm_loadu_si128((const __m128i*) (row0 + (2 * x + 4 * i) * 4));
+            __m128i bottom = _mm_loadu_si128((const __m128i*) (row1 + (2 * x + 4 * i) * 4));
+            // Vertical sums of two pixel columns each, then each pair of columns summed into the low half
+            __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+            __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+            blockSums[2 * i] = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+            blockSums[2 * i + 1] = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+        }
+        __m128i firstBlocks = _mm_unpacklo_epi64(blockSums[0], blockSums[1]);
+        __m128i secondBlocks = _mm_unpacklo_epi64(blockSums[2], blockSums[3]);
+
+        __m128i u = _mm_srai_epi32(_mm_add_epi32(dotPixels(firstBlocks, secondBlocks, uWeights), round), 10);
+        __m128i v = _mm_srai_epi32(_mm_add_epi32(dotPixels(firstBlocks, secondBlocks, vWeights), round), 10);
+        __m128i uv = _mm_add_epi16(_mm_packs_epi32(u, v), offset);
+        __m128i bytes = _mm_packus_epi16(uv, uv);
+        int uBytes = _mm_cvtsi128_si32(bytes);
+        int vBytes = _mm_cvtsi128_si32(_mm_srli_si128(bytes, 4));
+        std::copy((unsigned char*) &uBytes, (unsigned char*) &uBytes + 4, uOut + x);
+        std::copy((unsigned char*) &vBytes, (unsigned char*) &vBytes + 4, vOut + x);
+    }
+#endif
+    for (; x < chromaWidth; x++) {
+        // The last column of an odd width is counted twice
+        const unsigned char* pixels[4] = {
+            row0 + 2 * x * 4, row0 + std::min(2 * x + 1, width - 1) * 4,
+            row1 + 2 * x * 4, row1 + std::min(2 * x + 1, width - 1) * 4
+        };
+        int r = 0, g = 0, b = 0;
+        for (const unsigned char* pixel : pixels) {
+            r += pixel[0];
+            g += pixel[1];
+            b += pixel[2];
+        }
+        uOut[x] = chroma(r, g, b, chromaUR, chromaUG, chromaUB);
+        vOut[x] = chroma(r, g, b, chromaVR, chromaVG, chromaVB);
+    }
+}
+
+void rgbaToYUV420(const unsigned char* rgba, int width, int height,
+                  unsigned char* yPlane, unsigned char* uPlane, unsigned char* vPlane) {
+    for (int y = 0; y < height; y++) {
+        lumaRow(sourceRow(rgba, width, height, y), width, yPlane + size_t(y) * width);
+    }
+
+    int chromaWidth = (width + 1) / 2;
+    for (int y = 0; y < (height + 1) / 2; y++) {
+        const unsigned char* row0 = sourceRow(rgba, width, height, 2 * y);
+        const unsigned char* row1 = sourceRow(rgba, width, height, std::min(2 * y + 1, height - 1));
+        chromaRow(row0, row1, width, uPlane + size_t(y) * chromaWidth, vPlane + size_t(y) * chromaWidth);
+    }
+}
+
+void rgbaToRGB(const unsigned char* rgba, int width, int height, unsigned char* rgb) {
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = sourceRow(rgba, width, height, y);
+        unsigned char* out = rgb + size_t(y) * width * 3;
+        for (int x = 0; x < width; x++) {
+            out[x * 3] = row[x * 4];
+            out[x * 3 + 1] = row[x * 4 + 1];
+            out[x * 3 + 2] = row[x * 4 + 2];
+        }
+    }
+}
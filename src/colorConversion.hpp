@@ -0,0 +1,12 @@
+#pragma once
+
+// Conversions of frames read back from GL, RGBA with the bottom row first, into top row
+// first video layouts. Both take the source and write planes of the same width and height.
+
+// Planar 4:2:0 with BT.601 studio range, as expected by Y4M. Chroma planes are
+// (width + 1) / 2 by (height + 1) / 2, averaging each 2x2 block of pixels.
+void rgbaToYUV420(const unsigned char* rgba, int width, int height,
+                  unsigned char* yPlane, unsigned char* uPlane, unsigned char* vPlane);
+
+// Packed 8 bit RGB without the alpha channel
+void rgbaToRGB(const unsigned char* rgba, int width, int height, unsigned char* rgb);
@@ -0,0 +1,349 @@
+#include "frameOutput.hpp"
+#include "colorConversion.hpp"
+#include <utilities/window.hpp>
+#include <lodepng.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#include <unistd.h>
+#endif
+
+bool frameOutputFormatFromName(std::string const &name, FrameOutputFormat& format) {
+    if (name == "png") {
+        format = OUTPUT_PNG;
+    } else if (name == "y4m") {
+        format = OUTPUT_Y4M;
+    } else if (name == "rgb") {
+        format = OUTPUT_RAW_RGB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string frameOutputPath(std::string const &pathPattern, int frameIndex) {
+    std::string path = pathPattern;
+    size_t first = path.find('#');
+    size_t digits = 0;
+    if (first == std::string::npos) {
+        size_t extension = path.rfind('.');
+        first = (extension == std::string::npos || extension < path.find_last_of("/\\") + 1) ? path.size() : extension;
+        path.insert(first, "_");
+        first++;
+        digits = 5;
+    } else {
+        while (first + digits < path.size() && path[first + digits] == '#') {
+            digits++;
+        }
+        path.erase(first, digits);
+    }
+
+    std::string number = std::to_string(frameIndex);
+    if (number.size() < digits) {
+        number.insert(0, digits - number.size(), '0');
+    }
+    path.insert(first, number);
+    return path;
+}
+
+// GL rows start at the bottom, and the alpha left in the framebuffer is not part of the image
+static void flipOpaque(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& image) {
+    size_t rowSize = size_t(width) * 4;
+    for (int y = 0; y < height; y++) {
+        memcpy(&image[(height - 1 - y) * rowSize], &rgba[y * rowSize], rowSize);
+    }
+    for (size_t i = 3; i < image.size(); i += 4) {
+        image[i] = 255;
+    }
+}
+
+static std::string y4mHeader(int width, int height) {
+    // 4:2:0 with chroma centred between the pixels it averages, which Y4M calls jpeg siting
+    return "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F" + std::to_string(headlessFrameRate)
+         + ":1 Ip A1:1 C420jpeg\n";
+}
+
+std::vector<unsigned char> encodeFrame(FrameOutputFormat format, const unsigned char* rgba, int width, int height) {
+    std::vector<unsigned char> encoded;
+    size_t pixels = size_t(width) * height;
+    if (format == OUTPUT_PNG) {
+        std::vector<unsigned char> image(pixels * 4);
+        flipOpaque(rgba, width, height, image);
+        lodepng::encode(encoded, image, width, height);
+    } else if (format == OUTPUT_Y4M) {
+        std::string header = y4mHeader(width, height) + "FRAME\n";
+        size_t chromaSize = size_t((width + 1) / 2) * ((height + 1) / 2);
+        encoded.resize(header.size() + pixels + 2 * chromaSize);
+        std::copy(header.begin(), header.end(), encoded.begin());
+        unsigned char* planes = &encoded[header.size()];
+        rgbaToYUV420(rgba, width, height, planes, planes + pixels, planes + pixels + chromaSize);
+    } else {
+        encoded.resize(pixels * 3);
+        rgbaToRGB(rgba, width, height, encoded.data());
+    }
+    return encoded;
+}
+
+static void writePNG(FrameOutput* output, EncodeJob& job, std::vector<unsigned char>& image) {
+    flipOpaque(job.pixels.data(), output->width, output->height, image);
+
+    std::string path = frameOutputPath(output->pathPattern, job.frameIndex);
+    unsigned error = lodepng::encode(path, image, output->width, output->height);
+    if (error) {
+        std::lock_guard<std::mutex> lock(output->mutex);
+        std::cerr << "Could not write " << path << ": " << lodepng_error_text(error) << std::endl;
+    } else {
+        output->framesWritten++;
+    }
+}
+
+// Only ever called from the single stream encoder, so writes need no lock
+static void writeVideoFrame(FrameOutput* output, EncodeJob& job, std::vector<unsigned char>& image) {
+    if (output->streamFailed) {
+        return;
+    }
+
+    if (output->format == OUTPUT_Y4M) {
+        size_t lumaSize = size_t(output->width) * output->height;
+        size_t chromaSize = size_t((output->width + 1) / 2) * ((output->height + 1) / 2);
+        rgbaToYUV420(job.pixels.data(), output->width, output->height,
+                     &image[0], &image[lumaSize], &image[lumaSize + chromaSize]);
+        fputs("FRAME\n", output->stream);
+    } else {
+        rgbaToRGB(job.pixels.data(), output->width, output->height, image.data());
+    }
+
+    // A closed pipe ends the stream, rendering carries on so the run still finishes normally
+    if (fwrite(image.data(), 1, image.size(), output->stream) != image.size()) {
+        output->streamFailed = true;
+        std::cerr << "Could not write frame " << job.frameIndex << " to " << output->pathPattern << ", stopping the stream" << std::endl;
+        return;
+    }
+    output->framesWritten++;
+}
+
+static size_t encodedFrameSize(FrameOutput* output) {
+    size_t pixels = size_t(output->width) * output->height;
+    switch (output->format) {
+        case OUTPUT_Y4M:
+            return pixels + 2 * size_t((output->width + 1) / 2) * ((output->height + 1) / 2);
+        case OUTPUT_RAW_RGB:
+            return pixels * 3;
+        default:
+            return pixels * 4;
+    }
+}
+
+static void encodeFrames(FrameOutput* output) {
+    std::vector<unsigned char> image(encodedFrameSize(output));
+
+    while (true) {
+        EncodeJob job;
+        {
+            std::unique_lock<std::mutex> lock(output->mutex);
+            output->jobAvailable.wait(lock, [output]() { return !output->queue.empty() || output->stopping; });
+            if (output->queue.empty()) {
+                return;
+            }
+            job = std::move(output->queue.front());
+            output->queue.pop_front();
+        }
+        output->jobTaken.notify_one();
+
+        if (output->format == OUTPUT_PNG) {
+            writePNG(output, job, image);
+        } else {
+            writeVideoFrame(output, job, image);
+        }
+
+        std::lock_guard<std::mutex> lock(output->mutex);
+        output->freeBuffers.push_back(std::move(job.pixels));
+    }
+}
+
+// The real standard output once reserveStandardOutput moved file descriptor 1 to standard error
+static FILE* standardOutputStream = nullptr;
+
+void reserveStandardOutput() {
+    std::cout.flush();
+    fflush(stdout);
+#ifdef _WIN32
+    int streamFile = _dup(_fileno(stdout));
+    _dup2(_fileno(stderr), _fileno(stdout));
+    _setmode(streamFile, _O_BINARY);
+    standardOutputStream = _fdopen(streamFile, "wb");
+#else
+    int streamFile = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    standardOutputStream = fdopen(streamFile, "wb");
+#endif
+}
+
+FILE* openOutputStream(std::string const &path) {
+#ifndef _WIN32
+    // A reader closing the pipe becomes a write error instead of killing the program
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    // Named pipes block here until a reader opens them
+    FILE* stream = path == "-" ? standardOutputStream : fopen(path.c_str(), "wb");
+    if (!stream) {
+        std::cerr << "Could not open " << path << " for writing" << std::endl;
+    }
+    return stream;
+}
+
+static bool openStream(FrameOutput& output) {
+    output.stream = openOutputStream(output.pathPattern);
+    if (!output.stream) {
+        return false;
+    }
+
+    if (output.format == OUTPUT_Y4M) {
+        fputs(y4mHeader(output.width, output.height).c_str(), output.stream);
+    }
+    return true;
+}
+
+bool initFrameOutput(FrameOutput& output, int width, int height, FrameOutputFormat format,
+                     std::string const &pathPattern, unsigned int encoderThreads) {
+    output.width = width;
+    output.height = height;
+    output.pathPattern = pathPattern;
+    output.format = format;
+    output.stream = nullptr;
+    output.streamFailed = false;
+    if (format != OUTPUT_PNG) {
+        if (!openStream(output)) {
+            return false;
+        }
+        // Frames have to reach the stream in order
+        encoderThreads = 1;
+    }
+
+    size_t frameSize = size_t(width) * height * 4;
+    for (ReadbackSlot& slot : output.slots) {
+        glGenBuffers(1, &slot.pixelBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+        slot.fence = nullptr;
+        slot.frameIndex = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    output.nextSlot = 0;
+
+    if (encoderThreads == 0) {
+        encoderThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+    output.queueLimit = format == OUTPUT_PNG ? encoderThreads * encodeQueuePerThread : streamQueueLength;
+    output.stopping = false;
+    output.framesCaptured = 0;
+    output.fenceWaits = 0;
+    output.backPressureWaits = 0;
+    output.framesWritten = 0;
+    for (unsigned int i = 0; i < encoderThreads; i++) {
+        output.encoders.emplace_back(encodeFrames, &output);
+    }
+    const char* formatNames[] = { "PNG", "Y4M", "raw RGB" };
+    std::cout << "Writing " << formatNames[format] << " frames to " << (format == OUTPUT_PNG ? frameOutputPath(pathPattern, 0) : pathPattern)
+              << " with " << encoderThreads << " encoder threads" << std::endl;
+    return true;
+}
+
+static void queueEncodeJob(FrameOutput& output, EncodeJob job) {
+    std::unique_lock<std::mutex> lock(output.mutex);
+    if (output.queue.size() >= output.queueLimit) {
+        output.backPressureWaits++;
+        output.jobTaken.wait(lock, [&output]() { return output.queue.size() < output.queueLimit; });
+    }
+    output.queue.push_back(std::move(job));
+    lock.unlock();
+    output.jobAvailable.notify_one();
+}
+
+// Copies a finished frame out of its pixel buffer and hands it to the encoders
+static void retireSlot(FrameOutput& output, ReadbackSlot& slot) {
+    if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+        output.fenceWaits++;
+        while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    EncodeJob job;
+    job.frameIndex = slot.frameIndex;
+    {
+        std::lock_guard<std::mutex> lock(output.mutex);
+        if (!output.freeBuffers.empty()) {
+            job.pixels = std::move(output.freeBuffers.back());
+            output.freeBuffers.pop_back();
+        }
+    }
+    size_t frameSize = size_t(output.width) * output.height * 4;
+    job.pixels.resize(frameSize);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+    void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(job.pixels.data(), mapped, frameSize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    queueEncodeJob(output, std::move(job));
+}
+
+void captureFrame(FrameOutput& output, unsigned int framebuffer, int frameIndex) {
+    ReadbackSlot& slot = output.slots[output.nextSlot];
+    output.nextSlot = (output.nextSlot + 1) % readbackRingSize;
+    if (slot.fence) {
+        retireSlot(output, slot);
+    }
+
+    // The read lands in the pixel buffer, glReadPixels returns without waiting for the GPU
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pixelBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, output.width, output.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frameIndex = frameIndex;
+    output.framesCaptured++;
+}
+
+void finishFrameOutput(FrameOutput& output) {
+    // Oldest first, so frames reach the encoders in order
+    for (unsigned int i = 0; i < readbackRingSize; i++) {
+        ReadbackSlot& slot = output.slots[(output.nextSlot + i) % readbackRingSize];
+        if (slot.fence) {
+            retireSlot(output, slot);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(output.mutex);
+        output.stopping = true;
+    }
+    output.jobAvailable.notify_all();
+    for (std::thread& encoder : output.encoders) {
+        encoder.join();
+    }
+    output.encoders.clear();
+
+    for (ReadbackSlot& slot : output.slots) {
+        glDeleteBuffers(1, &slot.pixelBuffer);
+    }
+    if (output.stream) {
+        fclose(output.stream);
+        output.stream = nullptr;
+    }
+
+    std::cout << "Wrote " << output.framesWritten << " of " << output.framesCaptured << " frames, waited "
+              << output.fenceWaits << " times for the GPU and " << output.backPressureWaits << " times for the encoders" << std::endl;
+}
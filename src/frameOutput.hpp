@@ -0,0 +1,99 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frames in flight between the GPU and the CPU. A slot is only mapped again when it comes
+// around in the ring, by which time the GPU has long finished with it, so reading back
+// never waits on the frame just submitted.
+const unsigned int readbackRingSize = 3;
+
+// Frames waiting for an encoder, per encoder thread. Rendering blocks once the queue is full,
+// so a slow disk cannot make the queue grow without bound.
+const unsigned int encodeQueuePerThread = 2;
+
+// Video streams have a single writer, a longer queue rides out stalls of the reading process
+const unsigned int streamQueueLength = 8;
+
+enum FrameOutputFormat {
+    OUTPUT_PNG,      // one image per frame
+    OUTPUT_Y4M,      // uncompressed 4:2:0 video stream, read by ffmpeg and most encoders
+    OUTPUT_RAW_RGB   // headerless packed RGB frames
+};
+
+struct ReadbackSlot {
+    unsigned int pixelBuffer;
+    GLsync fence;  // null while the slot holds no frame
+    int frameIndex;
+};
+
+struct EncodeJob {
+    std::vector<unsigned char> pixels;  // RGBA with the bottom row first, as read from GL
+    int frameIndex;
+};
+
+// Copies finished frames out through a ring of pixel buffers and writes them as PNG
+// images on a pool of encoder threads, while the GPU continues with the next frames.
+// Video streams go to a file or pipe from a single thread, which keeps the frames in order.
+struct FrameOutput {
+    int width;
+    int height;
+    std::string pathPattern;
+    FrameOutputFormat format;
+    FILE* stream;      // video formats only
+    bool streamFailed;
+
+    ReadbackSlot slots[readbackRingSize];
+    unsigned int nextSlot;
+
+    std::vector<std::thread> encoders;
+    std::deque<EncodeJob> queue;
+    std::vector<std::vector<unsigned char>> freeBuffers;  // pixels of written frames, reused by later jobs
+    size_t queueLimit;
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobTaken;
+
+    // Counters for the summary
+    unsigned int framesCaptured;
+    unsigned int fenceWaits;         // the GPU had not finished a frame when its slot came around
+    unsigned int backPressureWaits;  // every encoder was busy and the queue was full
+    std::atomic<unsigned int> framesWritten;
+};
+
+// Maps "png", "y4m" and "rgb" to a format, returns false for anything else
+bool frameOutputFormatFromName(std::string const &name, FrameOutputFormat& format);
+
+// One frame in memory in the given format, a Y4M image is a stream of a single frame.
+// Takes RGBA with the bottom row first, as read from GL.
+std::vector<unsigned char> encodeFrame(FrameOutputFormat format, const unsigned char* rgba, int width, int height);
+
+// Path of a frame: a run of '#' in the pattern becomes the zero padded frame number,
+// without one the number is added in front of the extension
+std::string frameOutputPath(std::string const &pathPattern, int frameIndex);
+
+// Moves everything the program prints to standard error, so standard output can carry a video
+// stream. Has to be called before anything is printed when the output path is "-".
+void reserveStandardOutput();
+
+// Opens a video output for writing, "-" is standard output. Returns null with a message on failure.
+FILE* openOutputStream(std::string const &path);
+
+// Zero encoder threads uses one per core, leaving one for rendering. Video formats write to the
+// path as is, "-" for standard output. Returns false if the stream could not be opened.
+bool initFrameOutput(FrameOutput& output, int width, int height, FrameOutputFormat format,
+                     std::string const &pathPattern, unsigned int encoderThreads);
+
+// Queues a read of the framebuffer's color buffer. Call after the frame is drawn, before swapping buffers.
+void captureFrame(FrameOutput& output, unsigned int framebuffer, int frameIndex);
+
+// Writes every frame still in flight and stops the encoders
+void finishFrameOutput(FrameOutput& output);
@@ -0,0 +1,173 @@
+#include "frameWorkers.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frameOutput.hpp"
+#include "gamelogic.h"
+#include "headless.hpp"
+#include "program.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct FrameWorker {
+    pid_t process;
+    int firstFrame;
+    int frameCount;
+    std::string segmentPath;  // video formats only
+};
+
+static int runWorker(CommandLineOptions options, FrameWorker const &worker, unsigned int index, unsigned int workerCount, bool stream) {
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned int coresPerWorker = std::max(cores / workerCount, 1u);
+
+    // llvmpipe starts a rasterizer thread per core in every process, so a share of the cores each
+    // keeps the machine from being oversubscribed. A value set by the user wins.
+    setenv("LP_NUM_THREADS", std::to_string(coresPerWorker).c_str(), 0);
+
+    options.firstFrame = worker.firstFrame;
+    options.headlessFrames = worker.frameCount;
+    options.workers = 1;
+    if (stream) {
+        options.outputPattern = worker.segmentPath;
+    }
+    if (options.encoderThreads == 0) {
+        options.encoderThreads = coresPerWorker;
+    }
+    options.rasterThreads = coresPerWorker;
+
+    // The first worker's log stands for all of them, errors still reach standard error
+    if (index > 0) {
+        int discard = open("/dev/null", O_WRONLY);
+        dup2(discard, STDOUT_FILENO);
+        close(discard);
+    }
+
+    HeadlessContext context;
+    if (!initHeadlessContext(context, options.renderWidth, options.renderHeight)) {
+        return EXIT_FAILURE;
+    }
+    runHeadless(context, options);
+    destroyHeadlessContext(context);
+    return EXIT_SUCCESS;
+}
+
+static bool appendSegment(FILE* output, std::string const &path, bool skipHeader) {
+    FILE* segment = fopen(path.c_str(), "rb");
+    if (!segment) {
+        std::cerr << "Worker output " << path << " is missing" << std::endl;
+        return false;
+    }
+    if (skipHeader) {
+        // Every segment is a complete Y4M stream, the output keeps only the first header
+        int c;
+        while ((c = fgetc(segment)) != EOF && c != '\n') {}
+    }
+    std::vector<char> buffer(1 << 20);
+    size_t read;
+    bool written = true;
+    while (written && (read = fread(buffer.data(), 1, buffer.size(), segment)) > 0) {
+        written = fwrite(buffer.data(), 1, read, output) == read;
+    }
+    fclose(segment);
+    if (!written) {
+        std::cerr << "Could not write the merged video" << std::endl;
+    }
+    return written;
+}
+
+bool runFrameWorkers(CommandLineOptions options) {
+    unsigned int workerCount = options.workers == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : options.workers;
+    workerCount = std::max(std::min(workerCount, (unsigned int) std::max(options.headlessFrames, 1)), 1u);
+
+    // The name was checked when parsing the arguments
+    FrameOutputFormat format = OUTPUT_PNG;
+    frameOutputFormatFromName(options.outputFormat, format);
+    bool stream = !options.outputPattern.empty() && format != OUTPUT_PNG;
+    FILE* output = nullptr;
+    if (stream && !(output = openOutputStream(options.outputPattern))) {
+        return false;
+    }
+
+    // Decoded here once, every worker then maps the result
+    buildSceneAssetCache();
+
+    std::vector<FrameWorker> workers(workerCount);
+    std::string segmentBase = options.outputPattern == "-" ? "stdout" : options.outputPattern;
+    std::cout << "Rendering " << options.headlessFrames << " frames in " << workerCount << " processes" << std::endl;
+    std::cout.flush();
+    fflush(stdout);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < workerCount; i++) {
+        FrameWorker& worker = workers[i];
+        int sliceStart = int((long long) options.headlessFrames * i / workerCount);
+        int sliceEnd = int((long long) options.headlessFrames * (i + 1) / workerCount);
+        worker.firstFrame = options.firstFrame + sliceStart;
+        worker.frameCount = sliceEnd - sliceStart;
+        worker.segmentPath = segmentBase + ".part" + std::to_string(i);
+
+        // Forked before this process touches GL, so every worker starts from a clean slate
+        worker.process = fork();
+        if (worker.process == 0) {
+            int status = runWorker(options, worker, i, workerCount, stream);
+            std::cout.flush();
+            fflush(nullptr);
+            _exit(status);
+        }
+        if (worker.process < 0) {
+            std::cerr << "Could not start worker " << i << std::endl;
+        }
+    }
+
+    // In slice order, so video segments are appended while later workers are still rendering
+    bool succeeded = true;
+    for (unsigned int i = 0; i < workerCount; i++) {
+        FrameWorker& worker = workers[i];
+        int status = 0;
+        bool finished = worker.process > 0 && waitpid(worker.process, &status, 0) == worker.process
+                     && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+        if (!finished) {
+            std::cerr << "Worker " << i << " failed rendering frames " << worker.firstFrame
+                      << " to " << worker.firstFrame + worker.frameCount - 1 << std::endl;
+        }
+        succeeded = succeeded && finished;
+        if (stream) {
+            if (succeeded) {
+                succeeded = appendSegment(output, worker.segmentPath, format == OUTPUT_Y4M && i > 0);
+            }
+            std::remove(worker.segmentPath.c_str());
+        }
+    }
+    if (output) {
+        fclose(output);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Rendered %d frames at %dx%d in %u processes in %.2f s, %.2f ms per frame\n", options.headlessFrames,
+           options.renderWidth, options.renderHeight, workerCount, seconds, 1000.0 * seconds / std::max(options.headlessFrames, 1));
+    return succeeded;
+}
+
+#else
+
+bool runFrameWorkers(CommandLineOptions options) {
+    std::cerr << "Worker processes need fork, rendering every frame in this process" << std::endl;
+    HeadlessContext context;
+    if (!initHeadlessContext(context, options.renderWidth, options.renderHeight)) {
+        return false;
+    }
+    runHeadless(context, options);
+    destroyHeadlessContext(context);
+    return true;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <utilities/window.hpp>
+
+// Renders the headless frame range in several processes. The range is split into one contiguous
+// slice per worker, and each worker renders its slice in its own headless context. A single
+// renderer leaves most cores idle on software rasterizers, even though llvmpipe itself is
+// multithreaded.
+//
+// The asset cache is built once before the workers start, and every worker maps it read-only.
+// PNG frames are written by the workers under their frame numbers. Video streams go to one
+// segment file per worker, and the segments are appended to the output in order as their
+// workers finish.
+//
+// Returns false if a worker failed. Needs fork; elsewhere the whole range is rendered in this process.
+bool runFrameWorkers(CommandLineOptions options);
@@ -15,11 +15,32 @@
 #include <fmt/format.h>
 #include "gamelogic.h"
 #include "sceneGraph.hpp"
+#include "lightClusters.hpp"
+#include "shadowMaps.hpp"
+#include "outlines.hpp"
+#include "silhouetteLines.hpp"
+#include "renderScheduler.hpp"
+#include "renderGraph.hpp"
+#include "shaderVariants.hpp"
+#include "vertexPulling.hpp"
+#include "terrainChunks.hpp"
+#include "assetCache.hpp"
+#include "softwareRaster.hpp"
+#include "gbufferFile.hpp"
+#include "sceneQueries.hpp"
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
 
 #include "utilities/imageLoader.hpp"
 #include "utilities/glfont.h"
+#include "utilities/hashing.hpp"
+#include "utilities/tonalArtMap.hpp"
+#include "utilities/meshEdges.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <limits>
+#include <random>
 
 enum KeyFrameAction {
     BOTTOM, TOP
@@ -44,21 +65,106 @@ SceneNode* bizonSkullNode;
 SceneNode* terrainNode;
 SceneNode* LightNode;
 
+// Every point light in creation order, for placing them from a SceneView
+std::vector<SceneNode*> pointLightNodes;
+
 
-unsigned int FBO;
-unsigned int RBO;
 unsigned int rectVAO, rectVBO;
-unsigned int framebufferTexture;
-unsigned int normalTexture;
-unsigned int depthTexture;
+unsigned int tonalArtMapTexture;
+
+// All screen sized targets live in the render graph, these are its resource handles
+RenderGraph renderGraph;
+unsigned int albedoTarget;
+unsigned int normalTarget;
+unsigned int linearDepthTarget;
+unsigned int objectIDTarget;
+unsigned int hatchCoordinateTarget;
+unsigned int depthStencilTarget;
+unsigned int outlineSeedTargets[2];
+unsigned int litTarget;        // lit and hatched scene, input to the outline composite
+unsigned int compositeTarget;  // composited image with outlines, input to FXAA
+
+// The largest ID the R16UI object ID target holds, 0 is the background
+const unsigned int maxObjectID = 65535;
+
+GLenum gBufferAttachments[5] = {
+    GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4
+};
+
+// What the G-buffer and the outline seeds were last rendered with
+bool gBufferValid = false;
+bool gBufferDirty = true;
+glm::mat4 gBufferViewProjection;
+size_t gBufferTransformHash;
+int gBufferWidth, gBufferHeight;
+unsigned int outlineSeedResult = 0;
+unsigned int gBufferRedraws = 0;
 
 
 // These are heap allocated, because they should not be initialised at the start of the program
 sf::SoundBuffer* buffer;
-Gloom::Shader* shader;
-Gloom::Shader* shaderPP;
+Gloom::Shader* shaderDepth;
+Gloom::Shader* shaderFXAA;
 sf::Sound* sound;
 
+// Shaders with features selected at compile time, see shaderVariants.hpp
+ShaderVariants gBufferShaders;
+ShaderVariants lightingShaders;
+ShaderVariants compositeShaders;
+
+// Per material G-buffer variants
+const ShaderDefines untexturedMaterial = { {"TEXTURED", "0"} };
+const ShaderDefines texturedMaterial   = { {"TEXTURED", "1"} };
+const ShaderDefines untexturedPulledMaterial = { {"TEXTURED", "0"}, {"VERTEX_PULLING", "1"} };
+const ShaderDefines texturedPulledMaterial   = { {"TEXTURED", "1"}, {"VERTEX_PULLING", "1"} };
+Gloom::Shader* activeGBufferShader = nullptr;
+
+// Every mesh in shared buffers, drawn with one multi-draw per material instead of a VAO per mesh
+VertexPool vertexPool;
+bool useVertexPulling = false;
+
+// Terrain split into chunks with levels of detail, streamed from disk around the camera
+TerrainChunks terrainChunks;
+bool useChunkedTerrain = false;
+
+// Ray casts against the scene on the CPU, for picking and placing things on the ground
+SceneQueries sceneQueries;
+
+// Extra lights hang this far above the ground below them, in world units
+const float extraLightHeight = 1.5f;
+
+// The Moebius passes on the CPU, GL only shows the finished frame
+SoftwareRasterizer softwareRasterizer;
+bool useSoftwareRaster = false;
+
+// Fixed for the whole run, the lighting variant also picks SHADOWS every frame
+ShaderDefines lightingDefines;
+ShaderDefines compositeDefines;
+
+bool useDepthPrepass = false;
+bool useGeometricLines = false;
+bool useFXAA = true;
+bool usePicking = false;
+
+// Space pauses the light animation, letting the scheduler go idle. Set from the event
+// callbacks and read by the simulation thread.
+std::atomic<bool> animationPaused(false);
+
+// Lights stay where a SceneView put them
+bool sceneViewFixed = false;
+
+// Headless runs have no window, they render at the requested size and advance time
+// by a fixed step per frame so every run produces the same images
+bool headlessMode = false;
+int renderWidth = windowWidth;
+int renderHeight = windowHeight;
+
+LightClusters lightClusters;
+ShadowMaps shadowMaps;
+Outlines outlines;
+SilhouetteLines silhouetteLines;
+RenderScheduler renderScheduler;
+
 
 float rectangleVertices[] = {
     // Coords       // texCoords
@@ -71,63 +177,274 @@ float rectangleVertices[] = {
     -1.0f, 1.0f,   0.0f, 1.0f
 };
 
-glm::vec3 cameraPosition;
+glm::vec3 cameraPosition = glm::vec3(-40, 30, 170);
+float cameraPitch = 0.4f;
+float cameraYaw = 0.0f;
+glm::mat4 viewTransformation;
+glm::mat4 viewProjection;
+
+const float cameraFieldOfView = glm::radians(80.0f);
+const float cameraNearPlane   = 0.1f;
+const float cameraFarPlane    = 350.f;
+
+// The window contents were damaged (uncovered, restored), so the last frame has to be drawn again
+void windowRefreshCallback(GLFWwindow*) {
+    markRenderDirty(renderScheduler, RENDER_WINDOW);
+}
+
+void keyCallback(GLFWwindow*, int key, int, int action, int) {
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+        animationPaused = !animationPaused;
+        std::cout << "Animation " << (animationPaused ? "paused" : "resumed") << std::endl;
+    }
+}
+
+// Prints what is under the cursor, with --pick
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int) {
+    if (!usePicking || button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) {
+        return;
+    }
+    double cursorX, cursorY;
+    int width, height;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+    glfwGetWindowSize(window, &width, &height);
+    float x = 2.0f * float(cursorX) / float(width) - 1.0f;
+    float y = 1.0f - 2.0f * float(cursorY) / float(height);
+
+    // From the near to the far plane through the cursor
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    SceneRay ray = { origin, glm::vec3(farPoint) / farPoint.w - origin, 1.0f };
+
+    // Against the transforms of the frame on screen, the animation moved things since the last update
+    updateSceneQueries(sceneQueries, rootNode);
+    SceneHit hit;
+    if (castRay(sceneQueries, ray, hit)) {
+        std::cout << fmt::format("Picked object {} at ({:.2f}, {:.2f}, {:.2f})",
+                                 hit.node->objectID, hit.position.x, hit.position.y, hit.position.z) << std::endl;
+    } else {
+        std::cout << "Picked nothing" << std::endl;
+    }
+}
+
+// Moves the lights to a fixed height above the ground, which the scatter does not know. Only the
+// ground counts, a light over a rock or a cactus still hangs above the terrain below it.
+void snapLightsToGround(std::vector<SceneNode*> const &lights, SceneNode* ground) {
+    updateNodeTransformations(rootNode, glm::identity<glm::mat4>(), glm::identity<glm::mat4>());
+    updateSceneQueries(sceneQueries, rootNode);
+
+    // Straight down from above everything
+    float top = sceneQueries.instanceNodes.empty() ? 0.0f : sceneQueries.instanceNodes[0].boundsMax.y + 1.0f;
+    glm::mat4 groundInverse = glm::inverse(ground->modelMatrix);
+    unsigned int grounded = 0;
+    for (SceneNode* light : lights) {
+        glm::vec3 position = glm::vec3(ground->modelMatrix * glm::vec4(light->position, 1.0f));
+        SceneRay ray = { glm::vec3(position.x, top, position.z), glm::vec3(0.0f, -1.0f, 0.0f), std::numeric_limits<float>::max() };
+        SceneHit hit;
+        if (castRayAtNode(sceneQueries, ground, ray, hit)) {
+            position = hit.position + glm::vec3(0.0f, extraLightHeight, 0.0f);
+            light->position = glm::vec3(groundInverse * glm::vec4(position, 1.0f));
+            grounded++;
+        }
+    }
+    std::cout << fmt::format("Snapped {} of {} lights to the ground", grounded, lights.size()) << std::endl;
+}
+
+void buildRenderGraph();
+
+// Every texture and model loaded below, so the cache can be built before any renderer starts
+const char* sceneAssetCachePath = "assets.cache";
+const std::vector<std::string> sceneTextures = {
+    "../res/textures/CactusFlower_col.png", "../res/textures/Cactus_col.png", "../res/textures/Terrain_col.png",
+    "../res/textures/Rock01_col.png", "../res/textures/Rock03_col.png",
+    "../res/textures/BizonBones_col.png", "../res/textures/BizonSkull_col.png"
+};
+const std::vector<std::string> sceneModels = {
+    "../res/models/CactusFlower.glb", "../res/models/Cactus.glb", "../res/models/TerrainSmooth.glb",
+    "../res/models/Rock01Smooth.glb", "../res/models/Rock02Smooth.glb", "../res/models/Rock03Smooth.glb",
+    "../res/models/BizonBonesSmooth.glb", "../res/models/BizonSkullSmooth.glb"
+};
+
+void buildSceneAssetCache() {
+    buildAssetCache(sceneAssetCachePath, sceneTextures, sceneModels);
+}
+
+// Loads go through these so the software rasterizer gets its own copy of every texture and mesh
+static unsigned int loadSceneTexture(AssetCache& assetCache, std::string const &path) {
+    if (!useSoftwareRaster) {
+        return loadCachedTexture(assetCache, path);
+    }
+    PNGImage image = loadCachedImage(assetCache, path);
+    unsigned int textureID = generateTextureID(image.width, image.height, image.pixels.data());
+    addRasterTexture(softwareRasterizer, textureID, image.width, image.height, image.pixels);
+    return textureID;
+}
+
+static unsigned int generateSceneBuffer(Mesh& mesh) {
+    unsigned int vertexArrayObjectID = generateBuffer(mesh);
+    if (useSoftwareRaster) {
+        addRasterMesh(softwareRasterizer, vertexArrayObjectID, mesh);
+    }
+    return vertexArrayObjectID;
+}
+
+void getRenderSize(GLFWwindow* window, int& width, int& height) {
+    if (headlessMode) {
+        width = renderWidth;
+        height = renderHeight;
+    } else {
+        glfwGetWindowSize(window, &width, &height);
+    }
+}
 
 void initGame(GLFWwindow* window, CommandLineOptions gameOptions) {
-    shader = new Gloom::Shader();
-    shader->makeBasicShader("../res/shaders/simple.vert", "../res/shaders/simple.frag");
-    shader->activate();
+    headlessMode = gameOptions.headless;
+    renderWidth = gameOptions.renderWidth;
+    renderHeight = gameOptions.renderHeight;
+    useGeometricLines = gameOptions.enableGeometricLines;
+    useFXAA = !gameOptions.disableFXAA;
+    usePicking = gameOptions.enablePicking;
+    useDepthPrepass = gameOptions.enableDepthPrepass;
+    useVertexPulling = gameOptions.enableVertexPulling;
+    useSoftwareRaster = gameOptions.softwareRaster;
+    // The rasterizer draws the terrain node's own mesh, it knows nothing of the chunks
+    useChunkedTerrain = gameOptions.enableChunkedTerrain && !useSoftwareRaster;
+
+    std::string debugView = std::to_string(gameOptions.debugView);
+    lightingDefines = { {"HATCHING_STYLE", std::to_string(gameOptions.hatchingStyle)}, {"DEBUG_VIEW", debugView} };
+    compositeDefines = { {"IMAGE_SPACE_OUTLINES", useGeometricLines ? "0" : "1"}, {"DEBUG_VIEW", debugView} };
+
+    // Every program is linked before any of them is used, so the driver can build them in parallel
+    initShaderVariants(gBufferShaders, "../res/shaders/simple.vert", "../res/shaders/simple.frag");
+    prepareShaderVariant(gBufferShaders, useVertexPulling ? untexturedPulledMaterial : untexturedMaterial);
+    prepareShaderVariant(gBufferShaders, useVertexPulling ? texturedPulledMaterial : texturedMaterial);
 
     // Post-processing shader
-    shaderPP = new Gloom::Shader();
-    shaderPP->makeBasicShader("../res/shaders/framebuffer.vert", "../res/shaders/framebuffer.frag");
-    shaderPP->activate();
-    glUniform1i(shaderPP->getUniformFromName("screenTexture"), 0);
-    glUniform1i(shaderPP->getUniformFromName("normalTexture"), 1);
-    glUniform1i(shaderPP->getUniformFromName("depthTexture"), 2);
-
-    // Create meshes
-    PNGImage cactusFlowerTexture = loadPNGFile("../res/textures/CactusFlower_col.png");
-    unsigned int cactusFlowerTextureID = generateTextureID(cactusFlowerTexture);
-    Mesh cactusFlower = loadModel("../res/models/CactusFlower.glb");
-
-    PNGImage cactusTexture = loadPNGFile("../res/textures/Cactus_col.png");
-    unsigned int cactusTextureID = generateTextureID(cactusTexture);
-    Mesh cactus = loadModel("../res/models/Cactus.glb");
-
-    PNGImage terrainTexture = loadPNGFile("../res/textures/Terrain_col.png");
-    unsigned int terrainTextureID = generateTextureID(terrainTexture);
-    Mesh terrain = loadModel("../res/models/TerrainSmooth.glb");
-
-    PNGImage rock01Texture = loadPNGFile("../res/textures/Rock01_col.png");
-    unsigned int rock01TextureID = generateTextureID(rock01Texture);
-    Mesh rock01 = loadModel("../res/models/Rock01Smooth.glb");
-
-    PNGImage rock02Texture = loadPNGFile("../res/textures/Rock02_col.png");
-    unsigned int rock02TextureID = generateTextureID(rock01Texture);
-    Mesh rock02 = loadModel("../res/models/Rock02Smooth.glb");
-
-    PNGImage rock03Texture = loadPNGFile("../res/textures/Rock03_col.png");
-    unsigned int rock03TextureID = generateTextureID(rock03Texture);
-    Mesh rock03 = loadModel("../res/models/Rock03Smooth.glb");
-
-    PNGImage bizonBonesTexture = loadPNGFile("../res/textures/BizonBones_col.png");
-    unsigned int bizonBonesTextureID = generateTextureID(bizonBonesTexture);
-    Mesh bizonBones = loadModel("../res/models/BizonBonesSmooth.glb");
-
-    PNGImage bizonSkullTexture = loadPNGFile("../res/textures/BizonSkull_col.png");
-    unsigned int bizonSkullTextureID = generateTextureID(bizonSkullTexture);
-    Mesh bizonSkull = loadModel("../res/models/BizonSkullSmooth.glb");
+    initShaderVariants(compositeShaders, "../res/shaders/framebuffer.vert", "../res/shaders/framebuffer.frag",
+                       [gameOptions](Gloom::Shader* variant) {
+        glUniform1i(variant->getUniformFromName("screenTexture"), 0);
+        glUniform1i(variant->getUniformFromName("depthTexture"), 2);
+        glUniform1i(variant->getUniformFromName("outlineSeedTexture"), outlineSeedTextureUnit);
+        glUniform1f(variant->getUniformFromName("outline_width_near"), gameOptions.outlineWidth);
+        glUniform1f(variant->getUniformFromName("outline_width_far"), gameOptions.outlineWidthFar);
+    });
+    prepareShaderVariant(compositeShaders, compositeDefines);
+
+    // Anti-aliasing of the final image, replaces MSAA on the default framebuffer
+    shaderFXAA = new Gloom::Shader();
+    shaderFXAA->makeBasicShader("../res/shaders/framebuffer.vert", "../res/shaders/fxaa.frag");
+
+    // Depth prepass shader, position only
+    shaderDepth = new Gloom::Shader();
+    shaderDepth->makeBasicShader("../res/shaders/depth.vert", "../res/shaders/depth.frag");
+
+    // Deferred lighting over the G-buffer
+    initShaderVariants(lightingShaders, "../res/shaders/framebuffer.vert", "../res/shaders/lighting.frag",
+                       [](Gloom::Shader* variant) {
+        glUniform3ui(variant->getUniformFromName("cluster_count"), clusterCountX, clusterCountY, clusterCountZ);
+        glUniform1f(variant->getUniformFromName("cluster_near"), cameraNearPlane);
+        glUniform1f(variant->getUniformFromName("cluster_far"), cameraFarPlane);
+    });
+    for (const char* shadows : {"0", "1"}) {
+        ShaderDefines defines = lightingDefines;
+        defines["SHADOWS"] = shadows;
+        prepareShaderVariant(lightingShaders, defines);
+    }
+
+    shaderFXAA->activate();
+    glUniform1i(shaderFXAA->getUniformFromName("screenTexture"), 0);
+
+    // Clustered light culling
+    initLightClusters(lightClusters, cameraFieldOfView, float(renderWidth) / float(renderHeight), cameraNearPlane, cameraFarPlane);
+
+    initShadowMaps(shadowMaps);
+
+    // Crosshatching tones
+    tonalArtMapTexture = generateTonalArtMap();
+
+    if (useSoftwareRaster) {
+        initSoftwareRasterizer(softwareRasterizer, gameOptions.rasterThreads, gameOptions.outlineWidth, gameOptions.outlineWidthFar,
+                               gameOptions.edgeThreshold, gameOptions.depthEdgeScale, gameOptions.hatchingStyle);
+    }
+
+    // Create meshes, decoded once into the asset cache which every later run maps instead
+    buildSceneAssetCache();
+    AssetCache assetCache;
+    openAssetCache(assetCache, sceneAssetCachePath);
+
+    unsigned int cactusFlowerTextureID = loadSceneTexture(assetCache, "../res/textures/CactusFlower_col.png");
+    Mesh cactusFlower = loadCachedModel(assetCache, "../res/models/CactusFlower.glb");
+
+    unsigned int cactusTextureID = loadSceneTexture(assetCache, "../res/textures/Cactus_col.png");
+    Mesh cactus = loadCachedModel(assetCache, "../res/models/Cactus.glb");
+
+    unsigned int terrainTextureID = loadSceneTexture(assetCache, "../res/textures/Terrain_col.png");
+    Mesh terrain = loadCachedModel(assetCache, "../res/models/TerrainSmooth.glb");
+
+    unsigned int rock01TextureID = loadSceneTexture(assetCache, "../res/textures/Rock01_col.png");
+    Mesh rock01 = loadCachedModel(assetCache, "../res/models/Rock01Smooth.glb");
+
+    // Rock02 has always been drawn with the Rock01 texture
+    unsigned int rock02TextureID = loadSceneTexture(assetCache, "../res/textures/Rock01_col.png");
+    Mesh rock02 = loadCachedModel(assetCache, "../res/models/Rock02Smooth.glb");
+
+    unsigned int rock03TextureID = loadSceneTexture(assetCache, "../res/textures/Rock03_col.png");
+    Mesh rock03 = loadCachedModel(assetCache, "../res/models/Rock03Smooth.glb");
+
+    unsigned int bizonBonesTextureID = loadSceneTexture(assetCache, "../res/textures/BizonBones_col.png");
+    Mesh bizonBones = loadCachedModel(assetCache, "../res/models/BizonBonesSmooth.glb");
+
+    unsigned int bizonSkullTextureID = loadSceneTexture(assetCache, "../res/textures/BizonSkull_col.png");
+    Mesh bizonSkull = loadCachedModel(assetCache, "../res/models/BizonSkullSmooth.glb");
+    closeAssetCache(assetCache);
 
     // Fill buffers
-    unsigned int cactusFlowerVAO = generateBuffer(cactusFlower);
-    unsigned int cactusVAO = generateBuffer(cactus);
-    unsigned int terrainVAO = generateBuffer(terrain);
-    unsigned int rock01VAO = generateBuffer(rock01);
-    unsigned int rock02VAO = generateBuffer(rock02);
-    unsigned int rock03VAO = generateBuffer(rock03);
-    unsigned int bizonBonesVAO = generateBuffer(bizonBones);
-    unsigned int bizonSkullVAO = generateBuffer(bizonSkull);
+    unsigned int cactusFlowerVAO = generateSceneBuffer(cactusFlower);
+    unsigned int cactusVAO = generateSceneBuffer(cactus);
+    unsigned int terrainVAO = generateSceneBuffer(terrain);
+    unsigned int rock01VAO = generateSceneBuffer(rock01);
+    unsigned int rock02VAO = generateSceneBuffer(rock02);
+    unsigned int rock03VAO = generateSceneBuffer(rock03);
+    unsigned int bizonBonesVAO = generateSceneBuffer(bizonBones);
+    unsigned int bizonSkullVAO = generateSceneBuffer(bizonSkull);
+
+    // The same meshes in the shared pool for vertex pulling, only built when it is used
+    int cactusFlowerPulled = -1, cactusPulled = -1, terrainPulled = -1, rock01Pulled = -1;
+    int rock02Pulled = -1, rock03Pulled = -1, bizonBonesPulled = -1, bizonSkullPulled = -1;
+    if (useVertexPulling) {
+        initVertexPool(vertexPool);
+        cactusFlowerPulled = addPulledMesh(vertexPool, cactusFlower);
+        cactusPulled = addPulledMesh(vertexPool, cactus);
+        terrainPulled = addPulledMesh(vertexPool, terrain);
+        rock01Pulled = addPulledMesh(vertexPool, rock01);
+        rock02Pulled = addPulledMesh(vertexPool, rock02);
+        rock03Pulled = addPulledMesh(vertexPool, rock03);
+        bizonBonesPulled = addPulledMesh(vertexPool, bizonBones);
+        bizonSkullPulled = addPulledMesh(vertexPool, bizonSkull);
+        uploadVertexPool(vertexPool);
+    }
+
+    // Edge adjacency for the geometric line renderer
+    EdgeBuffer cactusFlowerEdges = generateEdgeBuffer(cactusFlower);
+    EdgeBuffer cactusEdges = generateEdgeBuffer(cactus);
+    EdgeBuffer terrainEdges = generateEdgeBuffer(terrain);
+    EdgeBuffer rock01Edges = generateEdgeBuffer(rock01);
+    EdgeBuffer rock02Edges = generateEdgeBuffer(rock02);
+    EdgeBuffer rock03Edges = generateEdgeBuffer(rock03);
+    EdgeBuffer bizonBonesEdges = generateEdgeBuffer(bizonBones);
+    EdgeBuffer bizonSkullEdges = generateEdgeBuffer(bizonSkull);
+
+    // Triangle hierarchies for ray casts
+    int cactusFlowerQuery = addQueryMesh(sceneQueries, cactusFlower);
+    int cactusQuery = addQueryMesh(sceneQueries, cactus);
+    int terrainQuery = addQueryMesh(sceneQueries, terrain);
+    int rock01Query = addQueryMesh(sceneQueries, rock01);
+    int rock02Query = addQueryMesh(sceneQueries, rock02);
+    int rock03Query = addQueryMesh(sceneQueries, rock03);
+    int bizonBonesQuery = addQueryMesh(sceneQueries, bizonBones);
+    int bizonSkullQuery = addQueryMesh(sceneQueries, bizonSkull);
 
     glGenVertexArrays(1, &rectVAO);
     glGenBuffers(1, &rectVBO);
@@ -142,45 +459,26 @@ void initGame(GLFWwindow* window, CommandLineOptions gameOptions) {
     glEnableVertexAttribArray(1);
 
 
-    // Post-processing buffer
-    glGenFramebuffers(1, &FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-
-    glGenTextures(1, &framebufferTexture);
-	glBindTexture(GL_TEXTURE_2D, framebufferTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, windowWidth, windowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebufferTexture, 0);
-
-    // Generate normaltexture and depthtexture for post-processing
-    glGenTextures(1, &normalTexture);
-    glBindTexture(GL_TEXTURE_2D, normalTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, windowWidth, windowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
-
-    glGenTextures(1, &depthTexture);
-    glBindTexture(GL_TEXTURE_2D, depthTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, windowWidth, windowHeight, 0,  GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, depthTexture, 0);
-
-    GLenum attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-    glDrawBuffers(3, attachments);
+    // Render targets, allocated when the graph is compiled
+    initRenderGraph(renderGraph);
+    albedoTarget          = createGraphTexture(renderGraph, "albedo", GL_RGB8, GL_NEAREST, true);
+    normalTarget          = createGraphTexture(renderGraph, "normal", GL_RGB16F, GL_NEAREST, true);
+    linearDepthTarget     = createGraphTexture(renderGraph, "linear depth", GL_RGB16F, GL_NEAREST, true);
+    // 16 bit object IDs, outlines between objects come from integer compares
+    objectIDTarget        = createGraphTexture(renderGraph, "object ID", GL_R16UI, GL_NEAREST, true);
+    // Scaled texture coordinates and mip level for the hatching in the lighting pass
+    hatchCoordinateTarget = createGraphTexture(renderGraph, "hatch coordinates", GL_RGBA32F, GL_NEAREST, true);
+    // Depth is a texture, the lighting pass reconstructs positions from it
+    depthStencilTarget    = createGraphTexture(renderGraph, "depth", GL_DEPTH24_STENCIL8, GL_NEAREST, true);
+    outlineSeedTargets[0] = createGraphTexture(renderGraph, "outline seeds A", GL_RG16UI, GL_NEAREST, true);
+    outlineSeedTargets[1] = createGraphTexture(renderGraph, "outline seeds B", GL_RG16UI, GL_NEAREST, true);
+    litTarget             = createGraphTexture(renderGraph, "lit", GL_RGB8, GL_NEAREST);
+    // Filtered linearly for the FXAA edge search
+    compositeTarget       = createGraphTexture(renderGraph, "composite", GL_RGB8, GL_LINEAR);
 
-    glGenRenderbuffers(1, &RBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, RBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, windowWidth, windowHeight);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO);
 
-    auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if (fboStatus != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer error: " << fboStatus << std::endl;
+    // Edge detection and jump flood shaders for the ink lines
+    initOutlines(outlines, gameOptions.outlineWidth, gameOptions.outlineWidthFar, gameOptions.edgeThreshold, gameOptions.depthEdgeScale);
 
 
     // Construct scene
@@ -207,6 +505,8 @@ void initGame(GLFWwindow* window, CommandLineOptions gameOptions) {
     cactusFlowerNode->rotation = {
         0.0f, 0.55f, 0.0f
     };
+    // Sways in the wind, so the shadow maps draw it over their static caches every frame
+    cactusFlowerNode->isDynamic = true;
 
     cactus01Node = createSceneNode();
     cactus01Node->scale = glm::vec3(0.7f);
@@ -318,9 +618,28 @@ void initGame(GLFWwindow* window, CommandLineOptions gameOptions) {
     LightNode->nodeType = POINT_LIGHT;
     LightNode->id = 0;
     LightNode->color = glm::vec3(255.0, 255.0, 255.0 );
+    LightNode->castsShadows = true;
     LightNode->position  = {
         12.0f, 4.0f, -1.0f
     };
+    pointLightNodes.push_back(LightNode);
+
+    // Small warm lights (campfires, lanterns) scattered around the props
+    std::mt19937 lightRandom(4230);
+    std::uniform_real_distribution<float> lightX(-2.0f, 20.0f);
+    std::uniform_real_distribution<float> lightZ(-12.0f, 12.0f);
+    for (int i = 0; i < gameOptions.extraLights; i++) {
+        SceneNode* extraLightNode = createSceneNode();
+        extraLightNode->nodeType = POINT_LIGHT;
+        extraLightNode->id = i + 1;
+        extraLightNode->color = glm::vec3(80.0, 50.0, 20.0);
+        extraLightNode->lightRadius = 40.0f;
+        extraLightNode->position = {
+            lightX(lightRandom), 1.0f, lightZ(lightRandom)
+        };
+        terrainNode->children.push_back(extraLightNode);
+        pointLightNodes.push_back(extraLightNode);
+    }
     
     rootNode->children.push_back(terrainNode);
     terrainNode->children.push_back(cactusFlowerNode);
@@ -337,44 +656,181 @@ void initGame(GLFWwindow* window, CommandLineOptions gameOptions) {
 
     cactusFlowerNode->vertexArrayObjectID = cactusFlowerVAO;
     cactusFlowerNode->VAOIndexCount       = cactusFlower.indices.size();
+    cactusFlowerNode->pulledMeshID        = cactusFlowerPulled;
+    cactusFlowerNode->queryMeshID         = cactusFlowerQuery;
+    cactusFlowerNode->edgeBufferID        = cactusFlowerEdges.bufferID;
+    cactusFlowerNode->edgeCount           = cactusFlowerEdges.edgeCount;
 
     cactus01Node->vertexArrayObjectID = cactusVAO;
     cactus01Node->VAOIndexCount       = cactus.indices.size();
+    cactus01Node->pulledMeshID        = cactusPulled;
+    cactus01Node->queryMeshID         = cactusQuery;
+    cactus01Node->edgeBufferID        = cactusEdges.bufferID;
+    cactus01Node->edgeCount           = cactusEdges.edgeCount;
 
     cactus02Node->vertexArrayObjectID = cactusVAO;
     cactus02Node->VAOIndexCount       = cactus.indices.size();
+    cactus02Node->pulledMeshID        = cactusPulled;
+    cactus02Node->queryMeshID         = cactusQuery;
+    cactus02Node->edgeBufferID        = cactusEdges.bufferID;
+    cactus02Node->edgeCount           = cactusEdges.edgeCount;
 
     rock01Node->vertexArrayObjectID = rock01VAO;
     rock01Node->VAOIndexCount       = rock01.indices.size();
+    rock01Node->pulledMeshID        = rock01Pulled;
+    rock01Node->queryMeshID         = rock01Query;
+    rock01Node->edgeBufferID        = rock01Edges.bufferID;
+    rock01Node->edgeCount           = rock01Edges.edgeCount;
 
     rock02Node->vertexArrayObjectID = rock02VAO;
     rock02Node->VAOIndexCount       = rock02.indices.size();
+    rock02Node->pulledMeshID        = rock02Pulled;
+    rock02Node->queryMeshID         = rock02Query;
+    rock02Node->edgeBufferID        = rock02Edges.bufferID;
+    rock02Node->edgeCount           = rock02Edges.edgeCount;
 
     rock02_1Node->vertexArrayObjectID = rock02VAO;
     rock02_1Node->VAOIndexCount       = rock02.indices.size();
+    rock02_1Node->pulledMeshID        = rock02Pulled;
+    rock02_1Node->queryMeshID         = rock02Query;
+    rock02_1Node->edgeBufferID        = rock02Edges.bufferID;
+    rock02_1Node->edgeCount           = rock02Edges.edgeCount;
 
     rock02_2Node->vertexArrayObjectID = rock02VAO;
     rock02_2Node->VAOIndexCount       = rock02.indices.size();
+    rock02_2Node->pulledMeshID        = rock02Pulled;
+    rock02_2Node->queryMeshID         = rock02Query;
+    rock02_2Node->edgeBufferID        = rock02Edges.bufferID;
+    rock02_2Node->edgeCount           = rock02Edges.edgeCount;
 
     rock03Node->vertexArrayObjectID = rock03VAO;
     rock03Node->VAOIndexCount       = rock03.indices.size();
+    rock03Node->pulledMeshID        = rock03Pulled;
+    rock03Node->queryMeshID         = rock03Query;
+    rock03Node->edgeBufferID        = rock03Edges.bufferID;
+    rock03Node->edgeCount           = rock03Edges.edgeCount;
 
     bizonBonesNode->vertexArrayObjectID = bizonBonesVAO;
     bizonBonesNode->VAOIndexCount       = bizonBones.indices.size();
+    bizonBonesNode->pulledMeshID        = bizonBonesPulled;
+    bizonBonesNode->queryMeshID         = bizonBonesQuery;
+    bizonBonesNode->edgeBufferID        = bizonBonesEdges.bufferID;
+    bizonBonesNode->edgeCount           = bizonBonesEdges.edgeCount;
 
     bizonSkullNode->vertexArrayObjectID = bizonSkullVAO;
     bizonSkullNode->VAOIndexCount       = bizonSkull.indices.size();
+    bizonSkullNode->pulledMeshID        = bizonSkullPulled;
+    bizonSkullNode->queryMeshID         = bizonSkullQuery;
+    bizonSkullNode->edgeBufferID        = bizonSkullEdges.bufferID;
+    bizonSkullNode->edgeCount           = bizonSkullEdges.edgeCount;
 
     terrainNode->vertexArrayObjectID = terrainVAO;
     terrainNode->VAOIndexCount       = terrain.indices.size();
+    terrainNode->pulledMeshID        = terrainPulled;
+    terrainNode->queryMeshID         = terrainQuery;
+    terrainNode->edgeBufferID        = terrainEdges.bufferID;
+    terrainNode->edgeCount           = terrainEdges.edgeCount;
+
+    if (useChunkedTerrain) {
+        // The chunk file is only rebuilt when the terrain mesh changes
+        buildTerrainChunks(terrain, "terrain.chunks");
+        if (!initTerrainChunks(terrainChunks, "terrain.chunks", terrainNode, terrainTextureID)) {
+            // The header matched but the rest did not, build it again from scratch
+            std::remove("terrain.chunks");
+            buildTerrainChunks(terrain, "terrain.chunks");
+            initTerrainChunks(terrainChunks, "terrain.chunks", terrainNode, terrainTextureID);
+        }
+
+        // The chunks draw the surface, the terrain node only keeps its transform and edges
+        terrainNode->vertexArrayObjectID = -1;
+        terrainNode->VAOIndexCount       = 0;
+        terrainNode->pulledMeshID        = -1;
+    }
+
+    // Only the scattered lights, the first one is animated
+    if (gameOptions.extraLights > 0) {
+        snapLightsToGround(std::vector<SceneNode*>(pointLightNodes.begin() + 1, pointLightNodes.end()), terrainNode);
+    }
+
+    if (gameOptions.checkQueries) {
+        updateNodeTransformations(rootNode, glm::identity<glm::mat4>(), glm::identity<glm::mat4>());
+        updateSceneQueries(sceneQueries, rootNode);
+        SceneQueryCheck check = checkSceneQueries(sceneQueries, 1000);
+        std::cout << fmt::format("Scene queries: {} of {} rays hit, {} disagree with brute force. Per ray castRay {:.2f} us, "
+                                 "castRays {:.2f} us, brute force {:.2f} us",
+                                 check.hits, check.rays, check.mismatches, check.castRayMicroseconds,
+                                 check.castRaysMicroseconds, check.bruteForceMicroseconds) << std::endl;
+    }
+
+    unsigned int nextObjectID = 1;
+    assignObjectIDs(rootNode, nextObjectID);
+    if (useChunkedTerrain) {
+        // One ID for all chunks, so the outline pass sees no seams between them
+        setTerrainObjectID(terrainChunks, nextObjectID++);
+    }
+    // Wrapped IDs would merge objects and run outlines through them
+    if (nextObjectID - 1 > maxObjectID) {
+        std::cerr << fmt::format("The scene has {} objects, the object ID target holds at most {}",
+                                 nextObjectID - 1, maxObjectID) << std::endl;
+        exit(1);
+    }
+
+    if (useGeometricLines) {
+        initSilhouetteLines(silhouetteLines, rootNode, gameOptions.outlineWidth);
+    }
 
     std::cout << fmt::format("Initialized scene with {} SceneNodes.", totalChildren(rootNode)) << std::endl;
+    std::cout << "Depth prepass " << (useDepthPrepass ? "enabled" : "disabled") << std::endl;
+    std::cout << "Outlines from " << (useGeometricLines ? "mesh edges" : "image space edge detection") << std::endl;
+    std::cout << "Geometry drawn " << (useVertexPulling ? "with vertex pulling" : "per VAO") << std::endl;
+    std::cout << "Frames rendered " << (useSoftwareRaster ? fmt::format("on the CPU with {} threads", softwareRasterizer.workers.threadCount) : "with GL") << std::endl;
+    std::cout << "Terrain " << (useChunkedTerrain ? fmt::format("split into {} chunks", terrainChunks.chunks.size()) : "drawn as one mesh") << std::endl;
+    buildRenderGraph();
+    compileRenderGraph(renderGraph, renderWidth, renderHeight);
+    printRenderGraph(renderGraph);
+
+    initRenderScheduler(renderScheduler, gameOptions.logFrames);
+    if (!headlessMode) {
+        glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    }
+
     std::cout << "Ready. Click to start!" << std::endl;
 }
 
 
 void updateFrame(GLFWwindow* window) {
-    double timeDelta = getTimeDeltaSeconds();
+    static SceneSnapshot snapshot;
+    double timeDelta = headlessMode ? 1.0 / headlessFrameRate : getTimeDeltaSeconds();
+    simulateFrame(timeDelta, snapshot);
+    presentSnapshot(window, snapshot);
+}
+
+static glm::mat4 nodeTransformation(SceneNode* node) {
+    return glm::translate(node->position)
+         * glm::translate(node->referencePoint)
+         * glm::rotate(node->rotation.y, glm::vec3(0,1,0))
+         * glm::rotate(node->rotation.x, glm::vec3(1,0,0))
+         * glm::rotate(node->rotation.z, glm::vec3(0,0,1))
+         * glm::scale(node->scale)
+         * glm::translate(-node->referencePoint);
+}
+
+// updateNodeTransformations into a snapshot instead of the nodes
+static void snapshotNodeTransformations(SceneNode* node, glm::mat4 transformationThusFar, glm::mat4 viewTransformation,
+                                        SceneSnapshot& snapshot) {
+    glm::mat4 transformationMatrix = nodeTransformation(node);
+    glm::mat4 modelMatrix = transformationThusFar * transformationMatrix;
+    snapshot.currentTransformations.push_back(viewTransformation * transformationThusFar * transformationMatrix);
+    snapshot.modelMatrices.push_back(modelMatrix);
+
+    for (SceneNode* child : node->children) {
+        snapshotNodeTransformations(child, modelMatrix, viewTransformation, snapshot);
+    }
+}
+
+bool simulateFrame(double timeDelta, SceneSnapshot& snapshot) {
     static float angle = 0.0f;
     
     // Circular motion for the light
@@ -382,30 +838,63 @@ void updateFrame(GLFWwindow* window) {
     float speed = 0.5f;       // Rotation speed in radians per second
     
     // Update angle based on time (smooth continuous motion)
-    angle += (float)timeDelta * speed;
-    
-    // Calculate new light position in a circular path
-    LightNode->position = {
-        11.0f + radius * cos(angle),
-        3.0f,
-        -3.0f + radius * sin(angle)
-    };
-
-    glm::mat4 projection = glm::perspective(glm::radians(80.0f), float(windowWidth) / float(windowHeight), 0.1f, 350.f);
+    bool moved = !animationPaused && !sceneViewFixed;
+    if (moved) {
+        angle += (float)timeDelta * speed;
+
+        // Calculate new light position in a circular path
+        LightNode->position = {
+            11.0f + radius * cos(angle),
+            3.0f,
+            -3.0f + radius * sin(angle)
+        };
+
+        // The cactus flower sways in the wind
+        cactusFlowerNode->rotation.z = 0.06f * sin(angle * 4.0f);
+    }
 
-    cameraPosition = glm::vec3(-40, 30, 170);
+    glm::mat4 projection = glm::perspective(cameraFieldOfView, float(renderWidth) / float(renderHeight), cameraNearPlane, cameraFarPlane);
 
     // Some math to make the camera move in a nice way
-    float lookRotation = 0.0;
     glm::mat4 cameraTransform =
-                    glm::rotate(0.4f, glm::vec3(1, 0, 0)) *
-                    glm::rotate(lookRotation, glm::vec3(0, 1, 0)) *
+                    glm::rotate(cameraPitch, glm::vec3(1, 0, 0)) *
+                    glm::rotate(cameraYaw, glm::vec3(0, 1, 0)) *
                     glm::translate(-cameraPosition);
 
     glm::mat4 VP = projection * cameraTransform;
-    
+    snapshot.viewTransformation = cameraTransform;
+    snapshot.viewProjection = VP;
+
+    // The vectors keep their capacity, so only the first snapshot allocates
+    snapshot.modelMatrices.clear();
+    snapshot.currentTransformations.clear();
+    snapshotNodeTransformations(rootNode, glm::identity<glm::mat4>(), VP, snapshot);
+    return moved;
+}
 
-    updateNodeTransformations(rootNode, glm::identity<glm::mat4>(), VP);
+void presentSnapshot(GLFWwindow* window, SceneSnapshot const &snapshot) {
+    viewTransformation = snapshot.viewTransformation;
+    viewProjection = snapshot.viewProjection;
+    applySceneSnapshot(snapshot, rootNode);
+    updateSceneQueries(sceneQueries, rootNode);
+
+    if (useChunkedTerrain) {
+        // Everything in range is loaded up front, later frames stream within the per frame budget.
+        // Headless frames are all output (server replies, single frames of a range), so they
+        // never leave chunks for later.
+        static bool initialLoad = true;
+        updateTerrainChunks(terrainChunks, terrainNode->modelMatrix, viewProjection, cameraPosition, cameraFarPlane,
+                            initialLoad || headlessMode ? ~0u : terrainLoadsPerFrame);
+        if (initialLoad) {
+            std::cout << fmt::format("Terrain: {} chunks loaded, {} visible with {} triangles",
+                                     terrainChunks.loads, terrainChunks.visibleChunks, terrainChunks.visibleTriangles) << std::endl;
+        }
+        initialLoad = false;
+    }
+
+    int windowWidth, windowHeight;
+    getRenderSize(window, windowWidth, windowHeight);
+    trackRenderState(renderScheduler, rootNode, viewProjection, windowWidth, windowHeight);
     
     //Calculate orthographic projection at (0,0)
     glm::mat4 orthoProjection = glm::ortho(0.0f, float(windowWidth),
@@ -414,14 +903,7 @@ void updateFrame(GLFWwindow* window) {
 }
 
 void updateNodeTransformations(SceneNode* node, glm::mat4 transformationThusFar, glm::mat4 viewTransformation) {
-    glm::mat4 transformationMatrix =
-              glm::translate(node->position)
-            * glm::translate(node->referencePoint)
-            * glm::rotate(node->rotation.y, glm::vec3(0,1,0))
-            * glm::rotate(node->rotation.x, glm::vec3(1,0,0))
-            * glm::rotate(node->rotation.z, glm::vec3(0,0,1))
-            * glm::scale(node->scale)
-            * glm::translate(-node->referencePoint);
+    glm::mat4 transformationMatrix = nodeTransformation(node);
 
     node->currentTransformationMatrix = viewTransformation * transformationThusFar * transformationMatrix;
     node->modelMatrix = transformationThusFar * transformationMatrix;
@@ -431,7 +913,16 @@ void updateNodeTransformations(SceneNode* node, glm::mat4 transformationThusFar,
     }                     
 }
 
-void renderNode(SceneNode* node) {
+// Switches to the G-buffer variant for a material, uniforms are per program so they are set afterwards
+void useGBufferShader(const ShaderDefines& material) {
+    Gloom::Shader* variant = getShaderVariant(gBufferShaders, material);
+    if (variant != activeGBufferShader) {
+        variant->activate();
+        activeGBufferShader = variant;
+    }
+}
+
+void setNodeUniforms(SceneNode* node) {
     // MVP
     glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(node->currentTransformationMatrix));
     // Model matrix
@@ -439,32 +930,39 @@ void renderNode(SceneNode* node) {
     // Normals matrix
     glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(node->modelMatrix)));
     glUniformMatrix3fv(5, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    // Camera position
-    glUniform3fv(6, 1, glm::value_ptr(cameraPosition));
-    // Textures settings
-    glUniform1i(7, false);
+    // Object ID for the outline pass
+    glUniform1ui(8, node->objectID);
+}
+
+void renderNode(SceneNode* node) {
+    // Nodes in the vertex pool were already drawn by the multi-draws, only their children are left
+    if (useVertexPulling && node->pulledMeshID != -1) {
+        for(SceneNode* child : node->children) {
+            renderNode(child);
+        }
+        return;
+    }
+
+    // Chunked terrain outside the view, other nodes have no bounds
+    bool culled = nodeOutsideFrustum(node, node->currentTransformationMatrix);
 
     switch(node->nodeType) {
         case GEOMETRY:
-            if(node->vertexArrayObjectID != -1) {
+            if(node->vertexArrayObjectID != -1 && !culled) {
+                useGBufferShader(untexturedMaterial);
+                setNodeUniforms(node);
                 glBindVertexArray(node->vertexArrayObjectID);
                 glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, nullptr);
             }
             break;
         case POINT_LIGHT:
-            // Calculate light position
-            glm::vec3 lightPosition;
-            lightPosition = glm::vec3(node->modelMatrix  * glm::vec4(0.0, 0.0, 0.0, 1.0));
-
-            glUniform3fv(shader->getUniformFromName("light_source[" + std::to_string(node->id) + "].position"), 1, glm::value_ptr(lightPosition)); 
-            glUniform3fv(shader->getUniformFromName("light_source[" + std::to_string(node->id) + "].color"), 1, glm::value_ptr(node->color));
-    
+            // Lights reach the shader through the cluster buffers
             break;
         case TEXTURE_MAP:
-            glUniform1i(7, true);
-            glBindTextureUnit(0, node->textureID);
-
-            if (node->vertexArrayObjectID != -1) {
+            if (node->vertexArrayObjectID != -1 && !culled) {
+                useGBufferShader(texturedMaterial);
+                setNodeUniforms(node);
+                glBindTextureUnit(0, node->textureID);
                 glBindVertexArray(node->vertexArrayObjectID);
                 glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, nullptr);
             }
@@ -476,35 +974,307 @@ void renderNode(SceneNode* node) {
     }
 }
 
-void renderFrame(GLFWwindow* window) {
-    int windowWidth, windowHeight;
-    glfwGetWindowSize(window, &windowWidth, &windowHeight);
-    glViewport(0, 0, windowWidth, windowHeight);
+void renderDepthNode(SceneNode* node) {
+    // MVP
+    glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(node->currentTransformationMatrix));
+
+    switch(node->nodeType) {
+        case GEOMETRY:
+        case TEXTURE_MAP:
+            if (node->vertexArrayObjectID != -1 && !nodeOutsideFrustum(node, node->currentTransformationMatrix)) {
+                glBindVertexArray(node->vertexArrayObjectID);
+                glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, nullptr);
+            }
+            break;
+        case POINT_LIGHT:
+            break;
+    }
+
+    for(SceneNode* child : node->children) {
+        renderDepthNode(child);
+    }
+}
+
+// Render graph passes. The graph binds each pass's targets and sets the viewport before running it.
 
+// Shadow cube maps, static geometry comes from the cache when nothing moved
+void renderShadowPass() {
+    renderShadowMaps(shadowMaps, rootNode, lightClusters.lights);
+}
 
-    // Render scene to framebuffer
+// Rasterizes the scene into the G-buffer, only needed when the camera or geometry moved
+void renderGBufferPass() {
+    if (!gBufferDirty) {
+        return;
+    }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
     glClearColor(0.157f, 0.565f, 0.863f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Integer attachments cannot be cleared with the float clear color
+    GLuint backgroundID[4] = { 0, 0, 0, 0 };
+    glClearBufferuiv(GL_COLOR, 3, backgroundID);
     glEnable(GL_DEPTH_TEST);
+
+    if (useDepthPrepass) {
+        // Lay down depth only, then shade just the visible fragments
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        shaderDepth->activate();
+        renderDepthNode(rootNode);
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_EQUAL);
+    }
     
-    shader->activate();
+    // Other passes change the bound program, so the first node always activates its variant
+    activeGBufferShader = nullptr;
+    glBindTextureUnit(tonalArtMapTextureUnit, tonalArtMapTexture);
+    if (useVertexPulling) {
+        buildPulledBatches(vertexPool, rootNode);
+        for (PulledBatch& batch : vertexPool.batches) {
+            useGBufferShader(batch.textured ? texturedPulledMaterial : untexturedPulledMaterial);
+            if (batch.textured) {
+                glBindTextureUnit(0, batch.textureID);
+            }
+            drawPulledBatch(vertexPool, batch);
+        }
+    }
+    // Everything not in the vertex pool, such as streamed terrain chunks
     renderNode(rootNode);
 
-    // Post-processing pass
+    if (useDepthPrepass) {
+        // Restore so the next clear and any other pass see the default state
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+    if (useGeometricLines) {
+        // Ink straight into the color attachment, the other attachments keep the surface underneath
+        GLenum colorAttachment = GL_COLOR_ATTACHMENT0;
+        glDrawBuffers(1, &colorAttachment);
+        renderSilhouetteLines(silhouetteLines, rootNode, viewProjection, cameraPosition, renderGraph.width, renderGraph.height);
+        glDrawBuffers(5, gBufferAttachments);
+    }
+}
+
+// Distance to the nearest edge for every pixel, cached along with the G-buffer
+void renderOutlinePass() {
+    if (!gBufferDirty) {
+        return;
+    }
+
+    unsigned int seedFramebuffers[2] = {
+        graphFramebuffer(renderGraph, { outlineSeedTargets[0] }),
+        graphFramebuffer(renderGraph, { outlineSeedTargets[1] })
+    };
+    unsigned int seedTextures[2] = {
+        graphTexture(renderGraph, outlineSeedTargets[0]),
+        graphTexture(renderGraph, outlineSeedTargets[1])
+    };
+    outlineSeedResult = renderOutlines(outlines, rectVAO, graphTexture(renderGraph, normalTarget),
+                                       graphTexture(renderGraph, linearDepthTarget), graphTexture(renderGraph, objectIDTarget),
+                                       seedFramebuffers, seedTextures);
+}
+
+void renderLightingPass() {
+    glDisable(GL_DEPTH_TEST);
+
+    // The shadow lookups are compiled out while no light has a shadow map
+    ShaderDefines defines = lightingDefines;
+    defines["SHADOWS"] = "0";
+    for (ClusterLight& light : lightClusters.lights) {
+        if (light.color.w >= 0.0f) {
+            defines["SHADOWS"] = "1";
+        }
+    }
+    Gloom::Shader* shaderLighting = getShaderVariant(lightingShaders, defines);
+
+    shaderLighting->activate();
+    glUniform2f(shaderLighting->getUniformFromName("screen_size"), float(renderGraph.width), float(renderGraph.height));
+    glUniform3fv(shaderLighting->getUniformFromName("camera_position"), 1, glm::value_ptr(cameraPosition));
+    glUniformMatrix4fv(shaderLighting->getUniformFromName("inverse_view_projection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(viewProjection)));
+    glBindVertexArray(rectVAO);
+    glBindTextureUnit(0, graphTexture(renderGraph, albedoTarget));
+    glBindTextureUnit(1, graphTexture(renderGraph, normalTarget));
+    glBindTextureUnit(tonalArtMapTextureUnit, tonalArtMapTexture);
+    glBindTextureUnit(shadowMapTextureUnit, shadowMaps.cubeArray);
+    glBindTextureUnit(5, graphTexture(renderGraph, depthStencilTarget));
+    glBindTextureUnit(6, graphTexture(renderGraph, hatchCoordinateTarget));
+    glBindTextureUnit(7, graphTexture(renderGraph, objectIDTarget));
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Outlines over the lit scene
+void renderCompositePass() {
     glClear(GL_COLOR_BUFFER_BIT);
     glDisable(GL_DEPTH_TEST);
 
-    shaderPP->activate();
+    getShaderVariant(compositeShaders, compositeDefines)->activate();
     glBindVertexArray(rectVAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, framebufferTexture);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalTexture);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glBindTextureUnit(0, graphTexture(renderGraph, litTarget));
+    glBindTextureUnit(2, graphTexture(renderGraph, linearDepthTarget));
+    glBindTextureUnit(outlineSeedTextureUnit, graphTexture(renderGraph, outlineSeedTargets[outlineSeedResult]));
     glDrawArrays(GL_TRIANGLES, 0, 6);    
 }
+
+void renderFXAAPass() {
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+
+    shaderFXAA->activate();
+    glUniform2f(shaderFXAA->getUniformFromName("inverse_screen_size"), 1.0f / float(renderGraph.width), 1.0f / float(renderGraph.height));
+    glBindVertexArray(rectVAO);
+    glBindTextureUnit(0, graphTexture(renderGraph, compositeTarget));
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+// Declares the passes in execution order, passes nothing depends on are culled when the graph is compiled
+void buildRenderGraph() {
+    // Renders into its own cube maps, so it is kept even though no pass reads a graph resource from it
+    unsigned int shadowPass = addGraphPass(renderGraph, "shadows", {}, {}, renderShadowPass);
+    renderGraph.passes[shadowPass].hasSideEffects = true;
+    renderGraph.passes[shadowPass].bindTargets = false;
+
+    unsigned int gBufferPass = addGraphPass(renderGraph, "g-buffer", {},
+                                            { albedoTarget, normalTarget, linearDepthTarget, objectIDTarget, hatchCoordinateTarget },
+                                            renderGBufferPass);
+    renderGraph.passes[gBufferPass].depthWrite = depthStencilTarget;
+
+    unsigned int outlinePass = addGraphPass(renderGraph, "outlines", { normalTarget, linearDepthTarget, objectIDTarget },
+                                            { outlineSeedTargets[0], outlineSeedTargets[1] }, renderOutlinePass);
+    renderGraph.passes[outlinePass].bindTargets = false;
+
+    addGraphPass(renderGraph, "lighting",
+                 { albedoTarget, normalTarget, depthStencilTarget, hatchCoordinateTarget, objectIDTarget },
+                 { litTarget }, renderLightingPass);
+
+    // Geometric lines are already in the albedo, so the image space outlines are not read and get culled
+    std::vector<unsigned int> compositeInputs = { litTarget, linearDepthTarget };
+    if (!useGeometricLines) {
+        compositeInputs.push_back(outlineSeedTargets[0]);
+        compositeInputs.push_back(outlineSeedTargets[1]);
+    }
+    addGraphPass(renderGraph, "composite", compositeInputs,
+                 { useFXAA ? compositeTarget : renderGraphBackbuffer }, renderCompositePass);
+
+    if (useFXAA) {
+        addGraphPass(renderGraph, "fxaa", { compositeTarget }, { renderGraphBackbuffer }, renderFXAAPass);
+    }
+}
+
+void renderFrame(GLFWwindow* window) {
+    int windowWidth, windowHeight;
+    getRenderSize(window, windowWidth, windowHeight);
+
+    // Reallocates the targets if the window size changed
+    resizeRenderGraph(renderGraph, windowWidth, windowHeight);
+
+    // Assign this frame's lights to clusters
+    lightClusters.lights.clear();
+    collectLights(rootNode, lightClusters.lights);
+    buildLightClusters(lightClusters, viewTransformation);
+
+    if (useSoftwareRaster) {
+        renderSoftwareFrame(softwareRasterizer, rootNode, lightClusters, cameraPosition, windowWidth, windowHeight);
+        presentSoftwareFrame(softwareRasterizer, renderGraph.backbufferFramebuffer);
+        return;
+    }
+
+    uploadLightClusters(lightClusters);
+
+    // The G-buffer is only redrawn when something it depends on changed since the last frame
+    size_t transformHash = hashSeed;
+    hashGeometryTransforms(rootNode, transformHash);
+    gBufferDirty = !gBufferValid || viewProjection != gBufferViewProjection || transformHash != gBufferTransformHash
+                || windowWidth != gBufferWidth || windowHeight != gBufferHeight;
+    if (gBufferDirty) {
+        gBufferValid = true;
+        gBufferViewProjection = viewProjection;
+        gBufferTransformHash = transformHash;
+        gBufferWidth = windowWidth;
+        gBufferHeight = windowHeight;
+        gBufferRedraws++;
+    }
+
+    executeRenderGraph(renderGraph);
+}
+
+void setOutputFramebuffer(unsigned int framebuffer) {
+    setRenderGraphBackbuffer(renderGraph, framebuffer);
+}
+
+void setRenderSize(int width, int height) {
+    renderWidth = width;
+    renderHeight = height;
+    setLightClusterAspect(lightClusters, float(width) / float(height));
+}
+
+SceneView currentSceneView() {
+    SceneView view;
+    view.cameraPosition = cameraPosition;
+    view.cameraPitch = cameraPitch;
+    view.cameraYaw = cameraYaw;
+    for (SceneNode* light : pointLightNodes) {
+        view.lightPositions.push_back(light->position);
+    }
+    return view;
+}
+
+void setSceneView(SceneView const &view) {
+    sceneViewFixed = true;
+    cameraPosition = view.cameraPosition;
+    cameraPitch = view.cameraPitch;
+    cameraYaw = view.cameraYaw;
+    for (size_t i = 0; i < view.lightPositions.size() && i < pointLightNodes.size(); i++) {
+        pointLightNodes[i]->position = view.lightPositions[i];
+    }
+}
+
+// Renders only when something changed since the last frame, returns whether a frame was produced
+bool renderScheduledFrame(GLFWwindow* window) {
+    if (!beginScheduledFrame(renderScheduler)) {
+        return false;
+    }
+    renderFrame(window);
+    return true;
+}
+
+bool exportGBuffer(std::string const &path) {
+    if (useSoftwareRaster) {
+        std::cerr << "The software rasterizer keeps no G-buffer to export" << std::endl;
+        return false;
+    }
+    if (useGeometricLines) {
+        // The lines are already drawn into the lit colors, a regrade would outline them a second time
+        std::cerr << "G-buffers cannot be exported with --geometric-lines, their lines are part of the colors" << std::endl;
+        return false;
+    }
+    GBufferFile gbuffer;
+    gbuffer.width = renderGraph.width;
+    gbuffer.height = renderGraph.height;
+    size_t pixels = size_t(gbuffer.width) * gbuffer.height;
+    gbuffer.color.resize(pixels * 3);
+    gbuffer.normals.resize(pixels * 2);
+    gbuffer.linearDepth.resize(pixels);
+    gbuffer.objectIDs.resize(pixels);
+    std::vector<float> normals(pixels * 3);
+
+    // Rows of three bytes are not padded to four
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTextureImage(graphTexture(renderGraph, litTarget), 0, GL_RGB, GL_UNSIGNED_BYTE,
+                      GLsizei(gbuffer.color.size()), gbuffer.color.data());
+    glGetTextureImage(graphTexture(renderGraph, normalTarget), 0, GL_RGB, GL_FLOAT,
+                      GLsizei(normals.size() * sizeof(float)), normals.data());
+    glGetTextureImage(graphTexture(renderGraph, linearDepthTarget), 0, GL_RED, GL_HALF_FLOAT,
+                      GLsizei(pixels * sizeof(unsigned short)), gbuffer.linearDepth.data());
+    glGetTextureImage(graphTexture(renderGraph, objectIDTarget), 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT,
+                      GLsizei(pixels * sizeof(unsigned short)), gbuffer.objectIDs.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    // The target holds 0.5 * n + 0.5
+    for (size_t i = 0; i < pixels; i++) {
+        glm::vec3 normal(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+        encodeOctahedral(glm::normalize(normal * 2.0f - 1.0f), gbuffer.normals[i * 2], gbuffer.normals[i * 2 + 1]);
+    }
+    return writeGBufferFile(path, gbuffer);
+}
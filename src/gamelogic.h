@@ -3,9 +3,43 @@
 #include <GLFW/glfw3.h>
 
 #include <utilities/window.hpp>
+#include <vector>
 #include "sceneGraph.hpp"
 
+// Camera and light placement of one image, replacing the animation (see renderServer)
+struct SceneView {
+    glm::vec3 cameraPosition;
+    float cameraPitch;  // radians, positive looks down
+    float cameraYaw;    // radians around the vertical axis
+    std::vector<glm::vec3> lightPositions;  // point lights in creation order, relative to their parent node
+};
+
 void updateNodeTransformations(SceneNode* node, glm::mat4 transformationThusFar, glm::mat4 viewTransformation);
 void initGame(GLFWwindow* window, CommandLineOptions options);
+
+// Decodes the scene's textures and models into the asset cache unless it is current. Needs no
+// GL context, so a coordinator can do it once before starting render processes.
+void buildSceneAssetCache();
 void updateFrame(GLFWwindow* window);
-void renderFrame(GLFWwindow* window);
\ No newline at end of file
+
+// updateFrame in two halves, for running the simulation on its own thread. simulateFrame advances
+// the animation and writes the resulting transforms to the snapshot, touching no GL state and no
+// node matrix. Returns whether anything moved. presentSnapshot makes the snapshot what the next
+// frames draw and belongs to the render thread.
+bool simulateFrame(double timeDelta, SceneSnapshot& snapshot);
+void presentSnapshot(GLFWwindow* window, SceneSnapshot const &snapshot);
+void renderFrame(GLFWwindow* window);
+bool renderScheduledFrame(GLFWwindow* window);
+
+// Framebuffer the final image goes to instead of the window, for headless rendering
+void setOutputFramebuffer(unsigned int framebuffer);
+
+// Headless only, the window decides its own size
+void setRenderSize(int width, int height);
+
+// The view of the next frames, which stops the light animation
+SceneView currentSceneView();
+void setSceneView(SceneView const &view);
+
+// Writes the lit image and the buffers the outline passes read from the last frame, for --export-gbuffer
+bool exportGBuffer(std::string const &path);
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "gbufferFile.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utilities/fileutils.h>
+
+// Bumped whenever the file layout changes
+static const uint32_t gbufferMagic = 0x31464247; // "GBF1"
+
+template <class T>
+static void writeValues(std::ofstream& file, std::vector<T> const &values) {
+    file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <class T>
+static bool readValues(std::ifstream& file, std::vector<T>& values, size_t count) {
+    values.resize(count);
+    return bool(file.read(reinterpret_cast<char*>(values.data()), count * sizeof(T)));
+}
+
+bool writeGBufferFile(std::string const &path, GBufferFile const &gbuffer) {
+    std::string temporaryPath = temporaryFilePath(path);
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    uint32_t header[3] = { gbufferMagic, uint32_t(gbuffer.width), uint32_t(gbuffer.height) };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    writeValues(file, gbuffer.color);
+    writeValues(file, gbuffer.normals);
+    writeValues(file, gbuffer.linearDepth);
+    writeValues(file, gbuffer.objectIDs);
+    file.close();
+    if (!file || !replaceFile(temporaryPath, path)) {
+        std::cerr << "Could not write the G-buffer to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readGBufferFile(std::string const &path, GBufferFile& gbuffer) {
+    std::ifstream file(path, std::ios::binary);
+    uint32_t header[3] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || header[0] != gbufferMagic || header[1] == 0 || header[2] == 0 || header[1] > 65536 || header[2] > 65536) {
+        std::cerr << path << " is not a G-buffer written by --export-gbuffer" << std::endl;
+        return false;
+    }
+    gbuffer.width = int(header[1]);
+    gbuffer.height = int(header[2]);
+    size_t pixels = size_t(gbuffer.width) * gbuffer.height;
+    bool complete = readValues(file, gbuffer.color, pixels * 3) && readValues(file, gbuffer.normals, pixels * 2)
+                 && readValues(file, gbuffer.linearDepth, pixels) && readValues(file, gbuffer.objectIDs, pixels);
+    if (!complete) {
+        std::cerr << "The G-buffer in " << path << " is cut short" << std::endl;
+    }
+    return complete;
+}
+
+static short toSnorm16(float value) {
+    return short(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// The octahedron's lower half is folded over the upper one
+void encodeOctahedral(glm::vec3 normal, short& u, short& v) {
+    float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    glm::vec2 folded = length > 0.0f ? glm::vec2(normal.x, normal.y) / length : glm::vec2(0.0f);
+    if (normal.z < 0.0f) {
+        folded = glm::vec2((1.0f - std::abs(folded.y)) * (folded.x >= 0.0f ? 1.0f : -1.0f),
+                           (1.0f - std::abs(folded.x)) * (folded.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    u = toSnorm16(folded.x);
+    v = toSnorm16(folded.y);
+}
+
+glm::vec3 decodeOctahedral(short u, short v) {
+    glm::vec3 normal(u / 32767.0f, v / 32767.0f, 0.0f);
+    normal.z = 1.0f - std::abs(normal.x) - std::abs(normal.y);
+    if (normal.z < 0.0f) {
+        float x = normal.x;
+        normal.x = (1.0f - std::abs(normal.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        normal.y = (1.0f - std::abs(x)) * (normal.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(normal);
+}
+
+float halfToFloat(unsigned short value) {
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        // Subnormal, renormalized for the wider exponent
+        float magnitude = std::ldexp(float(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
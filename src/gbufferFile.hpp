@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// What the outline and composite passes read from one frame, stored compactly so a finished
+// render can be outlined again with other settings (see postKernels). Rows start at the bottom,
+// as read from GL. 11 bytes a pixel against 17 in the GL targets.
+struct GBufferFile {
+    int width;
+    int height;
+    std::vector<unsigned char> color;         // RGB of the lighting pass, before outlines
+    std::vector<short> normals;               // world space, octahedral in two signed 16-bit values
+    std::vector<unsigned short> linearDepth;  // half floats, exactly as the GL target holds them
+    std::vector<unsigned short> objectIDs;
+};
+
+// Both return false with a message
+bool writeGBufferFile(std::string const &path, GBufferFile const &gbuffer);
+bool readGBufferFile(std::string const &path, GBufferFile& gbuffer);
+
+void encodeOctahedral(glm::vec3 normal, short& u, short& v);
+glm::vec3 decodeOctahedral(short u, short v);
+float halfToFloat(unsigned short value);
@@ -0,0 +1,128 @@
+#include "headless.hpp"
+#include <glad/glad.h>
+#include <cstdio>
+#include <cstring>
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static bool hasExtension(const char* extensions, const char* name) {
+    return extensions != nullptr && strstr(extensions, name) != nullptr;
+}
+
+static EGLDisplay openDisplay() {
+    // The surfaceless platform needs neither a display server nor a GPU
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay && hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY) {
+            return display;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static bool createContext(HeadlessContext& headless) {
+    EGLDisplay display = openDisplay();
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        fprintf(stderr, "Could not initialise EGL\n");
+        return false;
+    }
+
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!hasExtension(extensions, "EGL_KHR_surfaceless_context") || !eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "EGL %d.%d has no surfaceless OpenGL contexts\n", major, minor);
+        eglTerminate(display);
+        return false;
+    }
+
+    // Without EGL_KHR_no_config_context any config that can render OpenGL will do, no surface uses it
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!hasExtension(extensions, "EGL_KHR_no_config_context")) {
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+            fprintf(stderr, "No EGL config supports OpenGL\n");
+            eglTerminate(display);
+            return false;
+        }
+    }
+
+    // Same version and profile as the window context
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "Could not create a surfaceless OpenGL 4.3 context (EGL error 0x%x)\n", eglGetError());
+        eglTerminate(display);
+        return false;
+    }
+
+    headless.display = display;
+    headless.context = context;
+    return gladLoadGLLoader((GLADloadproc) eglGetProcAddress) != 0;
+}
+#endif
+
+bool initHeadlessContext(HeadlessContext& headless, int width, int height) {
+#ifdef HEADLESS_EGL
+    if (!createContext(headless)) {
+        return false;
+    }
+
+    printf("%s: %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
+    printf("OpenGL\t %s\n", glGetString(GL_VERSION));
+    printf("GLSL\t %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+    printf("Headless\t %dx%d\n\n", width, height);
+
+    glGenRenderbuffers(1, &headless.colorBuffer);
+    glGenRenderbuffers(1, &headless.depthBuffer);
+    resizeHeadlessContext(headless, width, height);
+
+    glGenFramebuffers(1, &headless.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless.framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless.colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, headless.depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Headless framebuffer is incomplete\n");
+        destroyHeadlessContext(headless);
+        return false;
+    }
+    return true;
+#else
+    (void) headless; (void) width; (void) height;
+    fprintf(stderr, "This build has no headless rendering, it needs EGL\n");
+    return false;
+#endif
+}
+
+void resizeHeadlessContext(HeadlessContext& headless, int width, int height) {
+    // Same formats as the window's default framebuffer
+    headless.width = width;
+    headless.height = height;
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+}
+
+void destroyHeadlessContext(HeadlessContext& headless) {
+#ifdef HEADLESS_EGL
+    glDeleteFramebuffers(1, &headless.framebuffer);
+    glDeleteRenderbuffers(1, &headless.colorBuffer);
+    glDeleteRenderbuffers(1, &headless.depthBuffer);
+    eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(headless.display, headless.context);
+    eglTerminate(headless.display);
+#else
+    (void) headless;
+#endif
+}
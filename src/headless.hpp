@@ -0,0 +1,22 @@
+#pragma once
+
+// OpenGL context without a window, for render nodes and CI machines that have no display.
+// Uses a surfaceless EGL context, which Mesa provides on every driver including llvmpipe.
+struct HeadlessContext {
+    // EGLDisplay and EGLContext, kept opaque so EGL headers stay out of the rest of the program
+    void* display;
+    void* context;
+
+    // Stands in for the window's default framebuffer
+    unsigned int framebuffer;
+    unsigned int colorBuffer;
+    unsigned int depthBuffer;
+    int width;
+    int height;
+};
+
+// Creates the context, makes it current, loads the GL functions and creates the framebuffer.
+// Returns false with a message on stderr when no headless context is available.
+bool initHeadlessContext(HeadlessContext& headless, int width, int height);
+void resizeHeadlessContext(HeadlessContext& headless, int width, int height);
+void destroyHeadlessContext(HeadlessContext& headless);
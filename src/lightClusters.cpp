@@ -0,0 +1,170 @@
+#include "lightClusters.hpp"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+
+// Index of the depth slice containing the given view space depth
+static unsigned int sliceForDepth(LightClusters& clusters, float depth) {
+    float slice = std::log(depth / clusters.nearPlane) / std::log(clusters.farPlane / clusters.nearPlane) * float(clusterCountZ);
+    return (unsigned int) std::min(std::max(slice, 0.0f), float(clusterCountZ - 1));
+}
+
+// The frustum bounds only depend on the projection, so they are only computed when it changes
+static void computeClusterBounds(LightClusters& clusters) {
+    float nearPlane = clusters.nearPlane;
+    float farPlane = clusters.farPlane;
+    float tanHalfY = std::tan(clusters.fovY / 2.0f);
+    float tanHalfX = tanHalfY * clusters.aspect;
+
+    for (unsigned int z = 0; z < clusterCountZ; z++) {
+        float sliceNear = nearPlane * std::pow(farPlane / nearPlane, float(z) / float(clusterCountZ));
+        float sliceFar  = nearPlane * std::pow(farPlane / nearPlane, float(z + 1) / float(clusterCountZ));
+
+        for (unsigned int y = 0; y < clusterCountY; y++) {
+            float ndcY0 = -1.0f + 2.0f * float(y) / float(clusterCountY);
+            float ndcY1 = -1.0f + 2.0f * float(y + 1) / float(clusterCountY);
+
+            for (unsigned int x = 0; x < clusterCountX; x++) {
+                float ndcX0 = -1.0f + 2.0f * float(x) / float(clusterCountX);
+                float ndcX1 = -1.0f + 2.0f * float(x + 1) / float(clusterCountX);
+
+                glm::vec3 minimum(INFINITY);
+                glm::vec3 maximum(-INFINITY);
+                for (float depth : {sliceNear, sliceFar}) {
+                    for (float ndcX : {ndcX0, ndcX1}) {
+                        for (float ndcY : {ndcY0, ndcY1}) {
+                            glm::vec3 corner(ndcX * depth * tanHalfX, ndcY * depth * tanHalfY, -depth);
+                            minimum = glm::min(minimum, corner);
+                            maximum = glm::max(maximum, corner);
+                        }
+                    }
+                }
+
+                unsigned int index = x + y * clusterCountX + z * clusterCountX * clusterCountY;
+                clusters.clusterMin[index] = minimum;
+                clusters.clusterMax[index] = maximum;
+            }
+        }
+    }
+}
+
+void initLightClusters(LightClusters& clusters, float fovY, float aspect, float nearPlane, float farPlane) {
+    clusters.fovY = fovY;
+    clusters.aspect = aspect;
+    clusters.nearPlane = nearPlane;
+    clusters.farPlane = farPlane;
+
+    glGenBuffers(1, &clusters.lightBuffer);
+    glGenBuffers(1, &clusters.clusterBuffer);
+    glGenBuffers(1, &clusters.lightIndexBuffer);
+
+    clusters.clusterMin.resize(clusterCount);
+    clusters.clusterMax.resize(clusterCount);
+    clusters.clusterRanges.resize(clusterCount);
+    computeClusterBounds(clusters);
+}
+
+void setLightClusterAspect(LightClusters& clusters, float aspect) {
+    if (aspect != clusters.aspect) {
+        clusters.aspect = aspect;
+        computeClusterBounds(clusters);
+    }
+}
+
+// Gathers every point light in the scene graph along with its world space position
+void collectLights(SceneNode* node, std::vector<ClusterLight>& lights) {
+    if (node->nodeType == POINT_LIGHT) {
+        ClusterLight light;
+        glm::vec3 position = glm::vec3(node->modelMatrix * glm::vec4(0.0, 0.0, 0.0, 1.0));
+        light.positionRadius = glm::vec4(position, node->lightRadius);
+        light.color = glm::vec4(node->color, -1.0f);
+
+        if (node->castsShadows) {
+            unsigned int shadowSlot = 0;
+            for (ClusterLight& other : lights) {
+                if (other.color.w >= 0.0f) {
+                    shadowSlot++;
+                }
+            }
+            if (shadowSlot < maxShadowCastingLights) {
+                light.color.w = float(shadowSlot);
+            }
+        }
+        lights.push_back(light);
+    }
+
+    for (SceneNode* child : node->children) {
+        collectLights(child, lights);
+    }
+}
+
+// Assigns every light to the clusters its sphere of influence touches
+void buildLightClusters(LightClusters& clusters, glm::mat4 viewTransformation) {
+    clusters.assignments.clear();
+
+    for (unsigned int i = 0; i < clusters.lights.size(); i++) {
+        glm::vec4 positionRadius = clusters.lights[i].positionRadius;
+        glm::vec3 center = glm::vec3(viewTransformation * glm::vec4(glm::vec3(positionRadius), 1.0f));
+        float radius = positionRadius.w;
+        float depth = -center.z;
+
+        if (depth + radius < clusters.nearPlane || depth - radius > clusters.farPlane) {
+            continue;
+        }
+
+        // Only the slices overlapping the sphere's depth range need testing
+        unsigned int firstSlice = sliceForDepth(clusters, std::max(depth - radius, clusters.nearPlane));
+        unsigned int lastSlice  = sliceForDepth(clusters, std::min(depth + radius, clusters.farPlane));
+
+        for (unsigned int z = firstSlice; z <= lastSlice; z++) {
+            for (unsigned int xy = 0; xy < clusterCountX * clusterCountY; xy++) {
+                unsigned int index = xy + z * clusterCountX * clusterCountY;
+
+                // Sphere against cluster AABB
+                glm::vec3 closest = glm::clamp(center, clusters.clusterMin[index], clusters.clusterMax[index]);
+                glm::vec3 offset = closest - center;
+                if (glm::dot(offset, offset) <= radius * radius) {
+                    clusters.assignments.push_back(glm::uvec2(index, i));
+                }
+            }
+        }
+    }
+
+    // Counting sort of the assignments into one flat index list per cluster
+    std::fill(clusters.clusterRanges.begin(), clusters.clusterRanges.end(), glm::uvec2(0, 0));
+    for (glm::uvec2 assignment : clusters.assignments) {
+        clusters.clusterRanges[assignment.x].y++;
+    }
+
+    unsigned int offset = 0;
+    for (glm::uvec2& range : clusters.clusterRanges) {
+        range.x = offset;
+        offset += range.y;
+        range.y = 0;
+    }
+
+    clusters.lightIndices.resize(clusters.assignments.size());
+    for (glm::uvec2 assignment : clusters.assignments) {
+        glm::uvec2& range = clusters.clusterRanges[assignment.x];
+        clusters.lightIndices[range.x + range.y] = assignment.y;
+        range.y++;
+    }
+}
+
+template <class T>
+static void uploadStorageBuffer(unsigned int bufferID, unsigned int binding, std::vector<T>& data) {
+    // Empty buffers cannot be bound, so always allocate at least one element
+    GLsizeiptr size = std::max<size_t>(data.size(), 1) * sizeof(T);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferID);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    if (!data.empty()) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data.size() * sizeof(T), data.data());
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, bufferID);
+}
+
+void uploadLightClusters(LightClusters& clusters) {
+    uploadStorageBuffer(clusters.lightBuffer, lightBufferBinding, clusters.lights);
+    uploadStorageBuffer(clusters.clusterBuffer, clusterBufferBinding, clusters.clusterRanges);
+    uploadStorageBuffer(clusters.lightIndexBuffer, lightIndexBufferBinding, clusters.lightIndices);
+}
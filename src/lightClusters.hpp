@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "sceneGraph.hpp"
+
+// Froxel grid: screen tiles in x/y and exponentially spaced slices in view depth.
+// Must match the cluster lookup in lighting.frag.
+const unsigned int clusterCountX = 16;
+const unsigned int clusterCountY = 9;
+const unsigned int clusterCountZ = 24;
+const unsigned int clusterCount  = clusterCountX * clusterCountY * clusterCountZ;
+
+// Lights with castsShadows set get one of this many shadow cube map slots, in scene graph order
+const unsigned int maxShadowCastingLights = 4;
+
+// Shader storage binding points used by the light culling buffers
+const unsigned int lightBufferBinding        = 0;
+const unsigned int clusterBufferBinding      = 1;
+const unsigned int lightIndexBufferBinding   = 2;
+
+// One light as laid out in the std430 light buffer
+struct ClusterLight {
+    glm::vec4 positionRadius; // world space position, w is the radius of influence
+    glm::vec4 color;          // rgb in [0, 255], w is the shadow map slot or -1
+};
+
+struct LightClusters {
+    // GPU buffers
+    unsigned int lightBuffer;
+    unsigned int clusterBuffer;
+    unsigned int lightIndexBuffer;
+
+    // Projection the cluster bounds were built for
+    float fovY;
+    float aspect;
+    float nearPlane;
+    float farPlane;
+
+    // View space bounding box of every cluster
+    std::vector<glm::vec3> clusterMin;
+    std::vector<glm::vec3> clusterMax;
+
+    // Per frame data, kept around to avoid reallocating every frame
+    std::vector<ClusterLight> lights;
+    std::vector<glm::uvec2> clusterRanges; // (offset, count) into lightIndices
+    std::vector<unsigned int> lightIndices;
+    std::vector<glm::uvec2> assignments;   // (cluster, light) pairs before sorting
+};
+
+void initLightClusters(LightClusters& clusters, float fovY, float aspect, float nearPlane, float farPlane);
+void setLightClusterAspect(LightClusters& clusters, float aspect);
+void collectLights(SceneNode* node, std::vector<ClusterLight>& lights);
+void buildLightClusters(LightClusters& clusters, glm::mat4 viewTransformation);
+void uploadLightClusters(LightClusters& clusters);
@@ -1,12 +1,17 @@
 // Local headers
 #include "utilities/window.hpp"
 #include "program.hpp"
+#include "headless.hpp"
+#include "frameOutput.hpp"
+#include "frameWorkers.hpp"
+#include "postKernels.hpp"
 
 // System headers
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 // Standard headers
+#include <algorithm>
 #include <cstdlib>
 #include <arrrgh.hpp>
 
@@ -18,7 +23,7 @@ static void glfwErrorCallback(int error, const char *description)
 }
 
 
-GLFWwindow* initialise()
+GLFWwindow* initialise(int width, int height)
 {
     // Initialise GLFW
     if (!glfwInit())
@@ -40,7 +45,7 @@ GLFWwindow* initialise()
     glfwWindowHint(GLFW_SAMPLES, windowSamples);  // MSAA
 
     // Create window using GLFW
-    GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, windowTitle.c_str(), nullptr, nullptr);
+    GLFWwindow* window = glfwCreateWindow(width, height, windowTitle.c_str(), nullptr, nullptr);
 
     // Ensure the window is set up correctly
     if (!window)
@@ -70,6 +75,34 @@ int main(int argc, const char* argb[])
     const auto& showHelp       = parser.add<bool>("help", "Show this help message.", 'h', arrrgh::Optional, false);
     const auto& enableMusic    = parser.add<bool>("enable-music", "Play background music while the game is playing", 'm', arrrgh::Optional, false);
     const auto& enableAutoplay = parser.add<bool>("autoplay", "Let the game play itself automatically. Useful for testing.", 'a', arrrgh::Optional, false);
+    const auto& enableDepthPrepass = parser.add<bool>("depth-prepass", "Lay down depth first so every pixel is shaded only once.", 'p', arrrgh::Optional, false);
+    const auto& extraLights    = parser.add<int>("extra-lights", "Scatter this many small point lights over the terrain.", 'l', arrrgh::Optional, 0);
+    const auto& outlineWidth   = parser.add<float>("outline-width", "Ink line width in pixels for nearby edges.", 'w', arrrgh::Optional, 1.0f);
+    const auto& outlineWidthFar = parser.add<float>("outline-width-far", "Ink line width in pixels for distant edges.", 'f', arrrgh::Optional, 1.0f);
+    const auto& edgeThreshold  = parser.add<float>("edge-threshold", "Edge strength above which normal and depth changes inside an object are outlined.", 'T', arrrgh::Optional, 0.3f);
+    const auto& depthEdgeScale = parser.add<float>("depth-edge-scale", "Weight of linear depth differences against normal differences in edge detection.", 'D', arrrgh::Optional, 50.0f);
+    const auto& disableFXAA    = parser.add<bool>("no-fxaa", "Skip the FXAA pass on the final image.", 'x', arrrgh::Optional, false);
+    const auto& logFrames      = parser.add<bool>("log-frames", "Print why every frame was rendered and when rendering goes idle.", 'r', arrrgh::Optional, false);
+    const auto& enablePicking  = parser.add<bool>("pick", "Print the object and point under the cursor on every left click.", 'k', arrrgh::Optional, false);
+    const auto& checkQueries   = parser.add<bool>("check-queries", "Compare the scene ray queries with testing every triangle at startup and print the result.", 'q', arrrgh::Optional, false);
+    const auto& hatchingStyle  = parser.add<int>("hatching-style", "0 for smooth shading, 1 for tonal art map crosshatching.", 'c', arrrgh::Optional, 1);
+    const auto& debugView      = parser.add<int>("debug-view", "Show an intermediate buffer: 1 lighting, 2 position, 3 normals, 4 outlines, 5 edge distance, 6 depth.", 'd', arrrgh::Optional, 0);
+    const auto& enableVertexPulling = parser.add<bool>("vertex-pulling", "Fetch vertices from one shared buffer and draw each material with a single multi-draw.", 'v', arrrgh::Optional, false);
+    const auto& enableChunkedTerrain = parser.add<bool>("chunked-terrain", "Split the terrain into chunks with levels of detail, streamed from disk around the camera.", 't', arrrgh::Optional, false);
+    const auto& softwareRaster = parser.add<bool>("software-raster", "Rasterize, shade and outline on the CPU in tiles, GL only shows the result. No shadows, FXAA, debug views or geometric lines.", 'u', arrrgh::Optional, false);
+    const auto& enableGeometricLines = parser.add<bool>("geometric-lines", "Draw outlines from mesh silhouette and crease edges instead of image space edge detection.", 'g', arrrgh::Optional, false);
+    const auto& headless       = parser.add<bool>("headless", "Render offscreen without a window, through a surfaceless EGL context.", 'o', arrrgh::Optional, false);
+    const auto& headlessFrames = parser.add<int>("frames", "Number of frames to render in headless mode before exiting.", 'n', arrrgh::Optional, 1);
+    const auto& firstFrame     = parser.add<int>("first-frame", "Number of the first headless frame, the animation starts where it would be at this frame.", 'B', arrrgh::Optional, 0);
+    const auto& workers        = parser.add<int>("workers", "Split the headless frames between this many processes, 0 for one per core.", 'W', arrrgh::Optional, 1);
+    const auto& renderWidth    = parser.add<int>("width", "Width of the window or the headless image in pixels.", 'X', arrrgh::Optional, windowWidth);
+    const auto& renderHeight   = parser.add<int>("height", "Height of the window or the headless image in pixels.", 'Y', arrrgh::Optional, windowHeight);
+    const auto& outputPattern  = parser.add<std::string>("output", "Write every rendered frame to a PNG file, a run of # in the name is replaced by the frame number.", 'O', arrrgh::Optional, "");
+    const auto& outputFormat   = parser.add<std::string>("output-format", "png for one image per frame, y4m (headless only) or rgb to stream video to the output path, - for standard output.", 'F', arrrgh::Optional, "png");
+    const auto& serverSocket   = parser.add<std::string>("serve", "Run headless as a render server listening on this Unix domain socket.", 'S', arrrgh::Optional, "");
+    const auto& gbufferPattern = parser.add<std::string>("export-gbuffer", "Also write the G-buffer of every headless frame to this path, a run of # is replaced by the frame number.", 'G', arrrgh::Optional, "");
+    const auto& regradePath    = parser.add<std::string>("regrade", "Outline an exported G-buffer again on the CPU with the outline options and write it to --output, no GL needed.", 'R', arrrgh::Optional, "");
+    const auto& encoderThreads = parser.add<int>("encoder-threads", "Threads encoding output frames, 0 for one per core.", 'e', arrrgh::Optional, 0);
 
     // If you want to add more program arguments, define them here,
     // but do not request their value here (they have not been parsed yet at this point).
@@ -94,9 +127,116 @@ int main(int argc, const char* argb[])
     CommandLineOptions options;
     options.enableMusic    = enableMusic.value();
     options.enableAutoplay = enableAutoplay.value();
+    options.enableDepthPrepass = enableDepthPrepass.value();
+    options.extraLights    = extraLights.value();
+    options.outlineWidth   = outlineWidth.value();
+    options.outlineWidthFar = outlineWidthFar.value();
+    options.edgeThreshold  = edgeThreshold.value();
+    options.depthEdgeScale = depthEdgeScale.value();
+    options.enableGeometricLines = enableGeometricLines.value();
+    options.logFrames      = logFrames.value();
+    options.enablePicking  = enablePicking.value();
+    options.checkQueries   = checkQueries.value();
+    options.disableFXAA    = disableFXAA.value();
+    options.hatchingStyle  = hatchingStyle.value();
+    options.debugView      = debugView.value();
+    options.enableVertexPulling = enableVertexPulling.value();
+    options.enableChunkedTerrain = enableChunkedTerrain.value();
+    options.softwareRaster = softwareRaster.value();
+    options.rasterThreads  = 0;
+    options.headless       = headless.value() || !serverSocket.value().empty();
+    options.headlessFrames = headlessFrames.value();
+    options.firstFrame     = std::max(firstFrame.value(), 0);
+    options.workers        = std::max(workers.value(), 0);
+    options.renderWidth    = renderWidth.value();
+    options.renderHeight   = renderHeight.value();
+    options.outputPattern  = outputPattern.value();
+    options.outputFormat   = outputFormat.value();
+    options.serverSocket   = serverSocket.value();
+    options.encoderThreads = std::max(encoderThreads.value(), 0);
+    options.gbufferPattern = gbufferPattern.value();
+    options.regradePath    = regradePath.value();
+
+    if (options.renderWidth <= 0 || options.renderHeight <= 0)
+    {
+        std::cerr << "Width and height must be positive" << std::endl;
+        exit(1);
+    }
+    if (options.hatchingStyle < HATCHING_SMOOTH || options.hatchingStyle > HATCHING_TONAL_ART_MAP)
+    {
+        std::cerr << "Unknown hatching style " << options.hatchingStyle << ", expected 0 or 1" << std::endl;
+        exit(1);
+    }
+    if (options.debugView < DEBUG_VIEW_NONE || options.debugView > DEBUG_VIEW_DEPTH)
+    {
+        std::cerr << "Unknown debug view " << options.debugView << ", expected 0 to 6" << std::endl;
+        exit(1);
+    }
+    if (!options.gbufferPattern.empty() && options.enableGeometricLines)
+    {
+        // Regrading would outline the lines already drawn into the colors a second time
+        std::cerr << "--export-gbuffer cannot be combined with --geometric-lines" << std::endl;
+        exit(1);
+    }
+
+    FrameOutputFormat format;
+    if (!frameOutputFormatFromName(options.outputFormat, format))
+    {
+        std::cerr << "Unknown output format " << options.outputFormat << ", expected png, y4m or rgb" << std::endl;
+        exit(1);
+    }
+    if (format == OUTPUT_Y4M && !options.outputPattern.empty() && !options.headless)
+    {
+        // The header promises a fixed frame rate, which only headless frames keep
+        std::cerr << "y4m output needs --headless, window frames are captured at whatever rate the display allows" << std::endl;
+        exit(1);
+    }
+    if (format != OUTPUT_PNG && options.outputPattern == "-")
+    {
+        // Before anything else is printed
+        reserveStandardOutput();
+    }
+
+    if (!options.regradePath.empty())
+    {
+        // Works on the exported buffers alone, so no context is created
+        if (options.outputPattern.empty())
+        {
+            std::cerr << "--regrade needs an --output path" << std::endl;
+            exit(1);
+        }
+        OutlineSettings settings = { options.outlineWidth, options.outlineWidthFar, options.edgeThreshold, options.depthEdgeScale };
+        return regradeGBuffer(options.regradePath, options.outputPattern, format, settings) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (options.headless && options.workers != 1 && options.serverSocket.empty())
+    {
+        // Every worker creates its own context, this process only coordinates
+        return runFrameWorkers(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (options.headless)
+    {
+        // No GLFW at all, so this works without a display server
+        HeadlessContext context;
+        if (!initHeadlessContext(context, options.renderWidth, options.renderHeight))
+        {
+            exit(EXIT_FAILURE);
+        }
+        if (options.serverSocket.empty())
+        {
+            runHeadless(context, options);
+        }
+        else
+        {
+            runServer(context, options);
+        }
+        destroyHeadlessContext(context);
+        return EXIT_SUCCESS;
+    }
 
     // Initialise window using GLFW
-    GLFWwindow* window = initialise();
+    GLFWwindow* window = initialise(options.renderWidth, options.renderHeight);
 
     // Run an OpenGL application using this window
     runProgram(window, options);
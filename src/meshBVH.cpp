@@ -0,0 +1,456 @@
+#include "meshBVH.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_BVH_SSE2
+#include <emmintrin.h>
+#endif
+
+struct Bounds {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void grow(glm::vec3 point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(Bounds const &other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // Half the surface area, all the heuristic compares are ratios
+    float area() const {
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+};
+
+struct BuildState {
+    std::vector<Bounds> primitiveBounds;
+    std::vector<glm::vec3> centroids;
+    std::vector<unsigned int> order;
+    std::vector<BVHNode> nodes;
+};
+
+static void buildNode(BuildState& state, unsigned int first, unsigned int count, unsigned int depth) {
+    Bounds bounds, centroidBounds;
+    for (unsigned int i = first; i < first + count; i++) {
+        bounds.grow(state.primitiveBounds[state.order[i]]);
+        centroidBounds.grow(state.centroids[state.order[i]]);
+    }
+    unsigned int nodeIndex = state.nodes.size();
+    state.nodes.push_back({ bounds.min, first, bounds.max, count });
+
+    // Cheapest bucket boundary over all three axes
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    unsigned int bestSplit = 0;
+    glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    for (int axis = 0; axis < 3; axis++) {
+        if (extent[axis] <= 0.0f) {
+            continue;
+        }
+        Bounds binBounds[bvhBuildBins];
+        unsigned int binCounts[bvhBuildBins] = {};
+        float binScale = float(bvhBuildBins) / extent[axis];
+        for (unsigned int i = first; i < first + count; i++) {
+            unsigned int triangle = state.order[i];
+            unsigned int bin = std::min(unsigned((state.centroids[triangle][axis] - centroidBounds.min[axis]) * binScale), bvhBuildBins - 1);
+            binBounds[bin].grow(state.primitiveBounds[triangle]);
+            binCounts[bin]++;
+        }
+
+        // Areas and counts left of every boundary from a forward sweep, the right side from a backward one
+        float leftAreas[bvhBuildBins - 1];
+        unsigned int leftCounts[bvhBuildBins - 1];
+        Bounds left;
+        unsigned int leftCount = 0;
+        for (unsigned int split = 0; split < bvhBuildBins - 1; split++) {
+            left.grow(binBounds[split]);
+            leftCount += binCounts[split];
+            leftAreas[split] = left.area();
+            leftCounts[split] = leftCount;
+        }
+        Bounds right;
+        unsigned int rightCount = 0;
+        for (unsigned int split = bvhBuildBins - 1; split > 0; split--) {
+            right.grow(binBounds[split]);
+            rightCount += binCounts[split];
+            if (leftCounts[split - 1] == 0 || rightCount == 0) {
+                continue;
+            }
+            float cost = leftAreas[split - 1] * float(leftCounts[split - 1]) + right.area() * float(rightCount);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    // Traversing a node costs about as much as one triangle test
+    float leafCost = bounds.area() * float(count);
+    float splitCost = bounds.area() + bestCost;
+    // All centroids coincide when no axis has an extent, those triangles cannot be separated
+    if (bestAxis < 0 || depth + 1 >= bvhMaxDepth || (count <= bvhMaxLeafTriangles && leafCost <= splitCost)) {
+        return;
+    }
+
+    float binScale = float(bvhBuildBins) / extent[bestAxis];
+    auto middle = std::partition(state.order.begin() + first, state.order.begin() + first + count, [&](unsigned int triangle) {
+        unsigned int bin = std::min(unsigned((state.centroids[triangle][bestAxis] - centroidBounds.min[bestAxis]) * binScale), bvhBuildBins - 1);
+        return bin < bestSplit;
+    });
+    unsigned int leftCount = unsigned(middle - (state.order.begin() + first));
+
+    state.nodes[nodeIndex].triangleCount = 0;
+    buildNode(state, first, leftCount, depth + 1);
+    state.nodes[nodeIndex].firstOrRight = state.nodes.size();
+    buildNode(state, first + leftCount, count - leftCount, depth + 1);
+}
+
+// Fills nodes and order from the bounds and centroids in the state
+static void buildHierarchy(BuildState& state, std::vector<BVHNode>& nodes, std::vector<unsigned int>& order) {
+    unsigned int count = state.centroids.size();
+    state.order.resize(count);
+    for (unsigned int i = 0; i < count; i++) {
+        state.order[i] = i;
+    }
+    state.nodes.reserve(2 * count / bvhMaxLeafTriangles + 1);
+    if (count > 0) {
+        buildNode(state, 0, count, 0);
+    }
+    nodes = std::move(state.nodes);
+    order = std::move(state.order);
+}
+
+void buildMeshBVH(MeshBVH& bvh, std::vector<glm::vec3> const &positions, std::vector<unsigned int> const &indices) {
+    BuildState state;
+    unsigned int triangleCount = indices.size() / 3;
+    state.primitiveBounds.resize(triangleCount);
+    state.centroids.resize(triangleCount);
+    for (unsigned int triangle = 0; triangle < triangleCount; triangle++) {
+        for (unsigned int corner = 0; corner < 3; corner++) {
+            state.primitiveBounds[triangle].grow(positions[indices[triangle * 3 + corner]]);
+        }
+        state.centroids[triangle] = 0.5f * (state.primitiveBounds[triangle].min + state.primitiveBounds[triangle].max);
+    }
+    buildHierarchy(state, bvh.nodes, bvh.triangleIndices);
+
+    bvh.triangles.resize(triangleCount);
+    for (unsigned int i = 0; i < triangleCount; i++) {
+        const unsigned int* corners = &indices[bvh.triangleIndices[i] * 3];
+        BVHTriangle& triangle = bvh.triangles[i];
+        triangle.corner = positions[corners[0]];
+        triangle.edgeA = positions[corners[1]] - triangle.corner;
+        triangle.edgeB = positions[corners[2]] - triangle.corner;
+    }
+}
+
+void buildBoundsBVH(std::vector<BVHNode>& nodes, std::vector<unsigned int>& order,
+                    std::vector<glm::vec3> const &boundsMin, std::vector<glm::vec3> const &boundsMax) {
+    BuildState state;
+    state.primitiveBounds.resize(boundsMin.size());
+    state.centroids.resize(boundsMin.size());
+    for (size_t i = 0; i < boundsMin.size(); i++) {
+        state.primitiveBounds[i].min = boundsMin[i];
+        state.primitiveBounds[i].max = boundsMax[i];
+        state.centroids[i] = 0.5f * (boundsMin[i] + boundsMax[i]);
+    }
+    buildHierarchy(state, nodes, order);
+}
+
+// Axis aligned directions get a huge finite inverse instead of an infinite one, which would make
+// the slab test produce NaN for rays starting exactly on a box face
+glm::vec3 inverseRayDirection(glm::vec3 direction) {
+    glm::vec3 inverse;
+    for (int axis = 0; axis < 3; axis++) {
+        float component = std::abs(direction[axis]) > 1e-20f ? direction[axis] : std::copysign(1e-20f, direction[axis]);
+        inverse[axis] = 1.0f / component;
+    }
+    return inverse;
+}
+
+void setPacketRay(RayPacket& packet, unsigned int lane, glm::vec3 origin, glm::vec3 direction, float maxDistance) {
+    glm::vec3 inverse = inverseRayDirection(direction);
+    packet.originX[lane] = origin.x;
+    packet.originY[lane] = origin.y;
+    packet.originZ[lane] = origin.z;
+    packet.directionX[lane] = direction.x;
+    packet.directionY[lane] = direction.y;
+    packet.directionZ[lane] = direction.z;
+    packet.inverseX[lane] = inverse.x;
+    packet.inverseY[lane] = inverse.y;
+    packet.inverseZ[lane] = inverse.z;
+    packet.maxDistance[lane] = maxDistance;
+}
+
+// Slab test, true when the ray enters the box before maxDistance
+bool rayEntersBounds(BVHNode const &node, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance, float& entry) {
+    glm::vec3 near = (node.boundsMin - origin) * inverseDirection;
+    glm::vec3 far = (node.boundsMax - origin) * inverseDirection;
+    glm::vec3 entries = glm::min(near, far);
+    glm::vec3 exits = glm::max(near, far);
+    entry = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+    float exit = std::min(std::min(exits.x, exits.y), std::min(exits.z, maxDistance));
+    return entry <= exit;
+}
+
+// Moeller-Trumbore, both sides of the triangle count
+static bool hitTriangle(BVHTriangle const &triangle, glm::vec3 origin, glm::vec3 direction, float maxDistance,
+                        float& distance, float& u, float& v) {
+    glm::vec3 p = glm::cross(direction, triangle.edgeB);
+    float determinant = glm::dot(triangle.edgeA, p);
+    if (std::abs(determinant) < 1e-12f) {
+        return false;
+    }
+    float inverseDeterminant = 1.0f / determinant;
+    glm::vec3 toOrigin = origin - triangle.corner;
+    u = glm::dot(toOrigin, p) * inverseDeterminant;
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+    glm::vec3 q = glm::cross(toOrigin, triangle.edgeA);
+    v = glm::dot(direction, q) * inverseDeterminant;
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+    distance = glm::dot(triangle.edgeB, q) * inverseDeterminant;
+    return distance > 0.0f && distance < maxDistance;
+}
+
+bool meshBVHOccluded(MeshBVH const &bvh, glm::vec3 origin, glm::vec3 direction, float maxDistance) {
+    if (bvh.nodes.empty()) {
+        return false;
+    }
+    glm::vec3 inverseDirection = inverseRayDirection(direction);
+    unsigned int stack[bvhMaxDepth];
+    unsigned int stackSize = 0;
+    unsigned int nodeIndex = 0;
+    float entry, distance, u, v;
+    while (true) {
+        BVHNode const &node = bvh.nodes[nodeIndex];
+        if (rayEntersBounds(node, origin, inverseDirection, maxDistance, entry)) {
+            if (node.triangleCount == 0) {
+                stack[stackSize++] = node.firstOrRight;
+                nodeIndex++;
+                continue;
+            }
+            for (unsigned int i = node.firstOrRight; i < node.firstOrRight + node.triangleCount; i++) {
+                if (hitTriangle(bvh.triangles[i], origin, direction, maxDistance, distance, u, v)) {
+                    return true;
+                }
+            }
+        }
+        if (stackSize == 0) {
+            return false;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+}
+
+bool intersectMeshTriangles(MeshBVH const &bvh, glm::vec3 origin, glm::vec3 direction, float maxDistance, MeshHit& hit) {
+    float nearest = maxDistance;
+    bool found = false;
+    float distance, u, v;
+    for (unsigned int i = 0; i < bvh.triangles.size(); i++) {
+        if (hitTriangle(bvh.triangles[i], origin, direction, nearest, distance, u, v)) {
+            nearest = distance;
+            hit = { distance, i, u, v };
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool intersectMeshBVH(MeshBVH const &bvh, glm::vec3 origin, glm::vec3 direction, float maxDistance, MeshHit& hit) {
+    glm::vec3 inverseDirection = inverseRayDirection(direction);
+    float entry;
+    if (bvh.nodes.empty() || !rayEntersBounds(bvh.nodes[0], origin, inverseDirection, maxDistance, entry)) {
+        return false;
+    }
+
+    // Far children wait here with the distance at which the ray enters them
+    struct Pending {
+        unsigned int node;
+        float entry;
+    } stack[bvhMaxDepth];
+    unsigned int stackSize = 0;
+    unsigned int nodeIndex = 0;
+    float nearest = maxDistance;
+    bool found = false;
+    while (true) {
+        BVHNode const &node = bvh.nodes[nodeIndex];
+        if (node.triangleCount == 0) {
+            unsigned int left = nodeIndex + 1, right = node.firstOrRight;
+            float leftEntry, rightEntry;
+            bool hitsLeft = rayEntersBounds(bvh.nodes[left], origin, inverseDirection, nearest, leftEntry);
+            bool hitsRight = rayEntersBounds(bvh.nodes[right], origin, inverseDirection, nearest, rightEntry);
+            if (hitsLeft && hitsRight) {
+                bool leftFirst = leftEntry <= rightEntry;
+                stack[stackSize++] = leftFirst ? Pending{ right, rightEntry } : Pending{ left, leftEntry };
+                nodeIndex = leftFirst ? left : right;
+                continue;
+            }
+            if (hitsLeft || hitsRight) {
+                nodeIndex = hitsLeft ? left : right;
+                continue;
+            }
+        } else {
+            float distance, u, v;
+            for (unsigned int i = node.firstOrRight; i < node.firstOrRight + node.triangleCount; i++) {
+                if (hitTriangle(bvh.triangles[i], origin, direction, nearest, distance, u, v)) {
+                    nearest = distance;
+                    hit = { distance, i, u, v };
+                    found = true;
+                }
+            }
+        }
+
+        // Children entered beyond the nearest hit so far cannot hold a nearer one
+        while (stackSize > 0 && stack[stackSize - 1].entry >= nearest) {
+            stackSize--;
+        }
+        if (stackSize == 0) {
+            return found;
+        }
+        nodeIndex = stack[--stackSize].node;
+    }
+}
+
+#ifdef MESH_BVH_SSE2
+
+unsigned int packetEntersBounds(BVHNode const &node, RayPacket const &packet) {
+    __m128 nearX = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), _mm_loadu_ps(packet.originX)), _mm_loadu_ps(packet.inverseX));
+    __m128 farX = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), _mm_loadu_ps(packet.originX)), _mm_loadu_ps(packet.inverseX));
+    __m128 nearY = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), _mm_loadu_ps(packet.originY)), _mm_loadu_ps(packet.inverseY));
+    __m128 farY = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), _mm_loadu_ps(packet.originY)), _mm_loadu_ps(packet.inverseY));
+    __m128 nearZ = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), _mm_loadu_ps(packet.originZ)), _mm_loadu_ps(packet.inverseZ));
+    __m128 farZ = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), _mm_loadu_ps(packet.originZ)), _mm_loadu_ps(packet.inverseZ));
+    __m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(nearX, farX), _mm_min_ps(nearY, farY)),
+                              _mm_max_ps(_mm_min_ps(nearZ, farZ), _mm_setzero_ps()));
+    __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(nearX, farX), _mm_max_ps(nearY, farY)),
+                             _mm_min_ps(_mm_max_ps(nearZ, farZ), _mm_loadu_ps(packet.maxDistance)));
+    // Inactive lanes have an exit of zero, which an entry of zero would still pass
+    __m128 active = _mm_cmpgt_ps(_mm_loadu_ps(packet.maxDistance), _mm_setzero_ps());
+    return unsigned(_mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(entry, exit), active)));
+}
+
+// One triangle against all four rays, shrinks maxDistance of the lanes that hit it
+static unsigned int packetHitsTriangle(BVHTriangle const &triangle, unsigned int index, RayPacket& packet, MeshHit hits[4]) {
+    __m128 directionX = _mm_loadu_ps(packet.directionX);
+    __m128 directionY = _mm_loadu_ps(packet.directionY);
+    __m128 directionZ = _mm_loadu_ps(packet.directionZ);
+    __m128 edgeAX = _mm_set1_ps(triangle.edgeA.x), edgeAY = _mm_set1_ps(triangle.edgeA.y), edgeAZ = _mm_set1_ps(triangle.edgeA.z);
+    __m128 edgeBX = _mm_set1_ps(triangle.edgeB.x), edgeBY = _mm_set1_ps(triangle.edgeB.y), edgeBZ = _mm_set1_ps(triangle.edgeB.z);
+
+    // p = direction x edgeB
+    __m128 pX = _mm_sub_ps(_mm_mul_ps(directionY, edgeBZ), _mm_mul_ps(directionZ, edgeBY));
+    __m128 pY = _mm_sub_ps(_mm_mul_ps(directionZ, edgeBX), _mm_mul_ps(directionX, edgeBZ));
+    __m128 pZ = _mm_sub_ps(_mm_mul_ps(directionX, edgeBY), _mm_mul_ps(directionY, edgeBX));
+    __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeAX, pX), _mm_mul_ps(edgeAY, pY)), _mm_mul_ps(edgeAZ, pZ));
+    __m128 absoluteDeterminant = _mm_andnot_ps(_mm_set1_ps(-0.0f), determinant);
+    __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+    __m128 toOriginX = _mm_sub_ps(_mm_loadu_ps(packet.originX), _mm_set1_ps(triangle.corner.x));
+    __m128 toOriginY = _mm_sub_ps(_mm_loadu_ps(packet.originY), _mm_set1_ps(triangle.corner.y));
+    __m128 toOriginZ = _mm_sub_ps(_mm_loadu_ps(packet.originZ), _mm_set1_ps(triangle.corner.z));
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(toOriginX, pX), _mm_mul_ps(toOriginY, pY)), _mm_mul_ps(toOriginZ, pZ)),
+                          inverseDeterminant);
+
+    // q = toOrigin x edgeA
+    __m128 qX = _mm_sub_ps(_mm_mul_ps(toOriginY, edgeAZ), _mm_mul_ps(toOriginZ, edgeAY));
+    __m128 qY = _mm_sub_ps(_mm_mul_ps(toOriginZ, edgeAX), _mm_mul_ps(toOriginX, edgeAZ));
+    __m128 qZ = _mm_sub_ps(_mm_mul_ps(toOriginX, edgeAY), _mm_mul_ps(toOriginY, edgeAX));
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, qX), _mm_mul_ps(directionY, qY)), _mm_mul_ps(directionZ, qZ)),
+                          inverseDeterminant);
+    __m128 distance = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeBX, qX), _mm_mul_ps(edgeBY, qY)), _mm_mul_ps(edgeBZ, qZ)),
+                                 inverseDeterminant);
+
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    __m128 valid = _mm_cmpge_ps(absoluteDeterminant, _mm_set1_ps(1e-12f));
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(distance, zero), _mm_cmplt_ps(distance, _mm_loadu_ps(packet.maxDistance))));
+    unsigned int mask = unsigned(_mm_movemask_ps(valid));
+    if (mask == 0) {
+        return 0;
+    }
+
+    float distances[4], us[4], vs[4];
+    _mm_storeu_ps(distances, distance);
+    _mm_storeu_ps(us, u);
+    _mm_storeu_ps(vs, v);
+    for (unsigned int lane = 0; lane < 4; lane++) {
+        if (mask & (1u << lane)) {
+            packet.maxDistance[lane] = distances[lane];
+            hits[lane] = { distances[lane], index, us[lane], vs[lane] };
+        }
+    }
+    return mask;
+}
+
+#else
+
+unsigned int packetEntersBounds(BVHNode const &node, RayPacket const &packet) {
+    unsigned int mask = 0;
+    float entry;
+    for (unsigned int lane = 0; lane < 4; lane++) {
+        glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+        glm::vec3 inverseDirection(packet.inverseX[lane], packet.inverseY[lane], packet.inverseZ[lane]);
+        if (packet.maxDistance[lane] > 0.0f && rayEntersBounds(node, origin, inverseDirection, packet.maxDistance[lane], entry)) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+static unsigned int packetHitsTriangle(BVHTriangle const &triangle, unsigned int index, RayPacket& packet, MeshHit hits[4]) {
+    unsigned int mask = 0;
+    float distance, u, v;
+    for (unsigned int lane = 0; lane < 4; lane++) {
+        glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+        glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+        if (hitTriangle(triangle, origin, direction, packet.maxDistance[lane], distance, u, v)) {
+            packet.maxDistance[lane] = distance;
+            hits[lane] = { distance, index, u, v };
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+#endif
+
+// A node is entered while any ray of the packet enters it. Children are not ordered, which
+// would only pay off for packets that agree on a direction.
+unsigned int intersectMeshBVHPacket(MeshBVH const &bvh, RayPacket& packet, MeshHit hits[4]) {
+    if (bvh.nodes.empty()) {
+        return 0;
+    }
+    unsigned int stack[bvhMaxDepth];
+    unsigned int stackSize = 0;
+    unsigned int nodeIndex = 0;
+    unsigned int hitLanes = 0;
+    while (true) {
+        BVHNode const &node = bvh.nodes[nodeIndex];
+        if (packetEntersBounds(node, packet)) {
+            if (node.triangleCount == 0) {
+                stack[stackSize++] = node.firstOrRight;
+                nodeIndex++;
+                continue;
+            }
+            for (unsigned int i = node.firstOrRight; i < node.firstOrRight + node.triangleCount; i++) {
+                hitLanes |= packetHitsTriangle(bvh.triangles[i], i, packet, hits);
+            }
+        }
+        if (stackSize == 0) {
+            return hitLanes;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Splits are chosen among this many buckets per axis with the surface area heuristic
+const unsigned int bvhBuildBins = 12;
+// Leaves hold at most this many triangles, fewer when a split is cheaper. Only triangles with
+// coincident centroids, or nodes at bvhMaxDepth, end up in larger leaves since they cannot be split.
+const unsigned int bvhMaxLeafTriangles = 8;
+// Deeper nodes become leaves regardless, which bounds the traversal stack
+const unsigned int bvhMaxDepth = 64;
+
+// 32 bytes, two to a cache line. Nodes are stored depth first, so an inner node's left child
+// directly follows it and only the right child needs an index.
+struct BVHNode {
+    glm::vec3 boundsMin;
+    unsigned int firstOrRight;   // first triangle of a leaf, right child of an inner node
+    glm::vec3 boundsMax;
+    unsigned int triangleCount;  // 0 for inner nodes
+};
+
+// Triangles in leaf order with the edges the intersection test needs precomputed
+struct BVHTriangle {
+    glm::vec3 corner;
+    glm::vec3 edgeA;
+    glm::vec3 edgeB;
+};
+
+// Triangle bounding volume hierarchy of one mesh, in the mesh's own coordinates
+struct MeshBVH {
+    std::vector<BVHNode> nodes;
+    std::vector<BVHTriangle> triangles;
+    std::vector<unsigned int> triangleIndices;  // the mesh's triangle number of every leaf triangle
+};
+
+// Nearest hit of a ray, u and v weigh the triangle's second and third corner
+struct MeshHit {
+    float distance;         // in units of the direction's length
+    unsigned int triangle;  // into triangles, triangleIndices has the mesh's triangle number
+    float u;
+    float v;
+};
+
+// Four rays in structure of arrays layout, traversed together and tested with SSE2 where the
+// compiler has it. Lanes with a maxDistance of zero are inactive. maxDistance shrinks to every
+// hit found, so a packet passed through several meshes in turn ends with the nearest hits.
+struct RayPacket {
+    float originX[4], originY[4], originZ[4];
+    float directionX[4], directionY[4], directionZ[4];
+    float inverseX[4], inverseY[4], inverseZ[4];
+    float maxDistance[4];
+};
+
+void buildMeshBVH(MeshBVH& bvh, std::vector<glm::vec3> const &positions, std::vector<unsigned int> const &indices);
+
+// The same build over arbitrary boxes, for hierarchies over something other than triangles.
+// Leaves refer to the boxes through order.
+void buildBoundsBVH(std::vector<BVHNode>& nodes, std::vector<unsigned int>& order,
+                    std::vector<glm::vec3> const &boundsMin, std::vector<glm::vec3> const &boundsMax);
+
+// Whether anything is hit closer than maxDistance, which stops at the first hit
+bool meshBVHOccluded(MeshBVH const &bvh, glm::vec3 origin, glm::vec3 direction, float maxDistance);
+
+// Nearest hit closer than maxDistance, children are visited front to back
+bool intersectMeshBVH(MeshBVH const &bvh, glm::vec3 origin, glm::vec3 direction, float maxDistance, MeshHit& hit);
+
+// Nearest hit by testing every triangle, the reference the traversals are checked against
+bool intersectMeshTriangles(MeshBVH const &bvh, glm::vec3 origin, glm::vec3 direction, float maxDistance, MeshHit& hit);
+
+// Nearest hits of a packet, lanes that found a closer hit get it in hits. Returns those lanes as a bit mask.
+unsigned int intersectMeshBVHPacket(MeshBVH const &bvh, RayPacket& packet, MeshHit hits[4]);
+
+// Building blocks of traversals over hierarchies built elsewhere
+glm::vec3 inverseRayDirection(glm::vec3 direction);
+void setPacketRay(RayPacket& packet, unsigned int lane, glm::vec3 origin, glm::vec3 direction, float maxDistance);
+bool rayEntersBounds(BVHNode const &node, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance, float& entry);
+unsigned int packetEntersBounds(BVHNode const &node, RayPacket const &packet);  // bit mask of lanes
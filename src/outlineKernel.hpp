@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cmath>
+
+// The interior edge kernel of outline.frag. initOutlines compiles the spacing, jitter and Sobel
+// kernels into the shader from here, and the CPU ports in softwareRaster.cpp and postKernels.cpp
+// read the same values, so the three stay in step.
+
+// Sample spacing in texture coordinates
+const float outlineKernelOffset = 1.0f / 800.0f;
+
+// Normal samples are jittered by up to this much, from value noise with this many cells across the screen
+const float outlineJitter = 0.003f;
+const float outlineNoiseScale = 10.0f;
+
+const float outlineKernelX[9] = {
+    1.0f, 0.0f, -1.0f,
+    2.0f, 0.0f, -2.0f,
+    1.0f, 0.0f, -1.0f
+};
+
+const float outlineKernelY[9] = {
+     1.0f,  2.0f,  1.0f,
+     0.0f,  0.0f,  0.0f,
+    -1.0f, -2.0f, -1.0f
+};
+
+// hash() in outline.frag, the noise value at a lattice point
+inline float outlineNoiseHash(float x, float y) {
+    float value = std::sin(x * 127.1f + y * 311.7f) * 43758.5453f;
+    return value - std::floor(value);
+}
+
+// Smoothstep interpolation of the four lattice values around a point, noise() in outline.frag
+inline float outlineNoiseBlend(float a, float b, float c, float d, float fractionX, float fractionY) {
+    float smoothX = fractionX * fractionX * (3.0f - 2.0f * fractionX);
+    float smoothY = fractionY * fractionY * (3.0f - 2.0f * fractionY);
+    return a * (1.0f - smoothX) + b * smoothX + (c - a) * smoothY * (1.0f - smoothX) + (d - b) * smoothX * smoothY;
+}
+
+inline float outlineNoise(float x, float y) {
+    float cellX = std::floor(x), cellY = std::floor(y);
+    return outlineNoiseBlend(outlineNoiseHash(cellX, cellY), outlineNoiseHash(cellX + 1.0f, cellY),
+                             outlineNoiseHash(cellX, cellY + 1.0f), outlineNoiseHash(cellX + 1.0f, cellY + 1.0f),
+                             x - cellX, y - cellY);
+}
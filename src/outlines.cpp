@@ -0,0 +1,82 @@
+#include "outlines.hpp"
+#include "outlineKernel.hpp"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+// GLSL float literal, the decimal point kept so it never reads as an int
+static std::string glslFloat(float value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%#.9g", value);
+    return text;
+}
+
+static std::string glslFloats(const float (&values)[9]) {
+    std::string array = "float[](";
+    for (int i = 0; i < 9; i++) {
+        array += (i == 0 ? "" : ", ") + glslFloat(values[i]);
+    }
+    return array + ")";
+}
+
+void initOutlines(Outlines& outlines, float widthNear, float widthFar, float edgeThreshold, float depthEdgeScale) {
+    outlines.widthNear = widthNear;
+    outlines.widthFar = widthFar;
+
+    outlines.edgeShader = new Gloom::Shader();
+    outlines.edgeShader->define("OUTLINE_KERNEL_OFFSET", glslFloat(outlineKernelOffset));
+    outlines.edgeShader->define("OUTLINE_JITTER", glslFloat(outlineJitter));
+    outlines.edgeShader->define("OUTLINE_NOISE_SCALE", glslFloat(outlineNoiseScale));
+    outlines.edgeShader->define("OUTLINE_KERNEL_X", glslFloats(outlineKernelX));
+    outlines.edgeShader->define("OUTLINE_KERNEL_Y", glslFloats(outlineKernelY));
+    outlines.edgeShader->makeBasicShader("../res/shaders/framebuffer.vert", "../res/shaders/outline.frag");
+    outlines.edgeShader->activate();
+    glUniform1i(outlines.edgeShader->getUniformFromName("normalTexture"), 1);
+    glUniform1i(outlines.edgeShader->getUniformFromName("depthTexture"), 2);
+    glUniform1i(outlines.edgeShader->getUniformFromName("objectIDTexture"), 3);
+    glUniform1f(outlines.edgeShader->getUniformFromName("edge_threshold"), edgeThreshold);
+    glUniform1f(outlines.edgeShader->getUniformFromName("depth_edge_scale"), depthEdgeScale);
+
+    outlines.jumpFloodShader = new Gloom::Shader();
+    outlines.jumpFloodShader->makeBasicShader("../res/shaders/framebuffer.vert", "../res/shaders/jumpflood.frag");
+    outlines.jumpFloodShader->activate();
+    glUniform1i(outlines.jumpFloodShader->getUniformFromName("seedTexture"), outlineSeedTextureUnit);
+}
+
+// Runs edge detection and the jump flood, returns which of the two seed textures holds the nearest seed of every pixel
+unsigned int renderOutlines(Outlines& outlines, unsigned int quadVAO,
+                            unsigned int normalTexture, unsigned int depthTexture, unsigned int objectIDTexture,
+                            const unsigned int seedFramebuffers[2], const unsigned int seedTextures[2]) {
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(quadVAO);
+
+    // Seed pass, edge pixels store their own coordinate
+    glBindFramebuffer(GL_FRAMEBUFFER, seedFramebuffers[0]);
+    outlines.edgeShader->activate();
+    glBindTextureUnit(1, normalTexture);
+    glBindTextureUnit(2, depthTexture);
+    glBindTextureUnit(3, objectIDTexture);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    // Seeds further away than the widest line never ink anything, so the
+    // flood only has to start at half the next power of two above it
+    float maxWidth = std::max(outlines.widthNear, outlines.widthFar);
+    int stepSize = 1;
+    while (float(stepSize) < maxWidth) {
+        stepSize *= 2;
+    }
+    stepSize /= 2;
+
+    unsigned int current = 0;
+    outlines.jumpFloodShader->activate();
+    for (; stepSize >= 1; stepSize /= 2) {
+        glBindFramebuffer(GL_FRAMEBUFFER, seedFramebuffers[1 - current]);
+        glBindTextureUnit(outlineSeedTextureUnit, seedTextures[current]);
+        glUniform1i(outlines.jumpFloodShader->getUniformFromName("step_size"), stepSize);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        current = 1 - current;
+    }
+
+    return current;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <utilities/shader.hpp>
+
+// Texture unit framebuffer.frag reads the nearest edge pixel from
+const unsigned int outlineSeedTextureUnit = 4;
+
+// Variable width ink lines. Edge pixels are detected once and written as seeds,
+// then a jump flood spreads the position of the nearest seed to every pixel in
+// log2(width) full-screen passes. The composite inks every pixel closer to its
+// nearest edge than the line width, so the cost does not grow with the width.
+// The ping-pong seed targets are passed in, each texel holds the pixel coordinate of the nearest edge.
+struct Outlines {
+    Gloom::Shader* edgeShader;
+    Gloom::Shader* jumpFloodShader;
+
+    // Line width in pixels at linear depth 0 and 1; 1 gives plain one pixel edges
+    float widthNear;
+    float widthFar;
+};
+
+// Interior edges are pixels whose normal or depth Sobel response exceeds edgeThreshold, depth
+// differences are scaled by depthEdgeScale first
+void initOutlines(Outlines& outlines, float widthNear, float widthFar, float edgeThreshold, float depthEdgeScale);
+unsigned int renderOutlines(Outlines& outlines, unsigned int quadVAO,
+                            unsigned int normalTexture, unsigned int depthTexture, unsigned int objectIDTexture,
+                            const unsigned int seedFramebuffers[2], const unsigned int seedTextures[2]);
@@ -0,0 +1,423 @@
+#include "postKernels.hpp"
+#include "outlineKernel.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <utilities/workerPool.hpp>
+
+// GCC and Clang compile single functions for AVX2, the processor is checked when they run
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define POST_KERNELS_AVX2
+#include <immintrin.h>
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+
+// The normals are sampled with a jitter from value noise, outlineNoiseScale cells across the screen each way
+static const int noiseLattice = 11;
+
+// Per image constants of the edge kernel
+struct EdgeKernel {
+    float offsetU[9];
+    float offsetV[9];
+    ptrdiff_t depthOffset[9];     // the unjittered depth samples land on whole pixels
+    ptrdiff_t neighbourOffset[8];
+    float noise[noiseLattice * noiseLattice];
+};
+
+struct SeedOffset {
+    ptrdiff_t offset;
+    float distance;
+};
+
+static float mix(float a, float b, float t) {
+    return a * (1.0f - t) + b * t;
+}
+
+static EdgeKernel edgeKernel(PostImage const &image) {
+    EdgeKernel kernel;
+    for (int i = 0; i < 9; i++) {
+        int column = i % 3 - 1, row = 1 - i / 3;
+        kernel.offsetU[i] = float(column) * outlineKernelOffset;
+        kernel.offsetV[i] = float(row) * outlineKernelOffset;
+        // floor(x + 0.5 + offset * width) - x, the pixel a nearest sample of the offset position hits
+        int pixelX = int(std::floor(0.5f + float(column) * outlineKernelOffset * float(image.width)));
+        int pixelY = int(std::floor(0.5f + float(row) * outlineKernelOffset * float(image.height)));
+        kernel.depthOffset[i] = ptrdiff_t(pixelY) * image.stride + pixelX;
+    }
+    int neighbour = 0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            if (x != 0 || y != 0) {
+                kernel.neighbourOffset[neighbour++] = ptrdiff_t(y) * image.stride + x;
+            }
+        }
+    }
+    for (int y = 0; y < noiseLattice; y++) {
+        for (int x = 0; x < noiseLattice; x++) {
+            kernel.noise[y * noiseLattice + x] = outlineNoiseHash(float(x), float(y));
+        }
+    }
+    return kernel;
+}
+
+static int depthPadding(PostImage const &image) {
+    return int(std::floor(0.5f + outlineKernelOffset * float(std::max(image.width, image.height)))) + 1;
+}
+
+// Nearest edges in order of distance, as far as the widest line reaches
+static std::vector<SeedOffset> seedOffsets(PostImage const &image, OutlineSettings const &settings) {
+    int radius = int(std::ceil(std::max(settings.widthNear, settings.widthFar)));
+    std::vector<SeedOffset> offsets;
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            if (x * x + y * y <= radius * radius) {
+                offsets.push_back({ ptrdiff_t(y) * image.stride + x, std::sqrt(float(x * x + y * y)) });
+            }
+        }
+    }
+    std::stable_sort(offsets.begin(), offsets.end(), [](SeedOffset const &a, SeedOffset const &b) {
+        return a.distance < b.distance;
+    });
+    return offsets;
+}
+
+void decodePostImage(PostImage& image, GBufferFile const &gbuffer, OutlineSettings const &settings, WorkerPool& workers) {
+    image.width = gbuffer.width;
+    image.height = gbuffer.height;
+    int radius = int(std::ceil(std::max(settings.widthNear, settings.widthFar)));
+    image.padding = std::max(depthPadding(image), radius);
+    image.stride = image.width + 2 * image.padding;
+    size_t paddedPixels = size_t(image.stride) * (image.height + 2 * image.padding);
+    image.normalX.resize(paddedPixels);
+    image.normalY.resize(paddedPixels);
+    image.normalZ.resize(paddedPixels);
+    image.linearDepth.resize(paddedPixels);
+    image.objectIDs.resize(paddedPixels);
+    image.seeds.assign(paddedPixels, 0);
+    image.color = gbuffer.color;
+
+    parallelFor(workers, image.height + 2 * image.padding, [&](unsigned int row) {
+        int y = glm::clamp(int(row) - image.padding, 0, image.height - 1);
+        for (int column = 0; column < image.stride; column++) {
+            int x = glm::clamp(column - image.padding, 0, image.width - 1);
+            size_t source = size_t(y) * image.width + x;
+            size_t target = size_t(row) * image.stride + column;
+            glm::vec3 normal = decodeOctahedral(gbuffer.normals[source * 2], gbuffer.normals[source * 2 + 1]);
+            image.normalX[target] = normal.x;
+            image.normalY[target] = normal.y;
+            image.normalZ[target] = normal.z;
+            image.linearDepth[target] = halfToFloat(gbuffer.linearDepth[source]);
+            image.objectIDs[target] = gbuffer.objectIDs[source];
+        }
+    });
+}
+
+static float noiseAt(EdgeKernel const &kernel, float x, float y) {
+    float cellX = std::floor(x), cellY = std::floor(y);
+    float fractionX = x - cellX, fractionY = y - cellY;
+    int index = int(cellY) * noiseLattice + int(cellX);
+    float a = kernel.noise[index], b = kernel.noise[index + 1];
+    float c = kernel.noise[index + noiseLattice], d = kernel.noise[index + noiseLattice + 1];
+    return outlineNoiseBlend(a, b, c, d, fractionX, fractionY);
+}
+
+// One pixel of outline.frag
+static bool isEdge(PostImage const &image, OutlineSettings const &settings, EdgeKernel const &kernel, int x, int y) {
+    size_t center = size_t(y + image.padding) * image.stride + x + image.padding;
+    int centerID = image.objectIDs[center];
+    for (ptrdiff_t offset : kernel.neighbourOffset) {
+        if (image.objectIDs[center + offset] != centerID) {
+            return true;
+        }
+    }
+    if (centerID == 0) {
+        return false;
+    }
+
+    float u = (float(x) + 0.5f) / float(image.width), v = (float(y) + 0.5f) / float(image.height);
+    float jitter = outlineJitter * noiseAt(kernel, u * outlineNoiseScale, v * outlineNoiseScale);
+    float centerX = image.normalX[center], centerY = image.normalY[center], centerZ = image.normalZ[center];
+    float centerDepth = image.linearDepth[center];
+    float gx = 0.0f, gy = 0.0f, depthGx = 0.0f, depthGy = 0.0f;
+    for (int i = 0; i < 9; i++) {
+        if (i == 4) {
+            continue;
+        }
+        int sampleX = glm::clamp(int(std::floor((u + jitter + kernel.offsetU[i]) * float(image.width))), 0, image.width - 1);
+        int sampleY = glm::clamp(int(std::floor((v + jitter + kernel.offsetV[i]) * float(image.height))), 0, image.height - 1);
+        size_t sample = size_t(sampleY + image.padding) * image.stride + sampleX + image.padding;
+        float normalDifference = 1.0f - (centerX * image.normalX[sample] + centerY * image.normalY[sample] + centerZ * image.normalZ[sample]);
+        float depthDifference = std::abs(centerDepth - image.linearDepth[center + kernel.depthOffset[i]]) * settings.depthEdgeScale;
+        if (outlineKernelX[i] != 0.0f) {
+            gx += normalDifference * outlineKernelX[i];
+            depthGx += depthDifference * outlineKernelX[i];
+        }
+        if (outlineKernelY[i] != 0.0f) {
+            gy += normalDifference * outlineKernelY[i];
+            depthGy += depthDifference * outlineKernelY[i];
+        }
+    }
+    return std::max(std::sqrt(gx * gx + gy * gy), std::sqrt(depthGx * depthGx + depthGy * depthGy)) > settings.edgeThreshold;
+}
+
+// One pixel of framebuffer.frag, how much ink covers it
+static float inkAt(PostImage const &image, OutlineSettings const &settings, std::vector<SeedOffset> const &offsets, int x, int y) {
+    size_t center = size_t(y + image.padding) * image.stride + x + image.padding;
+    for (SeedOffset const &seed : offsets) {
+        if (image.seeds[center + seed.offset]) {
+            float seedDepth = glm::clamp(image.linearDepth[center + seed.offset], 0.0f, 1.0f);
+            float width = mix(settings.widthNear, settings.widthFar, seedDepth);
+            float t = glm::clamp(seed.distance - (width - 1.0f), 0.0f, 1.0f);
+            return 1.0f - t * t * (3.0f - 2.0f * t);
+        }
+    }
+    return 0.0f;
+}
+
+#ifdef POST_KERNELS_AVX2
+
+AVX2_FUNCTION static __m256 floorAVX2(__m256 value) {
+    return _mm256_round_ps(value, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+
+// Eight pixels of a row at a time, the remainder goes through isEdge. The arithmetic is done in
+// the same order as there, so both give the same edges.
+AVX2_FUNCTION static void detectRowAVX2(PostImage& image, OutlineSettings const &settings, EdgeKernel const &kernel, int y) {
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 width = _mm256_set1_ps(float(image.width));
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 three = _mm256_set1_ps(3.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 absoluteMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maxX = _mm256_set1_epi32(image.width - 1);
+    const __m256i maxY = _mm256_set1_epi32(image.height - 1);
+    const __m256i padding = _mm256_set1_epi32(image.padding);
+    const __m256i stride = _mm256_set1_epi32(image.stride);
+
+    // The row's share of the noise is the same for every group
+    float v = (float(y) + 0.5f) / float(image.height);
+    float noiseY = v * outlineNoiseScale;
+    float cellY = std::floor(noiseY);
+    float fractionY = noiseY - cellY;
+    const __m256 smoothY = _mm256_set1_ps(fractionY * fractionY * (3.0f - 2.0f * fractionY));
+    const __m256i noiseRow = _mm256_set1_epi32(int(cellY) * noiseLattice);
+    const __m256 vs = _mm256_set1_ps(v);
+
+    int x = 0;
+    for (; x + 8 <= image.width; x += 8) {
+        size_t center = size_t(y + image.padding) * image.stride + x + image.padding;
+        __m256i centerID = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&image.objectIDs[center]));
+        __m256i same = _mm256_cmpeq_epi32(centerID, centerID);
+        for (ptrdiff_t offset : kernel.neighbourOffset) {
+            __m256i neighbour = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&image.objectIDs[center + offset]));
+            same = _mm256_and_si256(same, _mm256_cmpeq_epi32(neighbour, centerID));
+        }
+        int silhouette = ~_mm256_movemask_ps(_mm256_castsi256_ps(same)) & 0xFF;
+        int interior = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(centerID, zero))) & ~silhouette & 0xFF;
+
+        int edges = silhouette;
+        if (interior) {
+            __m256 u = _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(float(x)), lanes), _mm256_set1_ps(0.5f)), width);
+            __m256 noiseX = _mm256_mul_ps(u, _mm256_set1_ps(outlineNoiseScale));
+            __m256 cellX = floorAVX2(noiseX);
+            __m256 fractionX = _mm256_sub_ps(noiseX, cellX);
+            __m256i index = _mm256_add_epi32(noiseRow, _mm256_cvttps_epi32(cellX));
+            __m256 a = _mm256_i32gather_ps(kernel.noise, index, 4);
+            __m256 b = _mm256_i32gather_ps(kernel.noise + 1, index, 4);
+            __m256 c = _mm256_i32gather_ps(kernel.noise + noiseLattice, index, 4);
+            __m256 d = _mm256_i32gather_ps(kernel.noise + noiseLattice + 1, index, 4);
+            __m256 smoothX = _mm256_mul_ps(_mm256_mul_ps(fractionX, fractionX), _mm256_sub_ps(three, _mm256_mul_ps(two, fractionX)));
+            __m256 inverseX = _mm256_sub_ps(one, smoothX);
+            __m256 noise = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, inverseX), _mm256_mul_ps(b, smoothX)),
+                                                       _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(c, a), smoothY), inverseX)),
+                                         _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(d, b), smoothX), smoothY));
+            __m256 jitter = _mm256_mul_ps(_mm256_set1_ps(outlineJitter), noise);
+            __m256 ju = _mm256_add_ps(u, jitter), jv = _mm256_add_ps(vs, jitter);
+
+            __m256 centerX = _mm256_loadu_ps(&image.normalX[center]);
+            __m256 centerY = _mm256_loadu_ps(&image.normalY[center]);
+            __m256 centerZ = _mm256_loadu_ps(&image.normalZ[center]);
+            __m256 centerDepth = _mm256_loadu_ps(&image.linearDepth[center]);
+            __m256 depthScale = _mm256_set1_ps(settings.depthEdgeScale);
+            __m256 gx = _mm256_setzero_ps(), gy = _mm256_setzero_ps();
+            __m256 depthGx = _mm256_setzero_ps(), depthGy = _mm256_setzero_ps();
+            for (int i = 0; i < 9; i++) {
+                if (i == 4) {
+                    continue;
+                }
+                __m256i sampleX = _mm256_cvttps_epi32(floorAVX2(_mm256_mul_ps(_mm256_add_ps(ju, _mm256_set1_ps(kernel.offsetU[i])), width)));
+                __m256i sampleY = _mm256_cvttps_epi32(floorAVX2(_mm256_mul_ps(_mm256_add_ps(jv, _mm256_set1_ps(kernel.offsetV[i])),
+                                                                               _mm256_set1_ps(float(image.height)))));
+                sampleX = _mm256_min_epi32(_mm256_max_epi32(sampleX, zero), maxX);
+                sampleY = _mm256_min_epi32(_mm256_max_epi32(sampleY, zero), maxY);
+                __m256i sample = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(sampleY, padding), stride),
+                                                  _mm256_add_epi32(sampleX, padding));
+                __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(centerX, _mm256_i32gather_ps(image.normalX.data(), sample, 4)),
+                                                         _mm256_mul_ps(centerY, _mm256_i32gather_ps(image.normalY.data(), sample, 4))),
+                                           _mm256_mul_ps(centerZ, _mm256_i32gather_ps(image.normalZ.data(), sample, 4)));
+                __m256 normalDifference = _mm256_sub_ps(one, dot);
+                __m256 depthSample = _mm256_loadu_ps(&image.linearDepth[center + kernel.depthOffset[i]]);
+                __m256 depthDifference = _mm256_mul_ps(_mm256_and_ps(_mm256_sub_ps(centerDepth, depthSample), absoluteMask), depthScale);
+                if (outlineKernelX[i] != 0.0f) {
+                    gx = _mm256_add_ps(gx, _mm256_mul_ps(normalDifference, _mm256_set1_ps(outlineKernelX[i])));
+                    depthGx = _mm256_add_ps(depthGx, _mm256_mul_ps(depthDifference, _mm256_set1_ps(outlineKernelX[i])));
+                }
+                if (outlineKernelY[i] != 0.0f) {
+                    gy = _mm256_add_ps(gy, _mm256_mul_ps(normalDifference, _mm256_set1_ps(outlineKernelY[i])));
+                    depthGy = _mm256_add_ps(depthGy, _mm256_mul_ps(depthDifference, _mm256_set1_ps(outlineKernelY[i])));
+                }
+            }
+            __m256 normalStrength = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx), _mm256_mul_ps(gy, gy)));
+            __m256 depthStrength = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(depthGx, depthGx), _mm256_mul_ps(depthGy, depthGy)));
+            __m256 strong = _mm256_cmp_ps(_mm256_max_ps(normalStrength, depthStrength), _mm256_set1_ps(settings.edgeThreshold), _CMP_GT_OQ);
+            edges |= _mm256_movemask_ps(strong) & interior;
+        }
+        for (int lane = 0; lane < 8; lane++) {
+            image.seeds[center + lane] = (edges >> lane) & 1;
+        }
+    }
+    for (; x < image.width; x++) {
+        image.seeds[size_t(y + image.padding) * image.stride + x + image.padding] = isEdge(image, settings, kernel, x, y);
+    }
+}
+
+AVX2_FUNCTION static void compositeRowAVX2(PostImage const &image, OutlineSettings const &settings,
+                                           std::vector<SeedOffset> const &offsets, unsigned char* rgba, int y) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 widthNear = _mm256_set1_ps(settings.widthNear);
+    const __m256 widthFar = _mm256_set1_ps(settings.widthFar);
+    int x = 0;
+    for (; x + 8 <= image.width; x += 8) {
+        size_t center = size_t(y + image.padding) * image.stride + x + image.padding;
+        __m256 found = _mm256_setzero_ps(), distance = _mm256_setzero_ps(), seedDepth = _mm256_setzero_ps();
+        for (SeedOffset const &seed : offsets) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&image.seeds[center + seed.offset]));
+            __m256 hit = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(bytes), _mm256_setzero_si256()));
+            __m256 fresh = _mm256_andnot_ps(found, hit);
+            distance = _mm256_blendv_ps(distance, _mm256_set1_ps(seed.distance), fresh);
+            seedDepth = _mm256_blendv_ps(seedDepth, _mm256_loadu_ps(&image.linearDepth[center + seed.offset]), fresh);
+            found = _mm256_or_ps(found, hit);
+            if (_mm256_movemask_ps(found) == 0xFF) {
+                break;
+            }
+        }
+        float ink[8] = {};
+        if (_mm256_movemask_ps(found)) {
+            __m256 depth = _mm256_min_ps(_mm256_max_ps(seedDepth, _mm256_setzero_ps()), one);
+            __m256 width = _mm256_add_ps(_mm256_mul_ps(widthNear, _mm256_sub_ps(one, depth)), _mm256_mul_ps(widthFar, depth));
+            __m256 t = _mm256_sub_ps(distance, _mm256_sub_ps(width, one));
+            t = _mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), one);
+            __m256 smooth = _mm256_mul_ps(_mm256_mul_ps(t, t), _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), t)));
+            _mm256_storeu_ps(ink, _mm256_and_ps(_mm256_sub_ps(one, smooth), found));
+        }
+        for (int lane = 0; lane < 8; lane++) {
+            size_t pixel = size_t(y) * image.width + x + lane;
+            for (int channel = 0; channel < 3; channel++) {
+                rgba[pixel * 4 + channel] = (unsigned char) (float(image.color[pixel * 3 + channel]) * (1.0f - ink[lane]) + 0.5f);
+            }
+            rgba[pixel * 4 + 3] = 255;
+        }
+    }
+    for (; x < image.width; x++) {
+        size_t pixel = size_t(y) * image.width + x;
+        float ink = inkAt(image, settings, offsets, x, y);
+        for (int channel = 0; channel < 3; channel++) {
+            rgba[pixel * 4 + channel] = (unsigned char) (float(image.color[pixel * 3 + channel]) * (1.0f - ink) + 0.5f);
+        }
+        rgba[pixel * 4 + 3] = 255;
+    }
+}
+
+#endif
+
+bool postKernelsUseAVX2() {
+#ifdef POST_KERNELS_AVX2
+    static bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+void detectOutlineEdges(PostImage& image, OutlineSettings const &settings, WorkerPool& workers) {
+    EdgeKernel kernel = edgeKernel(image);
+    bool avx2 = postKernelsUseAVX2();
+    parallelFor(workers, image.height, [&](unsigned int y) {
+#ifdef POST_KERNELS_AVX2
+        if (avx2) {
+            detectRowAVX2(image, settings, kernel, y);
+            return;
+        }
+#endif
+        for (int x = 0; x < image.width; x++) {
+            image.seeds[size_t(y + image.padding) * image.stride + x + image.padding] = isEdge(image, settings, kernel, x, y);
+        }
+    });
+    (void) avx2;
+}
+
+void compositeOutlines(PostImage const &image, OutlineSettings const &settings, std::vector<unsigned char>& rgba, WorkerPool& workers) {
+    std::vector<SeedOffset> offsets = seedOffsets(image, settings);
+    rgba.resize(size_t(image.width) * image.height * 4);
+    bool avx2 = postKernelsUseAVX2();
+    parallelFor(workers, image.height, [&](unsigned int y) {
+#ifdef POST_KERNELS_AVX2
+        if (avx2) {
+            compositeRowAVX2(image, settings, offsets, rgba.data(), y);
+            return;
+        }
+#endif
+        for (int x = 0; x < image.width; x++) {
+            size_t pixel = size_t(y) * image.width + x;
+            float ink = inkAt(image, settings, offsets, x, y);
+            for (int channel = 0; channel < 3; channel++) {
+                rgba[pixel * 4 + channel] = (unsigned char) (float(image.color[pixel * 3 + channel]) * (1.0f - ink) + 0.5f);
+            }
+            rgba[pixel * 4 + 3] = 255;
+        }
+    });
+    (void) avx2;
+}
+
+bool regradeGBuffer(std::string const &inputPath, std::string const &outputPath, FrameOutputFormat format, OutlineSettings const &settings) {
+    GBufferFile gbuffer;
+    if (!readGBufferFile(inputPath, gbuffer)) {
+        return false;
+    }
+    WorkerPool workers;
+    initWorkerPool(workers, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    PostImage image;
+    decodePostImage(image, gbuffer, settings, workers);
+    auto decoded = std::chrono::steady_clock::now();
+    detectOutlineEdges(image, settings, workers);
+    auto detected = std::chrono::steady_clock::now();
+    std::vector<unsigned char> rgba;
+    compositeOutlines(image, settings, rgba, workers);
+    auto composited = std::chrono::steady_clock::now();
+
+    std::vector<unsigned char> encoded = encodeFrame(format, rgba.data(), image.width, image.height);
+    FILE* file = openOutputStream(outputPath);
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        std::cerr << "Could not write " << outputPath << std::endl;
+        return false;
+    }
+
+    auto milliseconds = [](std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    };
+    printf("Regraded %dx%d with %s on %u threads: decode %.2f ms, edges %.2f ms, composite %.2f ms\n",
+           image.width, image.height, postKernelsUseAVX2() ? "AVX2" : "scalar code", workers.threadCount,
+           milliseconds(start, decoded), milliseconds(decoded, detected), milliseconds(detected, composited));
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <utilities/workerPool.hpp>
+#include <vector>
+
+#include "frameOutput.hpp"
+#include "gbufferFile.hpp"
+
+// The outline pass settings a regrade can change
+struct OutlineSettings {
+    float widthNear;
+    float widthFar;
+    float edgeThreshold;
+    float depthEdgeScale;
+};
+
+// An exported G-buffer decoded to float planes. The planes are padded on every side by
+// repeating the border, which is the clamping of the GL samplers, so neighbours are plain
+// loads eight pixels at a time.
+struct PostImage {
+    int width;
+    int height;
+    int padding;
+    int stride;
+    std::vector<float> normalX;
+    std::vector<float> normalY;
+    std::vector<float> normalZ;
+    std::vector<float> linearDepth;
+    std::vector<int> objectIDs;
+    std::vector<unsigned char> seeds;  // 1 on edge pixels, 0 in the padding
+    std::vector<unsigned char> color;  // RGB, not padded
+};
+
+// Edge detection of outline.frag and the composite of framebuffer.frag on the CPU, with AVX2
+// where the processor has it and over all cores. The composite searches the nearest edge
+// exactly instead of with a jump flood. FXAA is not applied.
+void decodePostImage(PostImage& image, GBufferFile const &gbuffer, OutlineSettings const &settings, WorkerPool& workers);
+void detectOutlineEdges(PostImage& image, OutlineSettings const &settings, WorkerPool& workers);
+// RGBA with the bottom row first, what encodeFrame takes
+void compositeOutlines(PostImage const &image, OutlineSettings const &settings, std::vector<unsigned char>& rgba, WorkerPool& workers);
+bool postKernelsUseAVX2();
+
+// Outlines an exported G-buffer again and writes the image, for --regrade. Returns false with a message.
+bool regradeGBuffer(std::string const &inputPath, std::string const &outputPath, FrameOutputFormat format, OutlineSettings const &settings);
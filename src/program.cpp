@@ -11,11 +11,22 @@
 #include <utilities/shapes.h>
 #include <utilities/glutils.h>
 #include <utilities/shader.hpp>
+#include <utilities/shaderCache.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <utilities/timeutils.h>
+#include "renderScheduler.hpp"
+#include "frameOutput.hpp"
+#include "renderServer.hpp"
+#include <utilities/tripleBuffer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
 
 
-void runProgram(GLFWwindow* window, CommandLineOptions options)
+// GL state and scene setup shared by the window and headless modes
+static void initRenderer(GLFWwindow* window, CommandLineOptions options)
 {
     // Enable depth (Z) buffer (accept "closest" fragment)
     glEnable(GL_DEPTH_TEST);
@@ -31,21 +42,162 @@ void runProgram(GLFWwindow* window, CommandLineOptions options)
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // Program binaries from the previous run skip compilation entirely
+    initShaderCache("shaders.cache");
+
 	initGame(window, options);
 
+    // Some programs are only used later, wait for them so the cache is complete
+    Gloom::Shader::finishAll();
+    saveShaderCache();
+}
+
+
+static bool startFrameOutput(FrameOutput& output, CommandLineOptions options)
+{
+    // The name was checked when parsing the arguments
+    FrameOutputFormat format = OUTPUT_PNG;
+    frameOutputFormatFromName(options.outputFormat, format);
+    return initFrameOutput(output, options.renderWidth, options.renderHeight, format, options.outputPattern, options.encoderThreads);
+}
+
+
+// The animation advances by this much per simulation step, in seconds
+static const double simulationStep = 1.0 / 120.0;
+
+// Advances the scene at a fixed rate on its own thread, so a slow update does not hold back the
+// submission of a frame and a slow frame does not hold back the animation
+static void runSimulation(TripleBuffer<SceneSnapshot>& snapshots, std::atomic<bool>& running)
+{
+    auto step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(simulationStep));
+    auto nextStep = std::chrono::steady_clock::now();
+    while (running)
+    {
+        bool moved = simulateFrame(simulationStep, tripleBufferBack(snapshots));
+        publishTripleBuffer(snapshots);
+        if (moved)
+        {
+            // The render loop may be waiting for events with nothing to draw
+            glfwPostEmptyEvent();
+        }
+
+        // After a stall the missed steps are dropped instead of run back to back
+        nextStep = std::max(nextStep + step, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(nextStep);
+    }
+}
+
+
+void runProgram(GLFWwindow* window, CommandLineOptions options)
+{
+    initRenderer(window, options);
+
+    FrameOutput output;
+    bool writeFrames = !options.outputPattern.empty();
+    int frameIndex = 0;
+    if (writeFrames && !startFrameOutput(output, options))
+    {
+        return;
+    }
+
+    // The first snapshot is made before the simulation thread starts, so the first frame has one
+    TripleBuffer<SceneSnapshot> snapshots;
+    simulateFrame(0.0, tripleBufferBack(snapshots));
+    publishTripleBuffer(snapshots);
+    std::atomic<bool> simulationRunning(true);
+    std::thread simulation(runSimulation, std::ref(snapshots), std::ref(simulationRunning));
+
     // Rendering Loop
     while (!glfwWindowShouldClose(window))
     {
-        updateFrame(window);
-        renderFrame(window);
+        // Only the newest snapshot, any the simulation made in between are skipped
+        if (acquireTripleBuffer(snapshots))
+        {
+            presentSnapshot(window, tripleBufferFront(snapshots));
+        }
 
-        // Handle other events
-        glfwPollEvents();
+        if (renderScheduledFrame(window))
+        {
+            if (writeFrames)
+            {
+                captureFrame(output, 0, frameIndex++);
+            }
+
+            // Flip buffers
+            glfwSwapBuffers(window);
+
+            // Handle other events
+            glfwPollEvents();
+        }
+        else
+        {
+            // Nothing changed, sleep until an event arrives or the timeout passes
+            glfwWaitEventsTimeout(renderIdleTimeout);
+        }
         handleKeyboardInput(window);
+    }
+    simulationRunning = false;
+    simulation.join();
+
+    if (writeFrames)
+    {
+        finishFrameOutput(output);
+    }
+}
+
+
+void runHeadless(HeadlessContext& headless, CommandLineOptions options)
+{
+    initRenderer(nullptr, options);
+    setOutputFramebuffer(headless.framebuffer);
+
+    FrameOutput output;
+    bool writeFrames = !options.outputPattern.empty();
+    if (writeFrames && !startFrameOutput(output, options))
+    {
+        return;
+    }
+
+    // Animation advances by a fixed step per update, so stepping through the earlier frames without
+    // drawing them puts the scene exactly where a run from frame zero would have it
+    for (int frame = 0; frame < options.firstFrame; frame++)
+    {
+        updateFrame(nullptr);
+    }
 
-        // Flip buffers
-        glfwSwapBuffers(window);
+    // Every frame is rendered, the scheduler only skips frames nobody would see
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = options.firstFrame; frame < options.firstFrame + options.headlessFrames; frame++)
+    {
+        updateFrame(nullptr);
+        renderFrame(nullptr);
+        if (!options.gbufferPattern.empty())
+        {
+            exportGBuffer(frameOutputPath(options.gbufferPattern, frame));
+        }
+        if (writeFrames)
+        {
+            captureFrame(output, headless.framebuffer, frame);
+        }
+    }
+    if (writeFrames)
+    {
+        finishFrameOutput(output);
     }
+    glFinish();
+    printGLError();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Rendered %d frames at %dx%d in %.2f s, %.2f ms per frame\n", options.headlessFrames,
+           headless.width, headless.height, seconds, 1000.0 * seconds / std::max(options.headlessFrames, 1));
+}
+
+
+void runServer(HeadlessContext& headless, CommandLineOptions options)
+{
+    initRenderer(nullptr, options);
+    setOutputFramebuffer(headless.framebuffer);
+    runRenderServer(headless, options.serverSocket);
 }
 
 
@@ -8,11 +8,18 @@
 #include <glad/glad.h>
 #include <string>
 #include <utilities/window.hpp>
+#include "headless.hpp"
 
 
 // Main OpenGL program
 void runProgram(GLFWwindow* window, CommandLineOptions options);
 
+// Renders a fixed number of frames into the headless framebuffer and returns
+void runHeadless(HeadlessContext& headless, CommandLineOptions options);
+
+// Loads the scene once and answers render requests on the server socket until told to stop
+void runServer(HeadlessContext& headless, CommandLineOptions options);
+
 
 // Function for handling keypresses
 void handleKeyboardInput(GLFWwindow* window);
@@ -0,0 +1,297 @@
+#include "renderGraph.hpp"
+#include <algorithm>
+#include <iostream>
+
+void initRenderGraph(RenderGraph& graph) {
+    graph.width = 0;
+    graph.height = 0;
+    graph.compiled = false;
+    graph.backbufferFramebuffer = 0;
+}
+
+// Lets the final passes draw into an offscreen framebuffer instead of the window
+void setRenderGraphBackbuffer(RenderGraph& graph, unsigned int framebuffer) {
+    graph.backbufferFramebuffer = framebuffer;
+}
+
+unsigned int createGraphTexture(RenderGraph& graph, std::string name, GLenum internalFormat, GLenum filter, bool persistent) {
+    RenderGraphResource resource;
+    resource.name = name;
+    resource.desc.internalFormat = internalFormat;
+    resource.desc.filter = filter;
+    resource.desc.persistent = persistent;
+    resource.firstUse = -1;
+    resource.lastUse = -1;
+    resource.physicalIndex = -1;
+    graph.resources.push_back(resource);
+    graph.compiled = false;
+    return graph.resources.size() - 1;
+}
+
+unsigned int addGraphPass(RenderGraph& graph, std::string name, std::vector<unsigned int> reads,
+                          std::vector<unsigned int> writes, std::function<void()> execute) {
+    RenderGraphPass pass;
+    pass.name = name;
+    pass.reads = reads;
+    pass.writes = writes;
+    pass.depthWrite = -1;
+    pass.hasSideEffects = false;
+    pass.bindTargets = true;
+    pass.execute = execute;
+    pass.culled = false;
+    pass.framebuffer = 0;
+    graph.passes.push_back(pass);
+    graph.compiled = false;
+    return graph.passes.size() - 1;
+}
+
+static bool writesBackbuffer(RenderGraphPass& pass) {
+    return std::find(pass.writes.begin(), pass.writes.end(), renderGraphBackbuffer) != pass.writes.end();
+}
+
+static void releaseGraphTargets(RenderGraph& graph) {
+    for (RenderGraphTexture& texture : graph.textures) {
+        glDeleteTextures(1, &texture.textureID);
+    }
+    for (auto& framebuffer : graph.framebuffers) {
+        glDeleteFramebuffers(1, &framebuffer.second);
+    }
+    graph.textures.clear();
+    graph.framebuffers.clear();
+}
+
+// Passes are culled from the back: a pass survives if it has side effects or
+// writes something a surviving later pass reads
+static void cullPasses(RenderGraph& graph) {
+    std::vector<bool> needed(graph.resources.size(), false);
+
+    for (int i = int(graph.passes.size()) - 1; i >= 0; i--) {
+        RenderGraphPass& pass = graph.passes[i];
+        bool live = pass.hasSideEffects || writesBackbuffer(pass);
+        for (unsigned int resource : pass.writes) {
+            if (resource != renderGraphBackbuffer && needed[resource]) {
+                live = true;
+            }
+        }
+        if (pass.depthWrite >= 0 && needed[pass.depthWrite]) {
+            live = true;
+        }
+
+        pass.culled = !live;
+        if (live) {
+            for (unsigned int resource : pass.reads) {
+                needed[resource] = true;
+            }
+        }
+    }
+}
+
+static void computeLifetimes(RenderGraph& graph) {
+    for (RenderGraphResource& resource : graph.resources) {
+        resource.firstUse = -1;
+        resource.lastUse = -1;
+        resource.physicalIndex = -1;
+    }
+
+    for (int i = 0; i < int(graph.passes.size()); i++) {
+        RenderGraphPass& pass = graph.passes[i];
+        if (pass.culled) {
+            continue;
+        }
+        std::vector<unsigned int> used = pass.reads;
+        used.insert(used.end(), pass.writes.begin(), pass.writes.end());
+        if (pass.depthWrite >= 0) {
+            used.push_back(pass.depthWrite);
+        }
+
+        for (unsigned int index : used) {
+            if (index == renderGraphBackbuffer) {
+                continue;
+            }
+            RenderGraphResource& resource = graph.resources[index];
+            resource.firstUse = resource.firstUse < 0 ? i : std::min(resource.firstUse, i);
+            resource.lastUse = std::max(resource.lastUse, i);
+        }
+    }
+
+    // Persistent contents are read again next frame, so they live through the whole frame
+    for (RenderGraphResource& resource : graph.resources) {
+        if (resource.desc.persistent && resource.firstUse >= 0) {
+            resource.firstUse = 0;
+            resource.lastUse = graph.passes.size();
+        }
+    }
+}
+
+// Greedy assignment in order of first use: a transient resource takes over a
+// physical texture of the same format whose previous users are all done
+static void aliasResources(RenderGraph& graph) {
+    std::vector<unsigned int> order;
+    for (unsigned int i = 0; i < graph.resources.size(); i++) {
+        if (graph.resources[i].firstUse >= 0) {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&graph](unsigned int a, unsigned int b) {
+        return graph.resources[a].firstUse < graph.resources[b].firstUse;
+    });
+
+    std::vector<int> physicalLastUse;
+    for (unsigned int index : order) {
+        RenderGraphResource& resource = graph.resources[index];
+
+        if (!resource.desc.persistent) {
+            for (unsigned int physical = 0; physical < graph.textures.size(); physical++) {
+                RenderGraphTextureDesc& desc = graph.textures[physical].desc;
+                if (!desc.persistent && desc.internalFormat == resource.desc.internalFormat && desc.filter == resource.desc.filter
+                        && physicalLastUse[physical] < resource.firstUse) {
+                    resource.physicalIndex = physical;
+                    physicalLastUse[physical] = resource.lastUse;
+                    break;
+                }
+            }
+        }
+
+        if (resource.physicalIndex < 0) {
+            RenderGraphTexture texture;
+            texture.textureID = 0;
+            texture.desc = resource.desc;
+            resource.physicalIndex = graph.textures.size();
+            graph.textures.push_back(texture);
+            physicalLastUse.push_back(resource.lastUse);
+        }
+    }
+}
+
+void compileRenderGraph(RenderGraph& graph, int width, int height) {
+    releaseGraphTargets(graph);
+    graph.width = width;
+    graph.height = height;
+
+    cullPasses(graph);
+    computeLifetimes(graph);
+    aliasResources(graph);
+
+    for (RenderGraphTexture& texture : graph.textures) {
+        glGenTextures(1, &texture.textureID);
+        glBindTexture(GL_TEXTURE_2D, texture.textureID);
+        glTexStorage2D(GL_TEXTURE_2D, 1, texture.desc.internalFormat, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture.desc.filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texture.desc.filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    for (RenderGraphPass& pass : graph.passes) {
+        bool hasTargets = !pass.writes.empty() || pass.depthWrite >= 0;
+        if (!pass.culled && pass.bindTargets && hasTargets && !writesBackbuffer(pass)) {
+            pass.framebuffer = graphFramebuffer(graph, pass.writes, pass.depthWrite);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    graph.compiled = true;
+}
+
+void resizeRenderGraph(RenderGraph& graph, int width, int height) {
+    if (!graph.compiled || width != graph.width || height != graph.height) {
+        compileRenderGraph(graph, width, height);
+    }
+}
+
+void executeRenderGraph(RenderGraph& graph) {
+    for (RenderGraphPass& pass : graph.passes) {
+        if (pass.culled) {
+            continue;
+        }
+        if (pass.bindTargets) {
+            glBindFramebuffer(GL_FRAMEBUFFER, writesBackbuffer(pass) ? graph.backbufferFramebuffer : pass.framebuffer);
+        }
+        // Passes like the shadow maps change the viewport for their own targets
+        glViewport(0, 0, graph.width, graph.height);
+        pass.execute();
+    }
+}
+
+unsigned int graphTexture(RenderGraph& graph, unsigned int resource) {
+    int physical = graph.resources[resource].physicalIndex;
+    return physical >= 0 ? graph.textures[physical].textureID : 0;
+}
+
+// Framebuffer with the given resources attached, created on first use and kept until the next compile
+unsigned int graphFramebuffer(RenderGraph& graph, std::vector<unsigned int> colorWrites, int depthWrite) {
+    std::vector<int> key;
+    for (unsigned int resource : colorWrites) {
+        key.push_back(graph.resources[resource].physicalIndex);
+    }
+    key.push_back(-1);
+    key.push_back(depthWrite >= 0 ? graph.resources[depthWrite].physicalIndex : -1);
+
+    auto found = graph.framebuffers.find(key);
+    if (found != graph.framebuffers.end()) {
+        return found->second;
+    }
+
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    std::vector<GLenum> attachments;
+    for (unsigned int i = 0; i < colorWrites.size(); i++) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, graphTexture(graph, colorWrites[i]), 0);
+        attachments.push_back(GL_COLOR_ATTACHMENT0 + i);
+    }
+    glDrawBuffers(attachments.size(), attachments.data());
+
+    if (depthWrite >= 0) {
+        GLenum depthFormat = graph.resources[depthWrite].desc.internalFormat;
+        GLenum attachment = depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8
+                          ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, graphTexture(graph, depthWrite), 0);
+    }
+
+    auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (fboStatus != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Framebuffer error: " << fboStatus << std::endl;
+
+    graph.framebuffers[key] = framebuffer;
+    return framebuffer;
+}
+
+static unsigned int bytesPerPixel(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_R8:                return 1;
+        case GL_R16UI:             return 2;
+        case GL_RGB8:              return 3;
+        case GL_RG16UI:
+        case GL_RGBA8:
+        case GL_DEPTH24_STENCIL8:  return 4;
+        case GL_RGB16F:            return 6;
+        case GL_RGBA16F:           return 8;
+        case GL_RGBA32F:           return 16;
+        default:                   return 4;
+    }
+}
+
+void printRenderGraph(RenderGraph& graph) {
+    std::cout << "Render graph:" << std::endl;
+    for (RenderGraphPass& pass : graph.passes) {
+        std::cout << "  " << pass.name << (pass.culled ? " (culled)" : "") << std::endl;
+    }
+
+    unsigned int used = 0;
+    size_t declaredBytes = 0;
+    for (RenderGraphResource& resource : graph.resources) {
+        if (resource.physicalIndex >= 0) {
+            used++;
+            declaredBytes += size_t(bytesPerPixel(resource.desc.internalFormat)) * graph.width * graph.height;
+        }
+    }
+    size_t allocatedBytes = 0;
+    for (RenderGraphTexture& texture : graph.textures) {
+        allocatedBytes += size_t(bytesPerPixel(texture.desc.internalFormat)) * graph.width * graph.height;
+    }
+
+    std::cout << "  " << used << " textures in " << graph.textures.size() << " allocations, "
+              << allocatedBytes / (1024 * 1024) << " of " << declaredBytes / (1024 * 1024) << " MiB" << std::endl;
+}
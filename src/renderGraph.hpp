@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Handle of the default framebuffer, for passes that present to the window
+const unsigned int renderGraphBackbuffer = ~0u;
+
+// A screen sized texture declared by name, allocated by the graph
+struct RenderGraphTextureDesc {
+    GLenum internalFormat;
+    GLenum filter;
+    // Contents must survive into the next frame (e.g. the cached G-buffer), never aliased
+    bool persistent;
+};
+
+struct RenderGraphResource {
+    std::string name;
+    RenderGraphTextureDesc desc;
+
+    // Lifetime in compiled pass order, and the physical texture it was given
+    int firstUse;
+    int lastUse;
+    int physicalIndex;
+};
+
+struct RenderGraphPass {
+    std::string name;
+    std::vector<unsigned int> reads;
+    std::vector<unsigned int> writes;   // color attachments in order, or renderGraphBackbuffer
+    int depthWrite;                     // depth attachment resource, -1 for none
+
+    // Passes with effects outside the graph (shadow maps, the window) are never culled
+    bool hasSideEffects;
+    // Off for passes that switch between their own framebuffers (see graphFramebuffer)
+    bool bindTargets;
+
+    std::function<void()> execute;
+
+    bool culled;
+    unsigned int framebuffer;
+};
+
+struct RenderGraphTexture {
+    unsigned int textureID;
+    RenderGraphTextureDesc desc;
+};
+
+// Declarative pass setup. Passes list what they read and write; compiling the
+// graph culls passes whose results are never used, computes the lifetime of
+// every texture and lets transient textures with disjoint lifetimes and equal
+// formats share one allocation. Textures are reallocated when the size changes.
+struct RenderGraph {
+    std::vector<RenderGraphResource> resources;
+    std::vector<RenderGraphPass> passes;
+    std::vector<RenderGraphTexture> textures;
+    std::map<std::vector<int>, unsigned int> framebuffers;
+
+    int width;
+    int height;
+    bool compiled;
+
+    // Framebuffer behind renderGraphBackbuffer, 0 for the window
+    unsigned int backbufferFramebuffer;
+};
+
+void initRenderGraph(RenderGraph& graph);
+unsigned int createGraphTexture(RenderGraph& graph, std::string name, GLenum internalFormat, GLenum filter, bool persistent = false);
+// Returns the pass's index into graph.passes, references would not survive the next pass being added
+unsigned int addGraphPass(RenderGraph& graph, std::string name, std::vector<unsigned int> reads,
+                          std::vector<unsigned int> writes, std::function<void()> execute);
+void setRenderGraphBackbuffer(RenderGraph& graph, unsigned int framebuffer);
+void compileRenderGraph(RenderGraph& graph, int width, int height);
+void resizeRenderGraph(RenderGraph& graph, int width, int height);
+void executeRenderGraph(RenderGraph& graph);
+unsigned int graphTexture(RenderGraph& graph, unsigned int resource);
+unsigned int graphFramebuffer(RenderGraph& graph, std::vector<unsigned int> colorWrites, int depthWrite = -1);
+void printRenderGraph(RenderGraph& graph);
@@ -0,0 +1,80 @@
+#include "renderScheduler.hpp"
+#include <utilities/hashing.hpp>
+#include <iostream>
+
+void initRenderScheduler(RenderScheduler& scheduler, bool logFrames) {
+    scheduler.dirtyReasons = RENDER_FIRST_FRAME;
+    scheduler.geometryHash = 0;
+    scheduler.lightHash = 0;
+    scheduler.width = 0;
+    scheduler.height = 0;
+    scheduler.renderedFrames = 0;
+    scheduler.idleIterations = 0;
+    scheduler.logFrames = logFrames;
+}
+
+void markRenderDirty(RenderScheduler& scheduler, unsigned int reasons) {
+    scheduler.dirtyReasons |= reasons;
+}
+
+// Compares this iteration's state with what was last rendered, called after the scene is updated
+void trackRenderState(RenderScheduler& scheduler, SceneNode* rootNode, glm::mat4 viewProjection, int width, int height) {
+    size_t geometryHash = hashSeed;
+    hashGeometryTransforms(rootNode, geometryHash);
+    size_t lightHash = hashSeed;
+    hashLights(rootNode, lightHash);
+
+    if (geometryHash != scheduler.geometryHash) {
+        scheduler.dirtyReasons |= RENDER_SCENE;
+    }
+    if (viewProjection != scheduler.viewProjection) {
+        scheduler.dirtyReasons |= RENDER_CAMERA;
+    }
+    if (lightHash != scheduler.lightHash) {
+        scheduler.dirtyReasons |= RENDER_LIGHTS;
+    }
+    if (width != scheduler.width || height != scheduler.height) {
+        scheduler.dirtyReasons |= RENDER_WINDOW;
+    }
+
+    scheduler.geometryHash = geometryHash;
+    scheduler.viewProjection = viewProjection;
+    scheduler.lightHash = lightHash;
+    scheduler.width = width;
+    scheduler.height = height;
+}
+
+// Returns whether a frame should be rendered now, and consumes the dirty reasons if so
+bool beginScheduledFrame(RenderScheduler& scheduler) {
+    if (scheduler.dirtyReasons == 0) {
+        if (scheduler.logFrames && scheduler.idleIterations == 0) {
+            std::cout << "Idle after frame " << scheduler.renderedFrames << std::endl;
+        }
+        scheduler.idleIterations++;
+        return false;
+    }
+
+    scheduler.renderedFrames++;
+    if (scheduler.logFrames) {
+        std::cout << "Frame " << scheduler.renderedFrames << ": " << renderReasonNames(scheduler.dirtyReasons);
+        if (scheduler.idleIterations > 0) {
+            std::cout << " (after " << scheduler.idleIterations << " idle iterations)";
+        }
+        std::cout << std::endl;
+    }
+
+    scheduler.dirtyReasons = 0;
+    scheduler.idleIterations = 0;
+    return true;
+}
+
+std::string renderReasonNames(unsigned int reasons) {
+    const char* names[] = { "first frame", "scene", "camera", "lights", "window" };
+    std::string result;
+    for (unsigned int i = 0; i < 5; i++) {
+        if (reasons & (1u << i)) {
+            result += result.empty() ? names[i] : std::string(", ") + names[i];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+
+#include "sceneGraph.hpp"
+
+// Why a frame had to be rendered, several can be set at once
+enum RenderReason {
+    RENDER_FIRST_FRAME = 1 << 0,
+    RENDER_SCENE       = 1 << 1,  // a geometry node moved or changed mesh
+    RENDER_CAMERA      = 1 << 2,
+    RENDER_LIGHTS      = 1 << 3,
+    RENDER_WINDOW      = 1 << 4   // resized, or the window contents were damaged
+};
+
+// How long the loop sleeps in glfwWaitEventsTimeout when nothing is dirty
+const double renderIdleTimeout = 0.5;
+
+// On-demand rendering. The state frames depend on is compared against what the
+// last frame was rendered with, and a new frame is only produced when something
+// differs or an event marked the scheduler dirty.
+struct RenderScheduler {
+    unsigned int dirtyReasons;
+
+    // What the last rendered frame saw
+    glm::mat4 viewProjection;
+    size_t geometryHash;
+    size_t lightHash;
+    int width;
+    int height;
+
+    // Frames rendered and loop iterations that produced no frame
+    unsigned long renderedFrames;
+    unsigned long idleIterations;
+
+    bool logFrames;
+};
+
+void initRenderScheduler(RenderScheduler& scheduler, bool logFrames);
+void markRenderDirty(RenderScheduler& scheduler, unsigned int reasons);
+void trackRenderState(RenderScheduler& scheduler, SceneNode* rootNode, glm::mat4 viewProjection, int width, int height);
+bool beginScheduledFrame(RenderScheduler& scheduler);
+std::string renderReasonNames(unsigned int reasons);
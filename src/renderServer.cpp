@@ -0,0 +1,433 @@
+#include "renderServer.hpp"
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <fmt/format.h>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// A client sending this much without a line ending is not speaking the protocol
+const size_t serverMaxLineLength = 64 * 1024;
+
+static bool parseFloat(std::string const &text, float& value) {
+    char extra;
+    return sscanf(text.c_str(), "%f%c", &value, &extra) == 1;
+}
+
+static bool parseInt(std::string const &text, int& value) {
+    char extra;
+    return sscanf(text.c_str(), "%d%c", &value, &extra) == 1;
+}
+
+static bool parseVector(std::string const &text, glm::vec3& value) {
+    char extra;
+    return sscanf(text.c_str(), "%f,%f,%f%c", &value.x, &value.y, &value.z, &extra) == 3;
+}
+
+bool parseRenderRequest(RenderServer& server, std::string const &line, RenderRequest& request, std::string& error) {
+    request.line = line;
+    request.view = server.defaultView;
+    request.width = server.defaultWidth;
+    request.height = server.defaultHeight;
+    request.format = OUTPUT_PNG;
+
+    std::istringstream tokens(line);
+    std::string token;
+    while (tokens >> token) {
+        size_t separator = token.find('=');
+        if (separator == std::string::npos) {
+            error = "expected key=value, got " + token;
+            return false;
+        }
+        std::string key = token.substr(0, separator);
+        std::string value = token.substr(separator + 1);
+
+        bool valid;
+        if (key == "camera") {
+            valid = parseVector(value, request.view.cameraPosition);
+        } else if (key == "pitch") {
+            valid = parseFloat(value, request.view.cameraPitch);
+        } else if (key == "yaw") {
+            valid = parseFloat(value, request.view.cameraYaw);
+        } else if (key == "width") {
+            valid = parseInt(value, request.width) && request.width > 0 && request.width <= serverMaxImageSize;
+        } else if (key == "height") {
+            valid = parseInt(value, request.height) && request.height > 0 && request.height <= serverMaxImageSize;
+        } else if (key == "format") {
+            valid = frameOutputFormatFromName(value, request.format);
+        } else if (key.compare(0, 5, "light") == 0) {
+            int index;
+            if (!parseInt(key.substr(5), index) || index < 0 || index >= int(request.view.lightPositions.size())) {
+                error = "no light " + key.substr(5) + ", the scene has " + std::to_string(request.view.lightPositions.size());
+                return false;
+            }
+            valid = parseVector(value, request.view.lightPositions[index]);
+        } else {
+            error = "unknown key " + key;
+            return false;
+        }
+
+        if (!valid) {
+            error = "invalid value for " + key + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifndef _WIN32
+
+static volatile sig_atomic_t serverInterrupted = 0;
+
+static void onInterrupt(int) {
+    serverInterrupted = 1;
+}
+
+static bool openListenSocket(RenderServer& server) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (server.socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path " << server.socketPath << " is too long" << std::endl;
+        return false;
+    }
+    memcpy(address.sun_path, server.socketPath.c_str(), server.socketPath.size() + 1);
+
+    server.listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listenSocket < 0) {
+        perror("Could not create the server socket");
+        return false;
+    }
+
+    // A socket file left behind by an earlier run would make bind fail
+    unlink(server.socketPath.c_str());
+    if (bind(server.listenSocket, (sockaddr*) &address, sizeof(address)) < 0 || listen(server.listenSocket, SOMAXCONN) < 0) {
+        perror(("Could not listen on " + server.socketPath).c_str());
+        close(server.listenSocket);
+        return false;
+    }
+    return true;
+}
+
+static RenderClient* findClient(RenderServer& server, int socket) {
+    for (RenderClient& client : server.clients) {
+        if (client.socket == socket) {
+            return &client;
+        }
+    }
+    return nullptr;
+}
+
+static void queueReply(RenderServer& server, int socket, const void* data, size_t size) {
+    RenderClient* client = findClient(server, socket);
+    if (client) {
+        client->output.append((const char*) data, size);
+    }
+}
+
+// Sends as much queued output as the socket takes, returns false once the client is gone
+static bool flushClient(RenderClient& client) {
+    while (client.outputSent < client.output.size()) {
+        ssize_t sent = send(client.socket, client.output.data() + client.outputSent, client.output.size() - client.outputSent, 0);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        client.outputSent += sent;
+    }
+    if (client.outputSent == client.output.size()) {
+        client.output.clear();
+        client.outputSent = 0;
+    }
+    return client.output.size() - client.outputSent <= serverMaxQueuedOutput;
+}
+
+static bool outputQueued(RenderServer const &server) {
+    for (RenderClient const &client : server.clients) {
+        if (client.outputSent < client.output.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void closeClient(RenderServer& server, size_t index) {
+    int socket = server.clients[index].socket;
+    close(socket);
+    server.clients.erase(server.clients.begin() + index);
+
+    // Nobody is left to receive these
+    server.queue.erase(std::remove_if(server.queue.begin(), server.queue.end(),
+                                      [socket](RenderRequest& request) { return request.client == socket; }),
+                       server.queue.end());
+}
+
+// Queues every complete line that arrived, returns false once the client has disconnected
+static bool readClient(RenderServer& server, RenderClient& client) {
+    char buffer[4096];
+    ssize_t received = recv(client.socket, buffer, sizeof(buffer), 0);
+    if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+    }
+    if (received <= 0) {
+        return false;
+    }
+    client.pending.append(buffer, received);
+
+    size_t end;
+    while ((end = client.pending.find('\n')) != std::string::npos) {
+        std::string line = client.pending.substr(0, end);
+        client.pending.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (line == "shutdown") {
+            server.stopping = true;
+            continue;
+        }
+
+        // Malformed requests are queued too, so their replies keep their place in the order
+        RenderRequest request;
+        request.client = client.socket;
+        parseRenderRequest(server, line, request, request.error);
+        server.queue.push_back(request);
+    }
+    return client.pending.size() <= serverMaxLineLength;
+}
+
+static unsigned int batchPixelBuffer(RenderServer& server, size_t slot, size_t size) {
+    while (server.pixelBuffers.size() <= slot) {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        server.pixelBuffers.push_back(buffer);
+        server.pixelBufferSizes.push_back(0);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, server.pixelBuffers[slot]);
+    if (server.pixelBufferSizes[slot] < size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        server.pixelBufferSizes[slot] = size;
+    }
+    return server.pixelBuffers[slot];
+}
+
+static void renderBatch(RenderServer& server, HeadlessContext& headless) {
+    auto start = std::chrono::steady_clock::now();
+    size_t count = std::min<size_t>(server.queue.size(), serverMaxBatch);
+    std::vector<RenderRequest> batch(server.queue.begin(), server.queue.begin() + count);
+    server.queue.erase(server.queue.begin(), server.queue.begin() + count);
+
+    // Requests of one size next to each other, so the targets are reallocated once per size
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&batch](size_t a, size_t b) {
+        return std::make_pair(batch[a].width, batch[a].height) < std::make_pair(batch[b].width, batch[b].height);
+    });
+
+    // Identical requests are rendered once and share the image
+    std::map<std::string, size_t> renderedLines;
+    std::vector<size_t> source(count);
+    for (size_t i : order) {
+        RenderRequest& request = batch[i];
+        source[i] = i;
+        if (!request.error.empty()) {
+            continue;
+        }
+        auto same = renderedLines.find(request.line);
+        if (same != renderedLines.end()) {
+            source[i] = same->second;
+            continue;
+        }
+        renderedLines[request.line] = i;
+
+        if (request.width != headless.width || request.height != headless.height) {
+            resizeHeadlessContext(headless, request.width, request.height);
+            setRenderSize(request.width, request.height);
+        }
+        setSceneView(request.view);
+        updateFrame(nullptr);
+        renderFrame(nullptr);
+
+        // Reads land in pixel buffers, nothing waits until the whole batch has been drawn
+        batchPixelBuffer(server, i, size_t(request.width) * request.height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, headless.framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, request.width, request.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        server.imagesRendered++;
+    }
+
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fence);
+
+    // Encoding runs on one thread per image, the context stays on this one
+    std::vector<std::vector<unsigned char>> pixels(count);
+    std::vector<std::future<std::vector<unsigned char>>> encoding(count);
+    for (size_t i = 0; i < count; i++) {
+        RenderRequest& request = batch[i];
+        if (source[i] != i || !request.error.empty()) {
+            continue;
+        }
+        size_t size = size_t(request.width) * request.height * 4;
+        pixels[i].resize(size);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, server.pixelBuffers[i]);
+        void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (mapped) {
+            memcpy(pixels[i].data(), mapped, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        encoding[i] = std::async(std::launch::async, encodeFrame, request.format, pixels[i].data(), request.width, request.height);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    std::vector<std::vector<unsigned char>> images(count);
+    for (size_t i = 0; i < count; i++) {
+        if (encoding[i].valid()) {
+            images[i] = encoding[i].get();
+        }
+    }
+
+    // The batch is in arrival order, so every client gets its replies in the order it asked
+    const char* formatNames[] = { "png", "y4m", "rgb" };
+    for (size_t i = 0; i < count; i++) {
+        RenderRequest& request = batch[i];
+        std::string header;
+        if (!request.error.empty()) {
+            header = "ERROR " + request.error + "\n";
+        } else {
+            header = fmt::format("OK {} {} {} {}\n", formatNames[request.format], request.width, request.height, images[source[i]].size());
+        }
+        // Sent by the poll loop as each client reads
+        queueReply(server, request.client, header.data(), header.size());
+        if (request.error.empty()) {
+            queueReply(server, request.client, images[source[i]].data(), images[source[i]].size());
+        }
+        server.requestsServed++;
+    }
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << fmt::format("Served {} requests with {} renders in {:.1f} ms", count, renderedLines.size(), milliseconds) << std::endl;
+}
+
+void runRenderServer(HeadlessContext& headless, std::string const &socketPath) {
+    RenderServer server;
+    server.socketPath = socketPath;
+    server.stopping = false;
+    server.defaultView = currentSceneView();
+    server.defaultWidth = headless.width;
+    server.defaultHeight = headless.height;
+    server.imagesRendered = 0;
+    server.requestsServed = 0;
+    if (!openListenSocket(server)) {
+        return;
+    }
+
+    // Clients hanging up show up as failed sends, and an interrupt ends the loop with the socket removed
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction interrupt;
+    memset(&interrupt, 0, sizeof(interrupt));
+    interrupt.sa_handler = onInterrupt;
+    sigaction(SIGINT, &interrupt, nullptr);
+    sigaction(SIGTERM, &interrupt, nullptr);
+
+    std::cout << "Serving renders on " << socketPath << std::endl;
+    // After a shutdown the loop goes on until the queued replies are read or the timeout passes
+    auto stopDeadline = std::chrono::steady_clock::time_point::max();
+    while (!serverInterrupted && (!server.stopping || !server.queue.empty() || outputQueued(server))) {
+        if (server.stopping && stopDeadline == std::chrono::steady_clock::time_point::max()) {
+            stopDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(serverShutdownTimeout);
+        }
+        if (std::chrono::steady_clock::now() > stopDeadline) {
+            break;
+        }
+
+        std::vector<pollfd> descriptors;
+        descriptors.push_back({ server.listenSocket, short(server.stopping ? 0 : POLLIN), 0 });
+        for (RenderClient& client : server.clients) {
+            short events = POLLIN;
+            if (client.outputSent < client.output.size()) {
+                events |= POLLOUT;
+            }
+            descriptors.push_back({ client.socket, events, 0 });
+        }
+
+        // Sleeps while idle, with requests waiting it only picks up whatever else has arrived
+        int timeout = !server.queue.empty() ? 0 : server.stopping ? 100 : -1;
+        if (poll(descriptors.data(), descriptors.size(), timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        // Backwards, since disconnected clients are removed
+        for (size_t i = descriptors.size() - 1; i >= 1; i--) {
+            RenderClient& client = server.clients[i - 1];
+            bool open = true;
+            if (descriptors[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                open = readClient(server, client);
+            }
+            if (open && (descriptors[i].revents & POLLOUT)) {
+                open = flushClient(client);
+            }
+            if (!open) {
+                closeClient(server, i - 1);
+            }
+        }
+        if (descriptors[0].revents & POLLIN) {
+            int client = accept(server.listenSocket, nullptr, nullptr);
+            if (client >= 0) {
+                fcntl(client, F_SETFL, fcntl(client, F_GETFL, 0) | O_NONBLOCK);
+                server.clients.push_back({ client, "", "", 0 });
+            }
+        }
+
+        if (!server.queue.empty()) {
+            renderBatch(server, headless);
+        }
+    }
+
+    while (!server.clients.empty()) {
+        closeClient(server, server.clients.size() - 1);
+    }
+    close(server.listenSocket);
+    unlink(socketPath.c_str());
+    for (unsigned int buffer : server.pixelBuffers) {
+        glDeleteBuffers(1, &buffer);
+    }
+    std::cout << "Render server stopped after " << server.requestsServed << " requests and "
+              << server.imagesRendered << " renders" << std::endl;
+}
+
+#else
+
+void runRenderServer(HeadlessContext&, std::string const &) {
+    std::cerr << "The render server needs Unix domain sockets, which this build does not have" << std::endl;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "frameOutput.hpp"
+#include "gamelogic.h"
+#include "headless.hpp"
+
+// Requests taken from the queue and rendered together
+const unsigned int serverMaxBatch = 16;
+
+// Largest image a request may ask for, per side
+const int serverMaxImageSize = 8192;
+
+// Long running render service on a Unix domain socket. Models, textures and shaders stay resident
+// in one headless context, so an image costs a frame instead of a program start.
+//
+// Every request is one line of space separated key=value pairs, all optional:
+//     camera=x,y,z pitch=radians yaw=radians light0=x,y,z width=640 height=360 format=png|rgb|y4m
+// Lights are numbered in creation order and placed relative to their parent node, anything left
+// out keeps the view the server started with. The reply is a line
+//     OK <format> <width> <height> <byte count>
+// followed by the encoded image, or a line starting with ERROR. Blank lines get no reply, send
+// format=png for an image with every default. The line "shutdown" stops the server.
+struct RenderRequest {
+    int client;
+    std::string line;
+    std::string error;  // set for malformed requests, which are answered in order like the others
+    SceneView view;
+    int width;
+    int height;
+    FrameOutputFormat format;
+};
+
+// A client that lets more than this much reply data pile up without reading is dropped
+const size_t serverMaxQueuedOutput = 256 * 1024 * 1024;
+
+// How long a shutdown waits for the replies still queued to be read
+const int serverShutdownTimeout = 5000;  // milliseconds
+
+// Client sockets are non-blocking. Replies are appended to output and written as the socket
+// accepts them, so a client that stops reading only holds back its own replies.
+struct RenderClient {
+    int socket;
+    std::string pending;  // received text without a line ending yet
+    std::string output;   // replies not sent yet, from outputSent on
+    size_t outputSent;
+};
+
+struct RenderServer {
+    std::string socketPath;
+    int listenSocket;
+    std::vector<RenderClient> clients;
+    std::vector<RenderRequest> queue;  // in arrival order, which is also the order of the replies
+    bool stopping;
+
+    // Defaults for everything a request leaves out
+    SceneView defaultView;
+    int defaultWidth;
+    int defaultHeight;
+
+    // One pixel buffer per request of a batch, grown on demand
+    std::vector<unsigned int> pixelBuffers;
+    std::vector<size_t> pixelBufferSizes;
+
+    unsigned long long imagesRendered;
+    unsigned long long requestsServed;
+};
+
+// Parses one request line against the server's defaults, returns false with a message for malformed lines
+bool parseRenderRequest(RenderServer& server, std::string const &line, RenderRequest& request, std::string& error);
+
+// Serves requests until "shutdown" arrives or the process is interrupted. The game must be initialised
+// and drawing into the headless framebuffer.
+void runRenderServer(HeadlessContext& headless, std::string const &socketPath);
@@ -1,4 +1,6 @@
 #include "sceneGraph.hpp"
+#include <utilities/hashing.hpp>
+#include <cmath>
 #include <iostream>
 
 SceneNode* createSceneNode() {
@@ -18,6 +20,16 @@ int totalChildren(SceneNode* parent) {
 	return count;
 }
 
+// Gives every node with geometry its own non-zero object ID
+void assignObjectIDs(SceneNode* node, unsigned int& nextObjectID) {
+	if (node->nodeType != POINT_LIGHT && node->vertexArrayObjectID != -1) {
+		node->objectID = nextObjectID++;
+	}
+	for (SceneNode* child : node->children) {
+		assignObjectIDs(child, nextObjectID);
+	}
+}
+
 // Pretty prints the current values of a SceneNode instance to stdout
 void printNode(SceneNode* node) {
 	printf(
@@ -35,3 +47,84 @@ void printNode(SceneNode* node) {
 		node->vertexArrayObjectID);
 }
 
+// FNV-1a over the model matrix and mesh of every node with geometry, the G-buffer is only redrawn when it changes
+void hashGeometryTransforms(SceneNode* node, size_t& hash) {
+	if (node->nodeType != POINT_LIGHT && node->vertexArrayObjectID != -1) {
+		hash = hashValue(hash, node->modelMatrix);
+		hash = hashValue(hash, node->vertexArrayObjectID);
+	}
+	for (SceneNode* child : node->children) {
+		hashGeometryTransforms(child, hash);
+	}
+}
+
+// Same for the position, color and radius of every light
+void hashLights(SceneNode* node, size_t& hash) {
+	if (node->nodeType == POINT_LIGHT) {
+		float values[5] = { node->modelMatrix[3][0], node->modelMatrix[3][1], node->modelMatrix[3][2], node->lightRadius, float(node->castsShadows) };
+		hash = hashValue(hash, values);
+		hash = hashValue(hash, node->color);
+	}
+	for (SceneNode* child : node->children) {
+		hashLights(child, hash);
+	}
+}
+
+static void applySnapshotNode(SceneSnapshot const &snapshot, SceneNode* node, size_t& index) {
+	node->modelMatrix = snapshot.modelMatrices[index];
+	node->currentTransformationMatrix = snapshot.currentTransformations[index];
+	index++;
+	for (SceneNode* child : node->children) {
+		applySnapshotNode(snapshot, child, index);
+	}
+}
+
+// Copies the snapshot's matrices into the nodes, which is what everything that draws reads
+void applySceneSnapshot(SceneSnapshot const &snapshot, SceneNode* root) {
+	size_t index = 0;
+	applySnapshotNode(snapshot, root, index);
+}
+
+// Outside when all eight corners are beyond the same clip plane
+bool nodeOutsideFrustum(SceneNode* node, glm::mat4 modelViewProjection) {
+	if (!node->hasBounds) {
+		return false;
+	}
+	glm::vec4 corners[8];
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 local((corner & 1) ? node->boundsMax.x : node->boundsMin.x,
+		                (corner & 2) ? node->boundsMax.y : node->boundsMin.y,
+		                (corner & 4) ? node->boundsMax.z : node->boundsMin.z);
+		corners[corner] = modelViewProjection * glm::vec4(local, 1.0f);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		for (float side : {-1.0f, 1.0f}) {
+			bool allOutside = true;
+			for (int i = 0; i < 8 && allOutside; i++) {
+				allOutside = side * corners[i][axis] > corners[i].w;
+			}
+			if (allOutside) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Against the world space box around the bounds, which is what the light range reaches
+bool nodeOutsideSphere(SceneNode* node, glm::vec3 center, float radius) {
+	if (!node->hasBounds) {
+		return false;
+	}
+	glm::vec3 worldMin(INFINITY), worldMax(-INFINITY);
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 local((corner & 1) ? node->boundsMax.x : node->boundsMin.x,
+		                (corner & 2) ? node->boundsMax.y : node->boundsMin.y,
+		                (corner & 4) ? node->boundsMax.z : node->boundsMin.z);
+		glm::vec3 world = glm::vec3(node->modelMatrix * glm::vec4(local, 1.0f));
+		worldMin = glm::min(worldMin, world);
+		worldMax = glm::max(worldMax, world);
+	}
+	glm::vec3 offset = glm::max(glm::max(worldMin - center, center - worldMax), glm::vec3(0.0f));
+	return glm::dot(offset, offset) > radius * radius;
+}
@@ -26,9 +26,19 @@ struct SceneNode {
         referencePoint = glm::vec3(0, 0, 0);
         vertexArrayObjectID = -1;
         VAOIndexCount = 0;
+        edgeBufferID = -1;
+        edgeCount = 0;
+        pulledMeshID = -1;
+        queryMeshID = -1;
+        hasBounds = false;
 
         nodeType = GEOMETRY;
 
+        objectID = 0;
+        lightRadius = 250.0f;
+        castsShadows = false;
+        isDynamic = false;
+
 	}
 
 	// A list of all children that belong to this node.
@@ -51,22 +61,67 @@ struct SceneNode {
 	int vertexArrayObjectID;
 	unsigned int VAOIndexCount;
 
+	// Storage buffer with the crease, boundary and potential silhouette edges of the mesh, used by the geometric line renderer
+	int edgeBufferID;
+	unsigned int edgeCount;
+
+	// Index of the mesh in the shared vertex pool, used instead of the VAO when vertex pulling is enabled
+	int pulledMeshID;
+
+	// Index of the mesh's BVH in the scene queries, for ray casts against the node
+	int queryMeshID;
+
+	// Object space bounds of the geometry. Every pass culls nodes that have them against what it
+	// sees, the node itself stays the same whatever the camera does.
+	bool hasBounds;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
 	// Node type is used to determine how to handle the contents of a node
 	SceneNodeType nodeType;
 
 	// The ID to easily identify nodes
 	unsigned int id;
+
+	// Written to the object ID attachment so the outline pass can find silhouettes, 0 is the background
+	unsigned int objectID;
 	
 	// Color of the light
 	glm::vec3 color;
 
+	// World space distance at which the light fades out completely, used for light culling
+	float lightRadius;
+
+	// Whether a point light renders a shadow cube map
+	bool castsShadows;
+
+	// Dynamic geometry is redrawn into the shadow maps every frame, static geometry only when it or the light moves
+	bool isDynamic;
+
 	// Store texture ID
 	unsigned int textureID;
 };
 
+// The transforms of every node at one point in time, written by the simulation and read by the
+// renderer. Nodes are in depth first order, the structure of the graph does not change.
+struct SceneSnapshot {
+	glm::mat4 viewTransformation;
+	glm::mat4 viewProjection;
+	std::vector<glm::mat4> modelMatrices;
+	std::vector<glm::mat4> currentTransformations;
+};
+
 SceneNode* createSceneNode();
 void addChild(SceneNode* parent, SceneNode* child);
 void printNode(SceneNode* node);
 int totalChildren(SceneNode* parent);
+void assignObjectIDs(SceneNode* node, unsigned int& nextObjectID);
+void hashGeometryTransforms(SceneNode* node, size_t& hash);
+void hashLights(SceneNode* node, size_t& hash);
+void applySceneSnapshot(SceneSnapshot const &snapshot, SceneNode* root);
+
+// Culling of nodes with bounds, nodes without are never outside
+bool nodeOutsideFrustum(SceneNode* node, glm::mat4 modelViewProjection);
+bool nodeOutsideSphere(SceneNode* node, glm::vec3 center, float radius);
 
 // For more details, see SceneGraph.cpp.
\ No newline at end of file
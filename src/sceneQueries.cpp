@@ -0,0 +1,309 @@
+#include "sceneQueries.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+
+int addQueryMesh(SceneQueries& queries, Mesh const &mesh) {
+    queries.meshes.emplace_back();
+    buildMeshBVH(queries.meshes.back(), mesh.vertices, mesh.indices);
+    return int(queries.meshes.size() - 1);
+}
+
+static void collectInstances(SceneQueries& queries, SceneNode* node) {
+    if (node->queryMeshID != -1 && !queries.meshes[node->queryMeshID].nodes.empty()) {
+        queries.instances.push_back({ node, node->queryMeshID, node->modelMatrix, glm::inverse(node->modelMatrix) });
+    }
+    for (SceneNode* child : node->children) {
+        collectInstances(queries, child);
+    }
+}
+
+void updateSceneQueries(SceneQueries& queries, SceneNode* root) {
+    queries.instances.clear();
+    collectInstances(queries, root);
+
+    // World bounds of the mesh bounds' corners
+    std::vector<glm::vec3> boundsMin(queries.instances.size());
+    std::vector<glm::vec3> boundsMax(queries.instances.size());
+    for (size_t i = 0; i < queries.instances.size(); i++) {
+        QueryInstance const &instance = queries.instances[i];
+        BVHNode const &meshBounds = queries.meshes[instance.mesh].nodes[0];
+        boundsMin[i] = glm::vec3(std::numeric_limits<float>::max());
+        boundsMax[i] = glm::vec3(-std::numeric_limits<float>::max());
+        for (unsigned int corner = 0; corner < 8; corner++) {
+            glm::vec3 local((corner & 1) ? meshBounds.boundsMax.x : meshBounds.boundsMin.x,
+                            (corner & 2) ? meshBounds.boundsMax.y : meshBounds.boundsMin.y,
+                            (corner & 4) ? meshBounds.boundsMax.z : meshBounds.boundsMin.z);
+            glm::vec3 world = glm::vec3(instance.objectToWorld * glm::vec4(local, 1.0f));
+            boundsMin[i] = glm::min(boundsMin[i], world);
+            boundsMax[i] = glm::max(boundsMax[i], world);
+        }
+    }
+    buildBoundsBVH(queries.instanceNodes, queries.instanceOrder, boundsMin, boundsMax);
+}
+
+static void objectRay(QueryInstance const &instance, glm::vec3 origin, glm::vec3 direction,
+                      glm::vec3& objectOrigin, glm::vec3& objectDirection) {
+    // Not normalized, so distances along the ray stay the same in both spaces
+    objectOrigin = glm::vec3(instance.worldToObject * glm::vec4(origin, 1.0f));
+    objectDirection = glm::vec3(instance.worldToObject * glm::vec4(direction, 0.0f));
+}
+
+static void fillSceneHit(SceneQueries const &queries, QueryInstance const &instance, glm::vec3 origin, glm::vec3 direction,
+                         MeshHit const &meshHit, SceneHit& hit) {
+    MeshBVH const &bvh = queries.meshes[instance.mesh];
+    BVHTriangle const &triangle = bvh.triangles[meshHit.triangle];
+    // Normals go through the inverse transpose
+    glm::vec3 normal = glm::normalize(glm::transpose(glm::mat3(instance.worldToObject)) * glm::cross(triangle.edgeA, triangle.edgeB));
+    if (glm::dot(normal, direction) > 0.0f) {
+        normal = -normal;
+    }
+    hit.node = instance.node;
+    hit.distance = meshHit.distance;
+    hit.position = origin + direction * meshHit.distance;
+    hit.normal = normal;
+    hit.triangle = bvh.triangleIndices[meshHit.triangle];
+}
+
+bool castRay(SceneQueries const &queries, SceneRay const &ray, SceneHit& hit) {
+    glm::vec3 inverseDirection = inverseRayDirection(ray.direction);
+    float entry;
+    if (queries.instanceNodes.empty() ||
+        !rayEntersBounds(queries.instanceNodes[0], ray.origin, inverseDirection, ray.maxDistance, entry)) {
+        return false;
+    }
+
+    // Both children are pushed, the nearer one last so it is visited first
+    struct Pending {
+        unsigned int node;
+        float entry;
+    } stack[bvhMaxDepth + 1];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = { 0, entry };
+    float nearest = ray.maxDistance;
+    int nearestInstance = -1;
+    MeshHit nearestHit;
+    while (stackSize > 0) {
+        Pending pending = stack[--stackSize];
+        if (pending.entry >= nearest) {
+            continue;
+        }
+        BVHNode const &node = queries.instanceNodes[pending.node];
+        if (node.triangleCount == 0) {
+            unsigned int left = pending.node + 1, right = node.firstOrRight;
+            float leftEntry, rightEntry;
+            bool hitsLeft = rayEntersBounds(queries.instanceNodes[left], ray.origin, inverseDirection, nearest, leftEntry);
+            bool hitsRight = rayEntersBounds(queries.instanceNodes[right], ray.origin, inverseDirection, nearest, rightEntry);
+            if (hitsLeft && hitsRight) {
+                bool leftFirst = leftEntry <= rightEntry;
+                stack[stackSize++] = leftFirst ? Pending{ right, rightEntry } : Pending{ left, leftEntry };
+                stack[stackSize++] = leftFirst ? Pending{ left, leftEntry } : Pending{ right, rightEntry };
+            } else if (hitsLeft) {
+                stack[stackSize++] = { left, leftEntry };
+            } else if (hitsRight) {
+                stack[stackSize++] = { right, rightEntry };
+            }
+            continue;
+        }
+        for (unsigned int i = node.firstOrRight; i < node.firstOrRight + node.triangleCount; i++) {
+            QueryInstance const &instance = queries.instances[queries.instanceOrder[i]];
+            glm::vec3 origin, direction;
+            objectRay(instance, ray.origin, ray.direction, origin, direction);
+            MeshHit meshHit;
+            if (intersectMeshBVH(queries.meshes[instance.mesh], origin, direction, nearest, meshHit)) {
+                nearest = meshHit.distance;
+                nearestInstance = int(queries.instanceOrder[i]);
+                nearestHit = meshHit;
+            }
+        }
+    }
+    if (nearestInstance == -1) {
+        return false;
+    }
+    fillSceneHit(queries, queries.instances[nearestInstance], ray.origin, ray.direction, nearestHit, hit);
+    return true;
+}
+
+bool castRayAtNode(SceneQueries const &queries, SceneNode* node, SceneRay const &ray, SceneHit& hit) {
+    for (QueryInstance const &instance : queries.instances) {
+        if (instance.node != node) {
+            continue;
+        }
+        glm::vec3 origin, direction;
+        objectRay(instance, ray.origin, ray.direction, origin, direction);
+        MeshHit meshHit;
+        if (!intersectMeshBVH(queries.meshes[instance.mesh], origin, direction, ray.maxDistance, meshHit)) {
+            return false;
+        }
+        fillSceneHit(queries, instance, ray.origin, ray.direction, meshHit, hit);
+        return true;
+    }
+    return false;
+}
+
+unsigned int castRays(SceneQueries const &queries, SceneRay const* rays, unsigned int count, SceneHit* hits, bool* found) {
+    unsigned int hitCount = 0;
+    for (unsigned int first = 0; first < count; first += 4) {
+        unsigned int lanes = std::min(count - first, 4u);
+        RayPacket packet;
+        for (unsigned int lane = 0; lane < 4; lane++) {
+            // Lanes past the end repeat the first ray, inactive
+            SceneRay const &ray = rays[first + (lane < lanes ? lane : 0)];
+            setPacketRay(packet, lane, ray.origin, ray.direction, lane < lanes ? ray.maxDistance : 0.0f);
+        }
+
+        MeshHit meshHits[4];
+        int hitInstances[4] = { -1, -1, -1, -1 };
+        unsigned int stack[bvhMaxDepth];
+        unsigned int stackSize = 0;
+        unsigned int nodeIndex = 0;
+        while (!queries.instanceNodes.empty()) {
+            BVHNode const &node = queries.instanceNodes[nodeIndex];
+            if (packetEntersBounds(node, packet)) {
+                if (node.triangleCount == 0) {
+                    stack[stackSize++] = node.firstOrRight;
+                    nodeIndex++;
+                    continue;
+                }
+                for (unsigned int i = node.firstOrRight; i < node.firstOrRight + node.triangleCount; i++) {
+                    unsigned int instanceIndex = queries.instanceOrder[i];
+                    QueryInstance const &instance = queries.instances[instanceIndex];
+                    RayPacket objectPacket;
+                    for (unsigned int lane = 0; lane < 4; lane++) {
+                        glm::vec3 origin, direction;
+                        objectRay(instance, glm::vec3(packet.originX[lane], packet.originY[lane], packet.originZ[lane]),
+                                  glm::vec3(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]),
+                                  origin, direction);
+                        setPacketRay(objectPacket, lane, origin, direction, packet.maxDistance[lane]);
+                    }
+                    unsigned int mask = intersectMeshBVHPacket(queries.meshes[instance.mesh], objectPacket, meshHits);
+                    for (unsigned int lane = 0; lane < 4; lane++) {
+                        if (mask & (1u << lane)) {
+                            packet.maxDistance[lane] = objectPacket.maxDistance[lane];
+                            hitInstances[lane] = int(instanceIndex);
+                        }
+                    }
+                }
+            }
+            if (stackSize == 0) {
+                break;
+            }
+            nodeIndex = stack[--stackSize];
+        }
+
+        for (unsigned int lane = 0; lane < lanes; lane++) {
+            SceneRay const &ray = rays[first + lane];
+            found[first + lane] = hitInstances[lane] != -1;
+            if (found[first + lane]) {
+                fillSceneHit(queries, queries.instances[hitInstances[lane]], ray.origin, ray.direction, meshHits[lane], hits[first + lane]);
+                hitCount++;
+            }
+        }
+    }
+    return hitCount;
+}
+
+bool sceneRayOccluded(SceneQueries const &queries, SceneRay const &ray) {
+    if (queries.instanceNodes.empty()) {
+        return false;
+    }
+    glm::vec3 inverseDirection = inverseRayDirection(ray.direction);
+    unsigned int stack[bvhMaxDepth];
+    unsigned int stackSize = 0;
+    unsigned int nodeIndex = 0;
+    float entry;
+    while (true) {
+        BVHNode const &node = queries.instanceNodes[nodeIndex];
+        if (rayEntersBounds(node, ray.origin, inverseDirection, ray.maxDistance, entry)) {
+            if (node.triangleCount == 0) {
+                stack[stackSize++] = node.firstOrRight;
+                nodeIndex++;
+                continue;
+            }
+            for (unsigned int i = node.firstOrRight; i < node.firstOrRight + node.triangleCount; i++) {
+                QueryInstance const &instance = queries.instances[queries.instanceOrder[i]];
+                glm::vec3 origin, direction;
+                objectRay(instance, ray.origin, ray.direction, origin, direction);
+                if (meshBVHOccluded(queries.meshes[instance.mesh], origin, direction, ray.maxDistance)) {
+                    return true;
+                }
+            }
+        }
+        if (stackSize == 0) {
+            return false;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+}
+
+SceneQueryCheck checkSceneQueries(SceneQueries const &queries, unsigned int rayCount) {
+    SceneQueryCheck check = { rayCount, 0, 0, 0.0, 0.0, 0.0 };
+    if (queries.instanceNodes.empty() || rayCount == 0) {
+        return check;
+    }
+
+    // From anywhere in the scene's bounds to anywhere else in them, so most rays hit something
+    glm::vec3 boundsMin = queries.instanceNodes[0].boundsMin;
+    glm::vec3 boundsMax = queries.instanceNodes[0].boundsMax;
+    std::mt19937 random(4711);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomPoint = [&]() {
+        return boundsMin + (boundsMax - boundsMin) * glm::vec3(unit(random), unit(random), unit(random));
+    };
+    std::vector<SceneRay> rays(rayCount);
+    for (SceneRay& ray : rays) {
+        ray.origin = randomPoint();
+        ray.direction = randomPoint() - ray.origin;
+        ray.maxDistance = 2.0f;
+    }
+
+    auto microsecondsPerRay = [&](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / double(rayCount);
+    };
+    std::vector<SceneHit> hits(rayCount);
+    std::unique_ptr<bool[]> found(new bool[rayCount]);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < rayCount; i++) {
+        found[i] = castRay(queries, rays[i], hits[i]);
+    }
+    check.castRayMicroseconds = microsecondsPerRay(start);
+
+    std::vector<SceneHit> packetHits(rayCount);
+    std::unique_ptr<bool[]> packetFound(new bool[rayCount]);
+    start = std::chrono::steady_clock::now();
+    castRays(queries, rays.data(), rayCount, packetHits.data(), packetFound.get());
+    check.castRaysMicroseconds = microsecondsPerRay(start);
+
+    std::vector<float> referenceDistances(rayCount);
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < rayCount; i++) {
+        referenceDistances[i] = rays[i].maxDistance;
+        for (QueryInstance const &instance : queries.instances) {
+            glm::vec3 origin, direction;
+            objectRay(instance, rays[i].origin, rays[i].direction, origin, direction);
+            MeshHit meshHit;
+            if (intersectMeshTriangles(queries.meshes[instance.mesh], origin, direction, referenceDistances[i], meshHit)) {
+                referenceDistances[i] = meshHit.distance;
+            }
+        }
+    }
+    check.bruteForceMicroseconds = microsecondsPerRay(start);
+
+    // Distances are compared rather than nodes, two instances may touch at the hit
+    for (unsigned int i = 0; i < rayCount; i++) {
+        bool referenceFound = referenceDistances[i] < rays[i].maxDistance;
+        float tolerance = 1e-5f * rays[i].maxDistance;
+        bool agrees = found[i] == referenceFound && packetFound[i] == referenceFound
+                   && sceneRayOccluded(queries, rays[i]) == referenceFound;
+        if (agrees && referenceFound) {
+            agrees = std::abs(hits[i].distance - referenceDistances[i]) <= tolerance
+                  && std::abs(packetHits[i].distance - referenceDistances[i]) <= tolerance;
+        }
+        check.hits += referenceFound;
+        check.mismatches += !agrees;
+    }
+    return check;
+}
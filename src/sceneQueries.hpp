@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <utilities/mesh.h>
+#include <vector>
+
+#include "meshBVH.hpp"
+#include "sceneGraph.hpp"
+
+// Distances are in units of the direction's length, which need not be normalized
+struct SceneRay {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float maxDistance;
+};
+
+struct SceneHit {
+    SceneNode* node;
+    float distance;
+    glm::vec3 position;     // world space
+    glm::vec3 normal;       // world space, of the triangle, facing the ray
+    unsigned int triangle;  // the mesh's triangle number
+};
+
+// A node with a query mesh and its transforms at the last update
+struct QueryInstance {
+    SceneNode* node;
+    int mesh;
+    glm::mat4 objectToWorld;
+    glm::mat4 worldToObject;
+};
+
+// Ray queries against the scene graph's geometry on the CPU. Every mesh has its own hierarchy
+// in its own coordinates, built once, and the instances have a hierarchy over their world
+// bounds which is rebuilt whenever the transforms are updated. Rays are carried into each
+// instance's coordinates instead of moving the triangles.
+struct SceneQueries {
+    std::vector<MeshBVH> meshes;
+    std::vector<QueryInstance> instances;
+    std::vector<BVHNode> instanceNodes;
+    std::vector<unsigned int> instanceOrder;  // leaves of instanceNodes refer to instances through this
+};
+
+// Builds the mesh's hierarchy, returns the ID for SceneNode::queryMeshID
+int addQueryMesh(SceneQueries& queries, Mesh const &mesh);
+
+// Collects the nodes with a query mesh, after updateNodeTransformations
+void updateSceneQueries(SceneQueries& queries, SceneNode* root);
+
+bool castRay(SceneQueries const &queries, SceneRay const &ray, SceneHit& hit);
+
+// Only against the given node's mesh, everything else is ignored
+bool castRayAtNode(SceneQueries const &queries, SceneNode* node, SceneRay const &ray, SceneHit& hit);
+
+// Rays four at a time, see RayPacket. Returns how many hit, found[i] tells which.
+unsigned int castRays(SceneQueries const &queries, SceneRay const* rays, unsigned int count, SceneHit* hits, bool* found);
+
+// Whether anything lies on the ray before maxDistance, for visibility between two points
+bool sceneRayOccluded(SceneQueries const &queries, SceneRay const &ray);
+
+// Outcome of checkSceneQueries, times are per ray
+struct SceneQueryCheck {
+    unsigned int rays;
+    unsigned int hits;
+    unsigned int mismatches;  // rays where a query disagreed with the brute force reference
+    double castRayMicroseconds;
+    double castRaysMicroseconds;
+    double bruteForceMicroseconds;
+};
+
+// Casts random rays through the scene's bounds with castRay, castRays and sceneRayOccluded and
+// compares them with testing every triangle of every instance, for --check-queries
+SceneQueryCheck checkSceneQueries(SceneQueries const &queries, unsigned int rayCount);
@@ -0,0 +1,53 @@
+#include "shaderVariants.hpp"
+#include <iostream>
+
+void initShaderVariants(ShaderVariants& variants, std::string const &vertexPath, std::string const &fragmentPath,
+                        std::function<void(Gloom::Shader*)> configure) {
+    variants.vertexPath = vertexPath;
+    variants.fragmentPath = fragmentPath;
+    variants.configure = configure;
+}
+
+static std::string variantKey(ShaderDefines const &defines) {
+    std::string key;
+    for (auto& define : defines) {
+        key += define.first + "=" + define.second + " ";
+    }
+    return key;
+}
+
+static ShaderVariant& findOrCompile(ShaderVariants& variants, ShaderDefines const &defines) {
+    std::string key = variantKey(defines);
+    auto existing = variants.variants.find(key);
+    if (existing != variants.variants.end()) {
+        return existing->second;
+    }
+
+    std::cout << "Compiling " << variants.fragmentPath.substr(variants.fragmentPath.rfind('/') + 1)
+              << " variant [ " << key << "]" << std::endl;
+
+    ShaderVariant& variant = variants.variants[key];
+    variant.shader = new Gloom::Shader();
+    for (auto& define : defines) {
+        variant.shader->define(define.first, define.second);
+    }
+    variant.shader->makeBasicShader(variants.vertexPath, variants.fragmentPath);
+    variant.configured = false;
+    return variant;
+}
+
+void prepareShaderVariant(ShaderVariants& variants, ShaderDefines const &defines) {
+    findOrCompile(variants, defines);
+}
+
+Gloom::Shader* getShaderVariant(ShaderVariants& variants, ShaderDefines const &defines) {
+    ShaderVariant& variant = findOrCompile(variants, defines);
+    if (!variant.configured) {
+        variant.configured = true;
+        if (variants.configure) {
+            variant.shader->activate();
+            variants.configure(variant.shader);
+        }
+    }
+    return variant.shader;
+}
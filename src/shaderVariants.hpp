@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utilities/shader.hpp>
+
+// Feature defines of one variant. Ordered, so equal sets always give the same variant.
+typedef std::map<std::string, std::string> ShaderDefines;
+
+struct ShaderVariant {
+    Gloom::Shader* shader;
+    bool configured;
+};
+
+// Permutations of one vertex/fragment pair, compiled on first request and kept for reuse.
+// Features are #if'd in the shader instead of branched on uniforms, so no variant
+// carries code for features it does not use.
+struct ShaderVariants {
+    std::string vertexPath;
+    std::string fragmentPath;
+
+    // Sets sampler units and other uniforms that never change, once per variant
+    std::function<void(Gloom::Shader*)> configure;
+
+    std::map<std::string, ShaderVariant> variants;
+};
+
+void initShaderVariants(ShaderVariants& variants, std::string const &vertexPath, std::string const &fragmentPath,
+                        std::function<void(Gloom::Shader*)> configure = nullptr);
+
+// Starts compiling a variant without waiting for it, for variants known to be needed at startup
+void prepareShaderVariant(ShaderVariants& variants, ShaderDefines const &defines);
+
+// Returns the variant ready for use, compiling it first if this is the first request
+Gloom::Shader* getShaderVariant(ShaderVariants& variants, ShaderDefines const &defines);
@@ -0,0 +1,163 @@
+#include "shadowMaps.hpp"
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <utilities/hashing.hpp>
+
+// Look direction and up vector of each cube map face, in GL face order
+static const glm::vec3 faceDirections[6] = {
+    { 1.0f,  0.0f,  0.0f}, {-1.0f,  0.0f,  0.0f},
+    { 0.0f,  1.0f,  0.0f}, { 0.0f, -1.0f,  0.0f},
+    { 0.0f,  0.0f,  1.0f}, { 0.0f,  0.0f, -1.0f}
+};
+static const glm::vec3 faceUps[6] = {
+    { 0.0f, -1.0f,  0.0f}, { 0.0f, -1.0f,  0.0f},
+    { 0.0f,  0.0f,  1.0f}, { 0.0f,  0.0f, -1.0f},
+    { 0.0f, -1.0f,  0.0f}, { 0.0f, -1.0f,  0.0f}
+};
+
+static unsigned int createCubeArray() {
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, textureID);
+    glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 1, GL_DEPTH_COMPONENT32F, shadowMapSize, shadowMapSize, 6 * maxShadowCastingLights);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Hardware depth comparison, gives 2x2 PCF for free with linear filtering
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    return textureID;
+}
+
+void initShadowMaps(ShadowMaps& shadowMaps) {
+    shadowMaps.staticCubeArray = createCubeArray();
+    shadowMaps.cubeArray = createCubeArray();
+
+    glGenFramebuffers(1, &shadowMaps.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, shadowMaps.framebuffer);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    shadowMaps.shader = new Gloom::Shader();
+    shadowMaps.shader->makeBasicShader("../res/shaders/shadow.vert", "../res/shaders/shadow.frag");
+
+    for (unsigned int slot = 0; slot < maxShadowCastingLights; slot++) {
+        shadowMaps.cacheValid[slot] = false;
+        shadowMaps.hasDynamicGeometry[slot] = false;
+    }
+    shadowMaps.staticSceneHash = 0;
+    shadowMaps.staticRenders = 0;
+    shadowMaps.dynamicRenders = 0;
+}
+
+// FNV-1a over the transforms of all static geometry, so moving any of it invalidates the caches
+static void hashStaticGeometry(SceneNode* node, size_t& hash) {
+    if (node->nodeType != POINT_LIGHT && !node->isDynamic && node->vertexArrayObjectID != -1) {
+        hash = hashValue(hash, node->modelMatrix);
+        hash = hashValue(hash, node->vertexArrayObjectID);
+    }
+
+    for (SceneNode* child : node->children) {
+        hashStaticGeometry(child, hash);
+    }
+}
+
+static bool containsDynamicGeometry(SceneNode* node) {
+    if (node->nodeType != POINT_LIGHT && node->isDynamic && node->vertexArrayObjectID != -1) {
+        return true;
+    }
+    for (SceneNode* child : node->children) {
+        if (containsDynamicGeometry(child)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Nodes with bounds beyond the light's reach cast nothing into its cube
+static void renderShadowCasters(SceneNode* node, glm::mat4 lightTransformation, glm::vec4 positionRadius, bool dynamicGeometry) {
+    if (node->nodeType != POINT_LIGHT && node->isDynamic == dynamicGeometry && node->vertexArrayObjectID != -1
+        && !nodeOutsideSphere(node, glm::vec3(positionRadius), positionRadius.w)) {
+        glm::mat4 MVP = lightTransformation * node->modelMatrix;
+        glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(MVP));
+        glUniformMatrix4fv(4, 1, GL_FALSE, glm::value_ptr(node->modelMatrix));
+
+        glBindVertexArray(node->vertexArrayObjectID);
+        glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, nullptr);
+    }
+
+    for (SceneNode* child : node->children) {
+        renderShadowCasters(child, lightTransformation, positionRadius, dynamicGeometry);
+    }
+}
+
+// Renders either the static or the dynamic casters into the six faces of one slot
+static void renderCube(ShadowMaps& shadowMaps, SceneNode* rootNode, unsigned int textureID, unsigned int slot,
+                       glm::vec4 positionRadius, bool dynamicGeometry) {
+    glm::vec3 lightPosition = glm::vec3(positionRadius);
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, positionRadius.w);
+
+    glUniform3fv(shadowMaps.shader->getUniformFromName("light_position"), 1, glm::value_ptr(lightPosition));
+    glUniform1f(shadowMaps.shader->getUniformFromName("light_radius"), positionRadius.w);
+
+    for (unsigned int face = 0; face < 6; face++) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureID, 0, slot * 6 + face);
+        if (!dynamicGeometry) {
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+
+        glm::mat4 view = glm::lookAt(lightPosition, lightPosition + faceDirections[face], faceUps[face]);
+        renderShadowCasters(rootNode, projection * view, positionRadius, dynamicGeometry);
+    }
+}
+
+void renderShadowMaps(ShadowMaps& shadowMaps, SceneNode* rootNode, std::vector<ClusterLight>& lights) {
+    size_t staticSceneHash = hashSeed;
+    hashStaticGeometry(rootNode, staticSceneHash);
+    if (staticSceneHash != shadowMaps.staticSceneHash) {
+        shadowMaps.staticSceneHash = staticSceneHash;
+        for (unsigned int slot = 0; slot < maxShadowCastingLights; slot++) {
+            shadowMaps.cacheValid[slot] = false;
+        }
+    }
+    bool dynamicGeometry = containsDynamicGeometry(rootNode);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, shadowMaps.framebuffer);
+    glViewport(0, 0, shadowMapSize, shadowMapSize);
+    glEnable(GL_DEPTH_TEST);
+    shadowMaps.shader->activate();
+
+    for (ClusterLight& light : lights) {
+        if (light.color.w < 0.0f) {
+            continue;
+        }
+        unsigned int slot = (unsigned int) light.color.w;
+        bool staticChanged = !shadowMaps.cacheValid[slot] || shadowMaps.cachedPositionRadius[slot] != light.positionRadius;
+
+        if (staticChanged) {
+            renderCube(shadowMaps, rootNode, shadowMaps.staticCubeArray, slot, light.positionRadius, false);
+            shadowMaps.cachedPositionRadius[slot] = light.positionRadius;
+            shadowMaps.cacheValid[slot] = true;
+            shadowMaps.staticRenders++;
+        }
+
+        // The sampled cube map only needs refreshing if the cache changed or dynamic geometry was drawn into it
+        if (staticChanged || dynamicGeometry || shadowMaps.hasDynamicGeometry[slot]) {
+            glCopyImageSubData(shadowMaps.staticCubeArray, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, slot * 6,
+                               shadowMaps.cubeArray, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, slot * 6,
+                               shadowMapSize, shadowMapSize, 6);
+        }
+
+        if (dynamicGeometry) {
+            renderCube(shadowMaps, rootNode, shadowMaps.cubeArray, slot, light.positionRadius, true);
+            shadowMaps.dynamicRenders++;
+        }
+        shadowMaps.hasDynamicGeometry[slot] = dynamicGeometry;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <utilities/shader.hpp>
+
+#include "sceneGraph.hpp"
+#include "lightClusters.hpp"
+
+// Resolution of every cube map face
+const unsigned int shadowMapSize = 1024;
+
+// Texture unit lighting.frag samples the shadow cube maps from
+const unsigned int shadowMapTextureUnit = 3;
+
+// Omnidirectional shadows for point lights. Static geometry is rendered into a
+// cached cube map only when the light or the static geometry changes; each frame
+// the cache is copied into the sampled cube map and only dynamic nodes are drawn on top.
+struct ShadowMaps {
+    unsigned int staticCubeArray;  // static geometry only, one cube per shadow slot
+    unsigned int cubeArray;        // static + dynamic, sampled by lighting.frag
+    unsigned int framebuffer;
+    Gloom::Shader* shader;
+
+    // What the static cache of each slot was rendered with
+    bool cacheValid[maxShadowCastingLights];
+    glm::vec4 cachedPositionRadius[maxShadowCastingLights];
+    size_t staticSceneHash;
+
+    // Whether the sampled cube map of each slot still holds dynamic geometry
+    bool hasDynamicGeometry[maxShadowCastingLights];
+
+    // Number of cube maps redrawn, for comparing cached and uncached rendering
+    unsigned int staticRenders;
+    unsigned int dynamicRenders;
+};
+
+void initShadowMaps(ShadowMaps& shadowMaps);
+void renderShadowMaps(ShadowMaps& shadowMaps, SceneNode* rootNode, std::vector<ClusterLight>& lights);
@@ -0,0 +1,92 @@
+#include "silhouetteLines.hpp"
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+
+// Threads per work group in silhouettes.comp
+static const unsigned int extractGroupSize = 64;
+
+// Every edge can produce at most one segment per instance
+static unsigned int totalEdgeCount(SceneNode* node) {
+    unsigned int count = node->edgeBufferID != -1 ? node->edgeCount : 0;
+    for (SceneNode* child : node->children) {
+        count += totalEdgeCount(child);
+    }
+    return count;
+}
+
+void initSilhouetteLines(SilhouetteLines& lines, SceneNode* rootNode, float lineWidth) {
+    lines.lineWidth = lineWidth;
+    lines.maxSegments = totalEdgeCount(rootNode);
+
+    lines.extractShader = new Gloom::Shader();
+    lines.extractShader->attach("../res/shaders/silhouettes.comp");
+    lines.extractShader->link();
+
+    lines.lineShader = new Gloom::Shader();
+    lines.lineShader->makeBasicShader("../res/shaders/lines.vert", "../res/shaders/lines.frag");
+
+    // Two vec4 endpoints per segment
+    glGenBuffers(1, &lines.segmentBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lines.segmentBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(lines.maxSegments, 1u) * 2 * sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &lines.drawCommandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lines.drawCommandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+
+    glGenVertexArrays(1, &lines.emptyVAO);
+}
+
+static void extractSilhouettes(SceneNode* node, glm::vec3 cameraPosition) {
+    if (node->nodeType != POINT_LIGHT && node->edgeBufferID != -1 && node->edgeCount > 0) {
+        // Facing tests happen in object space, so the edge buffers never need transforming
+        glm::vec3 objectCamera = glm::vec3(glm::inverse(node->modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+
+        glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(node->modelMatrix));
+        glUniform3fv(1, 1, glm::value_ptr(objectCamera));
+        glUniform1ui(2, node->edgeCount);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, edgeBufferBinding, node->edgeBufferID);
+        glDispatchCompute((node->edgeCount + extractGroupSize - 1) / extractGroupSize, 1, 1);
+    }
+
+    for (SceneNode* child : node->children) {
+        extractSilhouettes(child, cameraPosition);
+    }
+}
+
+// Draws into the currently bound framebuffer, depth tested against the scene
+void renderSilhouetteLines(SilhouetteLines& lines, SceneNode* rootNode, glm::mat4 viewProjection,
+                           glm::vec3 cameraPosition, int width, int height) {
+    // Zero vertices, one instance
+    GLuint resetCommand[4] = { 0, 1, 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lines.drawCommandBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(resetCommand), resetCommand);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, segmentBufferBinding, lines.segmentBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, lineDrawCommandBinding, lines.drawCommandBuffer);
+
+    lines.extractShader->activate();
+    extractSilhouettes(rootNode, cameraPosition);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    lines.lineShader->activate();
+    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform2f(1, float(width), float(height));
+    glUniform1f(2, lines.lineWidth);
+    glUniform3fv(3, 1, glm::value_ptr(cameraPosition));
+
+    // Lines test against the scene but do not occlude each other
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+
+    glBindVertexArray(lines.emptyVAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, lines.drawCommandBuffer);
+    glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <utilities/shader.hpp>
+
+#include "sceneGraph.hpp"
+
+// Shader storage binding points, after the light culling buffers
+const unsigned int edgeBufferBinding        = 3;
+const unsigned int segmentBufferBinding     = 4;
+const unsigned int lineDrawCommandBinding   = 5;
+
+// Resolution independent ink lines from mesh geometry. A compute pass tests the
+// precomputed edges of every node against the camera and appends silhouette,
+// crease and boundary edges as world space segments, which are then drawn as
+// screen space quads of a fixed pixel width with one indirect draw.
+struct SilhouetteLines {
+    Gloom::Shader* extractShader;
+    Gloom::Shader* lineShader;
+
+    unsigned int segmentBuffer;
+    unsigned int drawCommandBuffer;  // DrawArraysIndirectCommand, count written by the compute pass
+    unsigned int emptyVAO;           // segments are pulled from the storage buffer
+
+    unsigned int maxSegments;
+    float lineWidth;
+};
+
+void initSilhouetteLines(SilhouetteLines& lines, SceneNode* rootNode, float lineWidth);
+void renderSilhouetteLines(SilhouetteLines& lines, SceneNode* rootNode, glm::mat4 viewProjection,
+                           glm::vec3 cameraPosition, int width, int height);
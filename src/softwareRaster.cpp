@@ -0,0 +1,749 @@
+#include "softwareRaster.hpp"
+#include "outlineKernel.hpp"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utilities/tonalArtMap.hpp>
+#include <utilities/window.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Hatch tiles per unit of texture coordinates, hatch_scale in simple.frag
+static const float hatchScale = 8.0f;
+
+// simple.frag linearizes depth with its own planes, the outline thresholds are tuned to them
+static const float linearDepthNear = 0.1f;
+static const float linearDepthFar = 100.0f;
+
+// The normals are sampled with a jitter from value noise, outlineNoiseScale cells across the screen each way
+static const int noiseLattice = 11;
+
+struct ClipVertex {
+    glm::vec4 clip;
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 textureCoordinates;
+    float ambientOcclusion;
+};
+
+static unsigned int packColor(glm::vec3 color) {
+    glm::vec3 scaled = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+    return unsigned(scaled.x) | unsigned(scaled.y) << 8 | unsigned(scaled.z) << 16 | 0xFF000000u;
+}
+
+static glm::vec3 unpackColor(unsigned int color) {
+    return glm::vec3(color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF) / 255.0f;
+}
+
+static float fract(float value) {
+    return value - std::floor(value);
+}
+
+static float smoothstep(float edge0, float edge1, float value) {
+    float t = glm::clamp((value - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+void initSoftwareRasterizer(SoftwareRasterizer& rasterizer, unsigned int threadCount, float outlineWidthNear, float outlineWidthFar,
+                            float edgeThreshold, float depthEdgeScale, int hatchingStyle) {
+    initWorkerPool(rasterizer.workers, threadCount);
+    rasterizer.outlineWidthNear = outlineWidthNear;
+    rasterizer.outlineWidthFar = outlineWidthFar;
+    rasterizer.edgeThreshold = edgeThreshold;
+    rasterizer.depthEdgeScale = depthEdgeScale;
+    rasterizer.hatchingStyle = hatchingStyle;
+    rasterizer.tonalArtMap = buildTonalArtMapLevels();
+    rasterizer.outlineNoise.resize(noiseLattice * noiseLattice);
+    for (int y = 0; y < noiseLattice; y++) {
+        for (int x = 0; x < noiseLattice; x++) {
+            rasterizer.outlineNoise[y * noiseLattice + x] = outlineNoiseHash(float(x), float(y));
+        }
+    }
+    rasterizer.tileCountX = 0;
+    rasterizer.tileCountY = 0;
+    rasterizer.width = 0;
+    rasterizer.height = 0;
+    rasterizer.rowStride = 0;
+    rasterizer.presentTexture = 0;
+    rasterizer.presentFramebuffer = 0;
+    rasterizer.presentWidth = 0;
+    rasterizer.presentHeight = 0;
+    rasterizer.trianglesBinned = 0;
+}
+
+void addRasterMesh(SoftwareRasterizer& rasterizer, int vertexArrayObjectID, Mesh const &mesh) {
+    RasterMesh& rasterMesh = rasterizer.meshes[vertexArrayObjectID];
+    rasterMesh.positions = mesh.vertices;
+    rasterMesh.normals = mesh.normals;
+    rasterMesh.textureCoordinates = mesh.textureCoordinates;
+    rasterMesh.ambientOcclusion = mesh.ambientOcclusion;
+    rasterMesh.indices = mesh.indices;
+
+    // Missing attributes read as zero, like a disabled vertex attribute
+    rasterMesh.normals.resize(mesh.vertices.size(), glm::vec3(0.0f));
+    rasterMesh.textureCoordinates.resize(mesh.vertices.size(), glm::vec2(0.0f));
+    // except ambient occlusion, which generateBuffer fills with 1 for meshes without a bake
+    rasterMesh.ambientOcclusion.resize(mesh.vertices.size(), 1.0f);
+}
+
+void addRasterTexture(SoftwareRasterizer& rasterizer, unsigned int textureID,
+                      unsigned int width, unsigned int height, std::vector<unsigned char> const &pixels) {
+    RasterTexture& texture = rasterizer.textures[textureID];
+    texture.widths = { int(width) };
+    texture.heights = { int(height) };
+    texture.levels = { pixels };
+
+    // Box filtered like glGenerateMipmap, an odd row or column is clamped
+    while (texture.widths.back() > 1 || texture.heights.back() > 1) {
+        int sourceWidth = texture.widths.back();
+        int sourceHeight = texture.heights.back();
+        int levelWidth = std::max(sourceWidth / 2, 1);
+        int levelHeight = std::max(sourceHeight / 2, 1);
+        const std::vector<unsigned char>& source = texture.levels.back();
+        std::vector<unsigned char> level(size_t(levelWidth) * levelHeight * 4);
+        for (int y = 0; y < levelHeight; y++) {
+            for (int x = 0; x < levelWidth; x++) {
+                for (int channel = 0; channel < 4; channel++) {
+                    unsigned int sum = 0;
+                    for (int corner = 0; corner < 4; corner++) {
+                        int sourceX = std::min(2 * x + (corner & 1), sourceWidth - 1);
+                        int sourceY = std::min(2 * y + (corner >> 1), sourceHeight - 1);
+                        sum += source[(size_t(sourceY) * sourceWidth + sourceX) * 4 + channel];
+                    }
+                    level[(size_t(y) * levelWidth + x) * 4 + channel] = (unsigned char) ((sum + 2) / 4);
+                }
+            }
+        }
+        texture.widths.push_back(levelWidth);
+        texture.heights.push_back(levelHeight);
+        texture.levels.push_back(std::move(level));
+    }
+}
+
+static void resizeRasterizer(SoftwareRasterizer& rasterizer, int width, int height) {
+    if (width == rasterizer.width && height == rasterizer.height) {
+        return;
+    }
+    rasterizer.width = width;
+    rasterizer.height = height;
+    rasterizer.rowStride = (width + 3) & ~3;
+    rasterizer.tileCountX = (width + rasterTileSize - 1) / rasterTileSize;
+    rasterizer.tileCountY = (height + rasterTileSize - 1) / rasterTileSize;
+    rasterizer.tileBins.assign(rasterizer.tileCountX * rasterizer.tileCountY, {});
+
+    size_t pixelCount = size_t(rasterizer.rowStride) * height;
+    rasterizer.depth.assign(pixelCount, 1.0f);
+    rasterizer.linearDepth.assign(pixelCount, 0.0f);
+    rasterizer.normals.assign(pixelCount, glm::vec3(0.0f));
+    rasterizer.positions.assign(pixelCount, glm::vec3(0.0f));
+    rasterizer.hatchCoordinates.assign(pixelCount, glm::vec4(0.0f));
+    rasterizer.albedo.assign(pixelCount, 0);
+    rasterizer.objectIDs.assign(pixelCount, 0);
+    rasterizer.outlineSeeds.assign(pixelCount, 0);
+    rasterizer.color.assign(pixelCount * 4, 255);
+}
+
+static void collectDraws(SoftwareRasterizer& rasterizer, SceneNode* node) {
+    if (node->nodeType != POINT_LIGHT && node->vertexArrayObjectID != -1) {
+        auto mesh = rasterizer.meshes.find(node->vertexArrayObjectID);
+        if (mesh != rasterizer.meshes.end()) {
+            RasterDraw draw;
+            draw.mesh = &mesh->second;
+            draw.texture = nullptr;
+            if (node->nodeType == TEXTURE_MAP) {
+                auto texture = rasterizer.textures.find(node->textureID);
+                draw.texture = texture != rasterizer.textures.end() ? &texture->second : nullptr;
+            }
+            draw.modelViewProjection = node->currentTransformationMatrix;
+            draw.modelMatrix = node->modelMatrix;
+            draw.normalMatrix = glm::mat3(glm::transpose(glm::inverse(node->modelMatrix)));
+            draw.objectID = node->objectID;
+            rasterizer.draws.push_back(draw);
+        }
+    }
+    for (SceneNode* child : node->children) {
+        collectDraws(rasterizer, child);
+    }
+}
+
+// Triangle setup in window coordinates, back faces are culled like GL_CULL_FACE
+static void setupTriangle(SoftwareRasterizer& rasterizer, const ClipVertex* vertices[3], unsigned int draw,
+                          std::vector<RasterTriangle>& triangles) {
+    float x[3], y[3];
+    RasterTriangle triangle;
+    for (int i = 0; i < 3; i++) {
+        float inverseW = 1.0f / vertices[i]->clip.w;
+        x[i] = (vertices[i]->clip.x * inverseW * 0.5f + 0.5f) * float(rasterizer.width);
+        y[i] = (vertices[i]->clip.y * inverseW * 0.5f + 0.5f) * float(rasterizer.height);
+        triangle.depth[i] = vertices[i]->clip.z * inverseW * 0.5f + 0.5f;
+        triangle.inverseW[i] = inverseW;
+        triangle.positions[i] = vertices[i]->position;
+        triangle.normals[i] = vertices[i]->normal;
+        triangle.textureCoordinates[i] = vertices[i]->textureCoordinates;
+        triangle.ambientOcclusion[i] = vertices[i]->ambientOcclusion;
+    }
+
+    // Counter-clockwise with y up is front facing
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!(area > 0.0f)) {
+        return;
+    }
+
+    // Pixel centers inside the bounds, clamped before converting so far off screen vertices cannot overflow
+    float maxX = float(rasterizer.width - 1), maxY = float(rasterizer.height - 1);
+    triangle.minX = int(std::ceil(glm::clamp(std::min({ x[0], x[1], x[2] }) - 0.5f, 0.0f, maxX + 1.0f)));
+    triangle.maxX = int(std::floor(glm::clamp(std::max({ x[0], x[1], x[2] }) - 0.5f, -1.0f, maxX)));
+    triangle.minY = int(std::ceil(glm::clamp(std::min({ y[0], y[1], y[2] }) - 0.5f, 0.0f, maxY + 1.0f)));
+    triangle.maxY = int(std::floor(glm::clamp(std::max({ y[0], y[1], y[2] }) - 0.5f, -1.0f, maxY)));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return;
+    }
+
+    // Barycentric i is the edge function of the edge opposite vertex i, divided by the area
+    triangle.topLeftEdges = 0;
+    for (int i = 0; i < 3; i++) {
+        int a = (i + 1) % 3, b = (i + 2) % 3;
+        float dx = x[b] - x[a], dy = y[b] - y[a];
+        triangle.edgeA[i] = -dy / area;
+        triangle.edgeB[i] = dx / area;
+        triangle.edgeC[i] = (dy * x[a] - dx * y[a]) / area;
+        // The interior lies to the left, so left edges run down and top edges run left
+        if (dy < 0.0f || (dy == 0.0f && dx < 0.0f)) {
+            triangle.topLeftEdges |= 1u << i;
+        }
+    }
+    triangle.draw = draw;
+    triangles.push_back(triangle);
+}
+
+static ClipVertex lerpVertex(ClipVertex const &a, ClipVertex const &b, float t) {
+    ClipVertex vertex;
+    vertex.clip = glm::mix(a.clip, b.clip, t);
+    vertex.position = glm::mix(a.position, b.position, t);
+    vertex.normal = glm::mix(a.normal, b.normal, t);
+    vertex.textureCoordinates = glm::mix(a.textureCoordinates, b.textureCoordinates, t);
+    vertex.ambientOcclusion = a.ambientOcclusion + (b.ambientOcclusion - a.ambientOcclusion) * t;
+    return vertex;
+}
+
+static bool outsidePlane(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, int axis, float sign) {
+    return sign * a.clip[axis] > a.clip.w && sign * b.clip[axis] > b.clip.w && sign * c.clip[axis] > c.clip.w;
+}
+
+// Transforms one draw and sets up its triangles, clipping against the near plane
+static void setupDraw(SoftwareRasterizer& rasterizer, unsigned int drawIndex) {
+    const RasterDraw& draw = rasterizer.draws[drawIndex];
+    const RasterMesh& mesh = *draw.mesh;
+    std::vector<RasterTriangle>& triangles = rasterizer.drawTriangles[drawIndex];
+    triangles.clear();
+
+    std::vector<ClipVertex> vertices(mesh.positions.size());
+    for (size_t i = 0; i < mesh.positions.size(); i++) {
+        glm::vec4 position = glm::vec4(mesh.positions[i], 1.0f);
+        glm::vec3 normal = draw.normalMatrix * mesh.normals[i];
+        float length = glm::length(normal);
+        vertices[i].clip = draw.modelViewProjection * position;
+        vertices[i].position = glm::vec3(draw.modelMatrix * position);
+        vertices[i].normal = length > 0.0f ? normal / length : normal;
+        vertices[i].textureCoordinates = mesh.textureCoordinates[i];
+        vertices[i].ambientOcclusion = mesh.ambientOcclusion[i];
+    }
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        const ClipVertex& a = vertices[mesh.indices[i]];
+        const ClipVertex& b = vertices[mesh.indices[i + 1]];
+        const ClipVertex& c = vertices[mesh.indices[i + 2]];
+        if (outsidePlane(a, b, c, 0, 1.0f) || outsidePlane(a, b, c, 0, -1.0f) ||
+            outsidePlane(a, b, c, 1, 1.0f) || outsidePlane(a, b, c, 1, -1.0f) || outsidePlane(a, b, c, 2, 1.0f)) {
+            continue;
+        }
+
+        const ClipVertex* corners[3] = { &a, &b, &c };
+        bool behindNear = false;
+        for (const ClipVertex* corner : corners) {
+            behindNear = behindNear || corner->clip.z < -corner->clip.w;
+        }
+        if (!behindNear) {
+            setupTriangle(rasterizer, corners, drawIndex, triangles);
+            continue;
+        }
+
+        // Sutherland-Hodgman against z = -w, leaves a fan of at most two triangles
+        ClipVertex clipped[4];
+        int clippedCount = 0;
+        for (int j = 0; j < 3; j++) {
+            const ClipVertex& current = *corners[j];
+            const ClipVertex& next = *corners[(j + 1) % 3];
+            float currentDistance = current.clip.z + current.clip.w;
+            float nextDistance = next.clip.z + next.clip.w;
+            if (currentDistance >= 0.0f) {
+                clipped[clippedCount++] = current;
+            }
+            if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f)) {
+                clipped[clippedCount++] = lerpVertex(current, next, currentDistance / (currentDistance - nextDistance));
+            }
+        }
+        for (int j = 1; j + 1 < clippedCount; j++) {
+            const ClipVertex* fan[3] = { &clipped[0], &clipped[j], &clipped[j + 1] };
+            setupTriangle(rasterizer, fan, drawIndex, triangles);
+        }
+    }
+}
+
+// GL_NEAREST_MIPMAP_NEAREST with repeat wrapping
+static unsigned int sampleTexture(const RasterTexture& texture, glm::vec2 uv, glm::vec2 uvDx, glm::vec2 uvDy) {
+    glm::vec2 size = glm::vec2(texture.widths[0], texture.heights[0]);
+    float rho = std::max(glm::length(uvDx * size), glm::length(uvDy * size));
+    float lod = std::log2(rho);
+    int level = 0;
+    if (lod > 0.5f) {
+        level = std::min(int(std::ceil(lod + 0.5f)) - 1, int(texture.levels.size()) - 1);
+    }
+    int width = texture.widths[level], height = texture.heights[level];
+    int x = int(std::floor(uv.x * width)) % width;
+    int y = int(std::floor(uv.y * height)) % height;
+    x += x < 0 ? width : 0;
+    y += y < 0 ? height : 0;
+    const unsigned char* texel = &texture.levels[level][(size_t(y) * width + x) * 4];
+    return unsigned(texel[0]) | unsigned(texel[1]) << 8 | unsigned(texel[2]) << 16 | unsigned(texel[3]) << 24;
+}
+
+// Interpolates the attributes of a covered pixel into the G-buffer, what simple.frag writes
+static void shadeFragment(SoftwareRasterizer& rasterizer, const RasterTriangle& triangle, size_t pixel, float depth,
+                          float barycentric0, float barycentric1, float barycentric2) {
+    const RasterDraw& draw = rasterizer.draws[triangle.draw];
+
+    // Perspective correct weights, and the screen space derivatives of the texture coordinates
+    float weights[3] = {
+        barycentric0 * triangle.inverseW[0], barycentric1 * triangle.inverseW[1], barycentric2 * triangle.inverseW[2]
+    };
+    float weightSum = weights[0] + weights[1] + weights[2];
+    glm::vec3 position(0.0f), normal(0.0f);
+    glm::vec2 uv(0.0f), uvDx(0.0f), uvDy(0.0f);
+    float ambientOcclusion = 0.0f;
+    float weightDx = 0.0f, weightDy = 0.0f;
+    for (int i = 0; i < 3; i++) {
+        float weight = weights[i] / weightSum;
+        position += weight * triangle.positions[i];
+        normal += weight * triangle.normals[i];
+        uv += weight * triangle.textureCoordinates[i];
+        ambientOcclusion += weight * triangle.ambientOcclusion[i];
+        uvDx += triangle.edgeA[i] * triangle.inverseW[i] * triangle.textureCoordinates[i];
+        uvDy += triangle.edgeB[i] * triangle.inverseW[i] * triangle.textureCoordinates[i];
+        weightDx += triangle.edgeA[i] * triangle.inverseW[i];
+        weightDy += triangle.edgeB[i] * triangle.inverseW[i];
+    }
+    uvDx = (uvDx - uv * weightDx) / weightSum;
+    uvDy = (uvDy - uv * weightDy) / weightSum;
+
+    float normalLength = glm::length(normal);
+    rasterizer.depth[pixel] = depth;
+    rasterizer.normals[pixel] = normalLength > 0.0f ? normal / normalLength : normal;
+    rasterizer.positions[pixel] = position;
+    rasterizer.albedo[pixel] = draw.texture ? sampleTexture(*draw.texture, uv, uvDx, uvDy) : 0xFFFFFFFFu;
+    rasterizer.objectIDs[pixel] = (unsigned short) draw.objectID;
+
+    // Mip level of the tonal art map, as textureQueryLod would pick it
+    float hatchRho = std::max(glm::length(uvDx), glm::length(uvDy)) * hatchScale * float(tonalArtMapSize);
+    rasterizer.hatchCoordinates[pixel] = glm::vec4(glm::vec3(uv * hatchScale, std::log2(hatchRho)), ambientOcclusion);
+
+    float ndcDepth = depth * 2.0f - 1.0f;
+    rasterizer.linearDepth[pixel] = (2.0f * linearDepthNear * linearDepthFar)
+        / (linearDepthFar + linearDepthNear - ndcDepth * (linearDepthFar - linearDepthNear)) / linearDepthFar;
+}
+
+static void clearTile(SoftwareRasterizer& rasterizer, int x0, int y0, int x1, int y1) {
+    // glClear writes the clear color to every color attachment, the lighting and outline passes see it
+    glm::vec3 clearNormal = glm::normalize(rasterClearColor * 2.0f - 1.0f);
+    unsigned int clearAlbedo = packColor(rasterClearColor);
+    for (int y = y0; y <= y1; y++) {
+        size_t row = size_t(y) * rasterizer.rowStride;
+        std::fill(&rasterizer.depth[row + x0], &rasterizer.depth[row + x1] + 1, 1.0f);
+        std::fill(&rasterizer.linearDepth[row + x0], &rasterizer.linearDepth[row + x1] + 1, rasterClearColor.x);
+        std::fill(&rasterizer.normals[row + x0], &rasterizer.normals[row + x1] + 1, clearNormal);
+        std::fill(&rasterizer.hatchCoordinates[row + x0], &rasterizer.hatchCoordinates[row + x1] + 1, glm::vec4(rasterClearColor, 1.0f));
+        std::fill(&rasterizer.albedo[row + x0], &rasterizer.albedo[row + x1] + 1, clearAlbedo);
+        std::fill(&rasterizer.objectIDs[row + x0], &rasterizer.objectIDs[row + x1] + 1, 0);
+    }
+}
+
+static void rasterizeTile(SoftwareRasterizer& rasterizer, int tile) {
+    int tileX = (tile % rasterizer.tileCountX) * rasterTileSize;
+    int tileY = (tile / rasterizer.tileCountX) * rasterTileSize;
+    int tileMaxX = std::min(tileX + rasterTileSize, rasterizer.width) - 1;
+    int tileMaxY = std::min(tileY + rasterTileSize, rasterizer.height) - 1;
+    clearTile(rasterizer, tileX, tileY, tileMaxX, tileMaxY);
+
+    for (const RasterTriangle* triangle : rasterizer.tileBins[tile]) {
+        // Groups of four start on a multiple of four, tiles do too, so a group never leaves the tile
+        int x0 = std::max(triangle->minX, tileX) & ~3;
+        int x1 = std::min(triangle->maxX, tileMaxX);
+        int y0 = std::max(triangle->minY, tileY);
+        int y1 = std::min(triangle->maxY, tileMaxY);
+
+        // Depth is close to 1 for distant surfaces and the linear depth amplifies its errors, so it is
+        // interpolated as offsets from the first vertex rather than as a weighted sum of three
+#ifdef SOFTWARE_RASTER_SSE2
+        const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        __m128 edgeA[3], topLeft[3];
+        for (int i = 0; i < 3; i++) {
+            edgeA[i] = _mm_set1_ps(triangle->edgeA[i]);
+            topLeft[i] = _mm_castsi128_ps(_mm_set1_epi32((triangle->topLeftEdges >> i) & 1 ? -1 : 0));
+        }
+        const __m128 baseDepth = _mm_set1_ps(triangle->depth[0]);
+        const __m128 depthDelta1 = _mm_set1_ps(triangle->depth[1] - triangle->depth[0]);
+        const __m128 depthDelta2 = _mm_set1_ps(triangle->depth[2] - triangle->depth[0]);
+#else
+        float depthDelta[3] = { 0.0f, triangle->depth[1] - triangle->depth[0], triangle->depth[2] - triangle->depth[0] };
+#endif
+        for (int y = y0; y <= y1; y++) {
+            float centerY = float(y) + 0.5f;
+            size_t row = size_t(y) * rasterizer.rowStride;
+            float rowEdge[3];
+            for (int i = 0; i < 3; i++) {
+                rowEdge[i] = triangle->edgeB[i] * centerY + triangle->edgeC[i];
+            }
+
+            for (int x = x0; x <= x1; x += 4) {
+#ifdef SOFTWARE_RASTER_SSE2
+                __m128 centerX = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+                __m128 barycentric[3];
+                __m128 covered = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int i = 0; i < 3; i++) {
+                    barycentric[i] = _mm_add_ps(_mm_mul_ps(edgeA[i], centerX), _mm_set1_ps(rowEdge[i]));
+                    __m128 inside = _mm_or_ps(_mm_cmpgt_ps(barycentric[i], zero),
+                                              _mm_and_ps(_mm_cmpeq_ps(barycentric[i], zero), topLeft[i]));
+                    covered = _mm_and_ps(covered, inside);
+                }
+                __m128 depth = _mm_add_ps(baseDepth, _mm_add_ps(_mm_mul_ps(barycentric[1], depthDelta1),
+                                                                _mm_mul_ps(barycentric[2], depthDelta2)));
+                // GL_LESS against the stored depth, and the far plane
+                __m128 stored = _mm_loadu_ps(&rasterizer.depth[row + x]);
+                covered = _mm_and_ps(covered, _mm_and_ps(_mm_cmplt_ps(depth, stored), _mm_cmple_ps(depth, one)));
+                int mask = _mm_movemask_ps(covered);
+                if (mask == 0) {
+                    continue;
+                }
+                float depths[4], lanes[3][4];
+                _mm_storeu_ps(depths, depth);
+                for (int i = 0; i < 3; i++) {
+                    _mm_storeu_ps(lanes[i], barycentric[i]);
+                }
+                for (int lane = 0; lane < 4; lane++) {
+                    if (mask & (1 << lane)) {
+                        shadeFragment(rasterizer, *triangle, row + x + lane, depths[lane], lanes[0][lane], lanes[1][lane], lanes[2][lane]);
+                    }
+                }
+#else
+                for (int lane = 0; lane < 4; lane++) {
+                    float centerX = float(x + lane) + 0.5f;
+                    float barycentric[3];
+                    bool covered = true;
+                    for (int i = 0; i < 3; i++) {
+                        barycentric[i] = triangle->edgeA[i] * centerX + rowEdge[i];
+                        covered = covered && (barycentric[i] > 0.0f || (barycentric[i] == 0.0f && ((triangle->topLeftEdges >> i) & 1)));
+                    }
+                    float depth = triangle->depth[0] + barycentric[1] * depthDelta[1] + barycentric[2] * depthDelta[2];
+                    if (covered && depth < rasterizer.depth[row + x + lane] && depth <= 1.0f) {
+                        shadeFragment(rasterizer, *triangle, row + x + lane, depth, barycentric[0], barycentric[1], barycentric[2]);
+                    }
+                }
+#endif
+            }
+        }
+    }
+}
+
+// Bilinear within a level and linear between levels, GL_LINEAR_MIPMAP_LINEAR with repeat wrapping
+static float sampleTonalArtMap(SoftwareRasterizer& rasterizer, glm::vec2 uv, float layer, float lod) {
+    int layerIndex = glm::clamp(int(std::floor(layer + 0.5f)), 0, int(tonalArtMapLayers) - 1);
+    int levelCount = int(rasterizer.tonalArtMap.size());
+    lod = glm::clamp(lod, 0.0f, float(levelCount - 1));
+    int baseLevel = int(lod);
+    float levelBlend = lod - float(baseLevel);
+
+    float ink[2] = { 0.0f, 0.0f };
+    for (int i = 0; i < 2; i++) {
+        int level = std::min(baseLevel + i, levelCount - 1);
+        int size = int(tonalArtMapSize) >> level;
+        const unsigned char* tone = &rasterizer.tonalArtMap[level][size_t(layerIndex) * size * size];
+        float texelX = uv.x * float(size) - 0.5f, texelY = uv.y * float(size) - 0.5f;
+        float floorX = std::floor(texelX), floorY = std::floor(texelY);
+        float blendX = texelX - floorX, blendY = texelY - floorY;
+        int x0 = ((int(floorX) % size) + size) % size, y0 = ((int(floorY) % size) + size) % size;
+        int x1 = (x0 + 1) % size, y1 = (y0 + 1) % size;
+        float bottom = tone[y0 * size + x0] + (tone[y0 * size + x1] - tone[y0 * size + x0]) * blendX;
+        float top = tone[y1 * size + x0] + (tone[y1 * size + x1] - tone[y1 * size + x0]) * blendX;
+        ink[i] = (bottom + (top - bottom) * blendY) / 255.0f;
+    }
+    return ink[0] + (ink[1] - ink[0]) * levelBlend;
+}
+
+static float ditherNoise(glm::vec2 uv) {
+    return (fract(std::sin(glm::dot(uv, glm::vec2(12.9898f, 78.233f))) * 43758.5453f) * 2.0f - 1.0f) / 256.0f;
+}
+
+// clusterIndex in lighting.frag, the froxel holding a pixel at the given window depth.
+// logDepthRange is log(farPlane / nearPlane), the same for every pixel.
+static unsigned int pixelCluster(SoftwareRasterizer& rasterizer, LightClusters const &clusters, float logDepthRange,
+                                 int x, int y, float depth) {
+    float nearPlane = clusters.nearPlane, farPlane = clusters.farPlane;
+    float viewDepth = (2.0f * nearPlane * farPlane) / (farPlane + nearPlane - (depth * 2.0f - 1.0f) * (farPlane - nearPlane));
+    float slice = std::log(viewDepth / nearPlane) / logDepthRange * float(clusterCountZ);
+    unsigned int tileX = std::min((unsigned int) ((float(x) + 0.5f) / float(rasterizer.width) * float(clusterCountX)), clusterCountX - 1);
+    unsigned int tileY = std::min((unsigned int) ((float(y) + 0.5f) / float(rasterizer.height) * float(clusterCountY)), clusterCountY - 1);
+    return tileX + tileY * clusterCountX + (unsigned int) glm::clamp(slice, 0.0f, float(clusterCountZ - 1)) * clusterCountX * clusterCountY;
+}
+
+// calculateLight in lighting.frag without the shadow lookups, over the lights of the pixel's cluster
+static glm::vec3 lightPixel(LightClusters const &clusters, unsigned int cluster, glm::vec3 cameraPosition,
+                            glm::vec3 position, glm::vec3 normal, glm::vec2 hatchCoordinates, float ambientOcclusion) {
+    glm::vec3 diffuse(0.0f), specular(0.0f);
+    glm::vec3 viewDirection = glm::normalize(cameraPosition - position);
+    glm::uvec2 range = clusters.clusterRanges[cluster];
+    for (unsigned int i = range.x; i < range.x + range.y; i++) {
+        ClusterLight const &light = clusters.lights[clusters.lightIndices[i]];
+        glm::vec3 lightPosition = glm::vec3(light.positionRadius);
+        float distance = glm::length(lightPosition - position);
+        if (distance >= light.positionRadius.w) {
+            continue;
+        }
+        float attenuation = 1.0f / (0.001f + 0.002f * distance + 0.001f * distance * distance);
+        float fade = glm::clamp(1.0f - std::pow(distance / light.positionRadius.w, 4.0f), 0.0f, 1.0f);
+        attenuation *= fade * fade;
+
+        glm::vec3 lightDirection = (lightPosition - position) / distance;
+        glm::vec3 lightColor = glm::vec3(light.color) / 255.0f;
+        diffuse += std::max(glm::dot(lightDirection, normal), 0.0f) * lightColor * attenuation;
+        glm::vec3 reflection = glm::reflect(-lightDirection, normal);
+        specular += std::pow(std::max(glm::dot(viewDirection, reflection), 0.0f), 32.0f) * lightColor * attenuation;
+    }
+    return glm::vec3(0.1f * ambientOcclusion) + diffuse + specular + ditherNoise(hatchCoordinates);
+}
+
+// Column or row of a screen texture coordinate, GL_NEAREST with clamping
+static int nearestTexel(float coordinate, int size) {
+    return glm::clamp(int(std::floor(coordinate * float(size))), 0, size - 1);
+}
+
+// outlineNoise from the lattice values instead of hashing all four corners again
+static float latticeNoise(SoftwareRasterizer& rasterizer, float x, float y) {
+    float cellX = std::floor(x), cellY = std::floor(y);
+    const float* corners = &rasterizer.outlineNoise[int(cellY) * noiseLattice + int(cellX)];
+    return outlineNoiseBlend(corners[0], corners[1], corners[noiseLattice], corners[noiseLattice + 1], x - cellX, y - cellY);
+}
+
+// The edge detection of outline.frag: silhouettes from object IDs, creases from normals and depth
+static bool isOutlineSeed(SoftwareRasterizer& rasterizer, int x, int y) {
+    size_t pixel = size_t(y) * rasterizer.rowStride + x;
+    unsigned short centerID = rasterizer.objectIDs[pixel];
+    int left = std::max(x - 1, 0), right = std::min(x + 1, rasterizer.width - 1);
+    for (int offsetY = -1; offsetY <= 1; offsetY++) {
+        int sampleY = glm::clamp(y + offsetY, 0, rasterizer.height - 1);
+        const unsigned short* row = &rasterizer.objectIDs[size_t(sampleY) * rasterizer.rowStride];
+        if (row[left] != centerID || row[x] != centerID || row[right] != centerID) {
+            return true;
+        }
+    }
+    if (centerID == 0) {
+        return false;
+    }
+
+    glm::vec2 uv = glm::vec2((float(x) + 0.5f) / float(rasterizer.width), (float(y) + 0.5f) / float(rasterizer.height));
+    float jitter = outlineJitter * latticeNoise(rasterizer, uv.x * outlineNoiseScale, uv.y * outlineNoiseScale);
+    glm::vec2 jitteredUV = uv + glm::vec2(jitter);
+    glm::vec3 centerNormal = rasterizer.normals[pixel];
+    float centerDepth = rasterizer.linearDepth[pixel];
+
+    // The kernel is a grid, so its samples only need three columns and three rows each, top row first
+    int normalColumns[3], normalRows[3], depthColumns[3], depthRows[3];
+    for (int i = 0; i < 3; i++) {
+        float offsetX = float(i - 1) * outlineKernelOffset, offsetY = float(1 - i) * outlineKernelOffset;
+        normalColumns[i] = nearestTexel(jitteredUV.x + offsetX, rasterizer.width);
+        normalRows[i] = nearestTexel(jitteredUV.y + offsetY, rasterizer.height);
+        depthColumns[i] = nearestTexel(uv.x + offsetX, rasterizer.width);
+        depthRows[i] = nearestTexel(uv.y + offsetY, rasterizer.height);
+    }
+
+    float gx = 0.0f, gy = 0.0f, depthGx = 0.0f, depthGy = 0.0f;
+    for (int i = 0; i < 9; i++) {
+        size_t normalSample = size_t(normalRows[i / 3]) * rasterizer.rowStride + normalColumns[i % 3];
+        float normalDifference = 1.0f - glm::dot(centerNormal, rasterizer.normals[normalSample]);
+        gx += normalDifference * outlineKernelX[i];
+        gy += normalDifference * outlineKernelY[i];
+        size_t depthSample = size_t(depthRows[i / 3]) * rasterizer.rowStride + depthColumns[i % 3];
+        float depthDifference = std::abs(centerDepth - rasterizer.linearDepth[depthSample]) * rasterizer.depthEdgeScale;
+        depthGx += depthDifference * outlineKernelX[i];
+        depthGy += depthDifference * outlineKernelY[i];
+    }
+    return std::max(std::sqrt(gx * gx + gy * gy), std::sqrt(depthGx * depthGx + depthGy * depthGy)) > rasterizer.edgeThreshold;
+}
+
+static void lightTile(SoftwareRasterizer& rasterizer, int tile, LightClusters const &clusters, glm::vec3 cameraPosition) {
+    int tileX = (tile % rasterizer.tileCountX) * rasterTileSize;
+    int tileY = (tile / rasterizer.tileCountX) * rasterTileSize;
+    int tileMaxX = std::min(tileX + rasterTileSize, rasterizer.width) - 1;
+    int tileMaxY = std::min(tileY + rasterTileSize, rasterizer.height) - 1;
+    float logDepthRange = std::log(clusters.farPlane / clusters.nearPlane);
+    for (int y = tileY; y <= tileMaxY; y++) {
+        for (int x = tileX; x <= tileMaxX; x++) {
+            size_t pixel = size_t(y) * rasterizer.rowStride + x;
+            rasterizer.outlineSeeds[pixel] = isOutlineSeed(rasterizer, x, y);
+
+            glm::vec3 albedo = unpackColor(rasterizer.albedo[pixel]);
+            glm::vec3 lit = albedo;
+            if (rasterizer.objectIDs[pixel] != 0) {
+                glm::vec4 hatch = rasterizer.hatchCoordinates[pixel];
+                unsigned int cluster = pixelCluster(rasterizer, clusters, logDepthRange, x, y, rasterizer.depth[pixel]);
+                glm::vec3 light = lightPixel(clusters, cluster, cameraPosition, rasterizer.positions[pixel], rasterizer.normals[pixel],
+                                             glm::vec2(hatch.x, hatch.y), hatch.w);
+                if (rasterizer.hatchingStyle == HATCHING_TONAL_ART_MAP) {
+                    float brightness = glm::dot(light, glm::vec3(0.299f, 0.587f, 0.114f));
+                    float layer = glm::clamp(brightness / tonalArtMapMaxBrightness, 0.0f, 1.0f) * float(tonalArtMapLayers) - 0.5f;
+                    lit = albedo * sampleTonalArtMap(rasterizer, glm::vec2(hatch.x, hatch.y), layer, hatch.z);
+                } else {
+                    lit = albedo * light;
+                }
+            }
+            unsigned int packed = packColor(lit);
+            memcpy(&rasterizer.color[pixel * 4], &packed, 4);
+        }
+    }
+}
+
+// Ink over the lit image, framebuffer.frag with an exact nearest edge search instead of the jump flood.
+// The search is split in two: first the nearest seed up or down every column, then the nearest of those
+// across the row. Ties go to the lowest row and then the leftmost column, as in a scan of the whole square.
+static void compositeTile(SoftwareRasterizer& rasterizer, int tile) {
+    int tileX = (tile % rasterizer.tileCountX) * rasterTileSize;
+    int tileY = (tile / rasterizer.tileCountX) * rasterTileSize;
+    int tileMaxX = std::min(tileX + rasterTileSize, rasterizer.width) - 1;
+    int tileMaxY = std::min(tileY + rasterTileSize, rasterizer.height) - 1;
+    int radius = int(std::ceil(std::max(rasterizer.outlineWidthNear, rasterizer.outlineWidthFar)));
+
+    // Row offset of the nearest seed in each column the tile searches, radius + 1 for none
+    int columnX = std::max(tileX - radius, 0);
+    int columnCount = std::min(tileMaxX + radius, rasterizer.width - 1) - columnX + 1;
+    int rowCount = tileMaxY - tileY + 1;
+    std::vector<int> columnOffsets(size_t(columnCount) * rowCount, radius + 1);
+    for (int y = tileY; y <= tileMaxY; y++) {
+        for (int column = 0; column < columnCount; column++) {
+            const unsigned char* seeds = &rasterizer.outlineSeeds[columnX + column];
+            for (int offset = 0; offset <= radius; offset++) {
+                if (y - offset >= 0 && seeds[size_t(y - offset) * rasterizer.rowStride]) {
+                    columnOffsets[size_t(y - tileY) * columnCount + column] = -offset;
+                    break;
+                }
+                if (offset > 0 && y + offset < rasterizer.height && seeds[size_t(y + offset) * rasterizer.rowStride]) {
+                    columnOffsets[size_t(y - tileY) * columnCount + column] = offset;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int y = tileY; y <= tileMaxY; y++) {
+        const int* offsets = &columnOffsets[size_t(y - tileY) * columnCount];
+        for (int x = tileX; x <= tileMaxX; x++) {
+            int nearestDistance = -1, nearestOffsetY = 0;
+            size_t nearestSeed = 0;
+            for (int sampleX = std::max(x - radius, 0); sampleX <= std::min(x + radius, rasterizer.width - 1); sampleX++) {
+                int offsetY = offsets[sampleX - columnX];
+                if (offsetY > radius) {
+                    continue;
+                }
+                int distance = (sampleX - x) * (sampleX - x) + offsetY * offsetY;
+                if (nearestDistance < 0 || distance < nearestDistance || (distance == nearestDistance && offsetY < nearestOffsetY)) {
+                    nearestDistance = distance;
+                    nearestOffsetY = offsetY;
+                    nearestSeed = size_t(y + offsetY) * rasterizer.rowStride + sampleX;
+                }
+            }
+            if (nearestDistance < 0) {
+                continue;
+            }
+
+            float seedDepth = glm::clamp(rasterizer.linearDepth[nearestSeed], 0.0f, 1.0f);
+            float width = glm::mix(rasterizer.outlineWidthNear, rasterizer.outlineWidthFar, seedDepth);
+            float ink = 1.0f - smoothstep(width - 1.0f, width, std::sqrt(float(nearestDistance)));
+            unsigned char* color = &rasterizer.color[(size_t(y) * rasterizer.rowStride + x) * 4];
+            for (int channel = 0; channel < 3; channel++) {
+                color[channel] = (unsigned char) (float(color[channel]) * (1.0f - ink) + 0.5f);
+            }
+        }
+    }
+}
+
+void renderSoftwareFrame(SoftwareRasterizer& rasterizer, SceneNode* rootNode, LightClusters const &clusters,
+                         glm::vec3 cameraPosition, int width, int height) {
+    resizeRasterizer(rasterizer, width, height);
+
+    rasterizer.draws.clear();
+    collectDraws(rasterizer, rootNode);
+    rasterizer.drawTriangles.resize(rasterizer.draws.size());
+    parallelFor(rasterizer.workers, rasterizer.draws.size(), [&](unsigned int draw) {
+        setupDraw(rasterizer, draw);
+    });
+
+    // Binned in draw order, so every tile sees the triangles in the order GL would draw them
+    for (std::vector<const RasterTriangle*>& bin : rasterizer.tileBins) {
+        bin.clear();
+    }
+    rasterizer.trianglesBinned = 0;
+    for (std::vector<RasterTriangle>& triangles : rasterizer.drawTriangles) {
+        for (const RasterTriangle& triangle : triangles) {
+            for (int tileY = triangle.minY / rasterTileSize; tileY <= triangle.maxY / rasterTileSize; tileY++) {
+                for (int tileX = triangle.minX / rasterTileSize; tileX <= triangle.maxX / rasterTileSize; tileX++) {
+                    rasterizer.tileBins[tileY * rasterizer.tileCountX + tileX].push_back(&triangle);
+                }
+            }
+        }
+        rasterizer.trianglesBinned += triangles.size();
+    }
+
+    // Each pass reads neighbours from other tiles, so it waits for the previous one on all tiles
+    unsigned int tileCount = rasterizer.tileBins.size();
+    parallelFor(rasterizer.workers, tileCount, [&](unsigned int tile) {
+        rasterizeTile(rasterizer, tile);
+    });
+    parallelFor(rasterizer.workers, tileCount, [&](unsigned int tile) {
+        lightTile(rasterizer, tile, clusters, cameraPosition);
+    });
+    parallelFor(rasterizer.workers, tileCount, [&](unsigned int tile) {
+        compositeTile(rasterizer, tile);
+    });
+}
+
+void presentSoftwareFrame(SoftwareRasterizer& rasterizer, unsigned int framebuffer) {
+    if (rasterizer.presentTexture == 0) {
+        glGenTextures(1, &rasterizer.presentTexture);
+        glGenFramebuffers(1, &rasterizer.presentFramebuffer);
+    }
+
+    // Storage only changes with the frame size, other frames just replace the pixels
+    glBindTexture(GL_TEXTURE_2D, rasterizer.presentTexture);
+    if (rasterizer.presentWidth != rasterizer.width || rasterizer.presentHeight != rasterizer.height) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rasterizer.width, rasterizer.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, rasterizer.presentFramebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rasterizer.presentTexture, 0);
+        rasterizer.presentWidth = rasterizer.width;
+        rasterizer.presentHeight = rasterizer.height;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, rasterizer.rowStride);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, rasterizer.width, rasterizer.height, GL_RGBA, GL_UNSIGNED_BYTE, rasterizer.color.data());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, rasterizer.presentFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, rasterizer.width, rasterizer.height, 0, 0, rasterizer.width, rasterizer.height,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+#include <utilities/mesh.h>
+#include <utilities/workerPool.hpp>
+
+#include "lightClusters.hpp"
+#include "sceneGraph.hpp"
+
+// Screen tiles rasterized and shaded independently, one thread per tile at a time
+const int rasterTileSize = 64;
+
+// Background of the G-buffer, the same as the clear color of the GL path
+const glm::vec3 rasterClearColor = glm::vec3(0.157f, 0.565f, 0.863f);
+
+struct RasterMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> textureCoordinates;
+    std::vector<float> ambientOcclusion;
+    std::vector<unsigned int> indices;
+};
+
+// RGBA with the bottom row first and a box filtered mip chain, sampled like GL_NEAREST_MIPMAP_NEAREST
+struct RasterTexture {
+    std::vector<int> widths;
+    std::vector<int> heights;
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+// A triangle after clipping and setup, with barycentrics as edge functions of the pixel position
+struct RasterTriangle {
+    float edgeA[3], edgeB[3], edgeC[3];  // barycentric i = A x + B y + C at a pixel center
+    unsigned int topLeftEdges;            // bit i set when pixels exactly on edge i are covered
+    float depth[3];                       // window depth, linear in screen space
+    float inverseW[3];
+    glm::vec3 positions[3];               // world space
+    glm::vec3 normals[3];
+    glm::vec2 textureCoordinates[3];
+    float ambientOcclusion[3];
+    int minX, minY, maxX, maxY;
+    unsigned int draw;
+};
+
+struct RasterDraw {
+    const RasterMesh* mesh;
+    const RasterTexture* texture;  // null for untextured geometry
+    glm::mat4 modelViewProjection;
+    glm::mat4 modelMatrix;
+    glm::mat3 normalMatrix;
+    unsigned int objectID;
+};
+
+// CPU replacement for the G-buffer, lighting, outline and composite passes, for machines whose
+// only GL is a generic software rasterizer. Triangles are binned into screen tiles, every tile is
+// rasterized four pixels at a time with SSE2 and then shaded with the crosshatching of
+// lighting.frag and the edge detection of outline.frag.
+struct SoftwareRasterizer {
+    WorkerPool workers;  // started at init, shared by every pass of every frame
+    float outlineWidthNear;
+    float outlineWidthFar;
+    float edgeThreshold;
+    float depthEdgeScale;
+    int hatchingStyle;
+
+    // Scene data, found through the GL names the scene graph refers to
+    std::map<int, RasterMesh> meshes;                // by vertex array object
+    std::map<unsigned int, RasterTexture> textures;  // by texture ID
+    std::vector<std::vector<unsigned char>> tonalArtMap;
+    std::vector<float> outlineNoise;  // the hashes at the noise lattice points
+
+    // Per frame
+    std::vector<RasterDraw> draws;
+    std::vector<std::vector<RasterTriangle>> drawTriangles;
+    std::vector<std::vector<const RasterTriangle*>> tileBins;
+    int tileCountX;
+    int tileCountY;
+
+    // G-buffer and image, rows start at the bottom and are rowStride pixels apart so a group of
+    // four pixels never spans two rows
+    int width;
+    int height;
+    int rowStride;
+    std::vector<float> depth;
+    std::vector<float> linearDepth;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec4> hatchCoordinates;  // scaled texture coordinates, mip level and ambient occlusion
+    std::vector<unsigned int> albedo;         // packed RGBA
+    std::vector<unsigned short> objectIDs;
+    std::vector<unsigned char> outlineSeeds;
+    std::vector<unsigned char> color;         // RGBA, the finished frame
+
+    // Shows the finished frame through GL
+    unsigned int presentTexture;
+    unsigned int presentFramebuffer;
+    int presentWidth;
+    int presentHeight;
+
+    // Counters for the log
+    unsigned int trianglesBinned;
+};
+
+// Zero threads uses one per core
+void initSoftwareRasterizer(SoftwareRasterizer& rasterizer, unsigned int threadCount, float outlineWidthNear, float outlineWidthFar,
+                            float edgeThreshold, float depthEdgeScale, int hatchingStyle);
+
+// Copies of the scene data, under the GL names the scene graph uses for it
+void addRasterMesh(SoftwareRasterizer& rasterizer, int vertexArrayObjectID, Mesh const &mesh);
+void addRasterTexture(SoftwareRasterizer& rasterizer, unsigned int textureID,
+                      unsigned int width, unsigned int height, std::vector<unsigned char> const &pixels);
+
+// Draws every node with a registered mesh, using the transforms from updateNodeTransformations.
+// The clusters must have been built for this frame, pixels only loop over their cluster's lights.
+void renderSoftwareFrame(SoftwareRasterizer& rasterizer, SceneNode* rootNode, LightClusters const &clusters,
+                         glm::vec3 cameraPosition, int width, int height);
+
+// Copies the finished frame into a framebuffer, 0 for the window
+void presentSoftwareFrame(SoftwareRasterizer& rasterizer, unsigned int framebuffer);
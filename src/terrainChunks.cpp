@@ -0,0 +1,420 @@
+#include "terrainChunks.hpp"
+#include <utilities/fileutils.h>
+#include <utilities/hashing.hpp>
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <tuple>
+
+// Bumped whenever the file layout or the chunking changes
+static const uint32_t chunkFileMagic = 0x32484354; // "TCH2"
+
+struct ChunkMesh {
+    std::vector<TerrainVertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+template <class T>
+static bool readValue(std::istream& file, T& value) {
+    return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <class T>
+static void writeValue(std::ostream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static unsigned long long hashTerrainMesh(Mesh& mesh) {
+    unsigned long long hash = hashSeed;
+    hash = hashValues(hash, mesh.vertices);
+    hash = hashValues(hash, mesh.normals);
+    hash = hashValues(hash, mesh.textureCoordinates);
+    hash = hashValues(hash, mesh.indices);
+    hash = hashValues(hash, mesh.ambientOcclusion);
+    hash = hashValues(hash, std::vector<unsigned int>{ terrainChunkGrid, terrainLodLevels, terrainLodFinestCells });
+    return hash;
+}
+
+static TerrainVertex terrainVertex(Mesh& mesh, unsigned int i) {
+    TerrainVertex vertex;
+    vertex.position = mesh.vertices[i];
+    vertex.normal = i < mesh.normals.size() ? mesh.normals[i] : glm::vec3(0.0f);
+    vertex.textureCoordinates = i < mesh.textureCoordinates.size() ? mesh.textureCoordinates[i] : glm::vec2(0.0f);
+    vertex.tangent = i < mesh.tangents.size() ? mesh.tangents[i] : glm::vec3(0.0f);
+    vertex.bitangent = i < mesh.bitangents.size() ? mesh.bitangents[i] : glm::vec3(0.0f);
+    vertex.ambientOcclusion = i < mesh.ambientOcclusion.size() ? mesh.ambientOcclusion[i] : 1.0f;
+    return vertex;
+}
+
+typedef std::tuple<float, float, float> PositionKey;
+
+static PositionKey positionKey(glm::vec3 position) {
+    return std::make_tuple(position.x, position.y, position.z);
+}
+
+// Vertex clustering: unlocked vertices sharing a grid cell collapse onto the member closest to the
+// cell's mean. Vertices on the chunk border are locked, so neighbours at any level share the same
+// border and never crack. A cell size of zero keeps the source triangles.
+static ChunkMesh simplifyChunk(Mesh& mesh, const std::vector<unsigned int>& triangles,
+                               const std::map<PositionKey, int>& owners, float cellSize) {
+    std::map<unsigned int, unsigned int> representative;
+    for (unsigned int triangle : triangles) {
+        for (unsigned int corner = 0; corner < 3; corner++) {
+            unsigned int index = mesh.indices[triangle * 3 + corner];
+            representative[index] = index;
+        }
+    }
+
+    if (cellSize > 0.0f) {
+        std::map<std::tuple<int, int, int>, std::vector<unsigned int>> clusters;
+        for (auto& entry : representative) {
+            glm::vec3 position = mesh.vertices[entry.first];
+            if (owners.at(positionKey(position)) == -1) {
+                continue;
+            }
+            glm::ivec3 cell = glm::ivec3(glm::floor(position / cellSize));
+            clusters[std::make_tuple(cell.x, cell.y, cell.z)].push_back(entry.first);
+        }
+
+        for (auto& cluster : clusters) {
+            glm::vec3 mean(0.0f);
+            for (unsigned int index : cluster.second) {
+                mean += mesh.vertices[index];
+            }
+            mean /= float(cluster.second.size());
+
+            unsigned int closest = cluster.second[0];
+            for (unsigned int index : cluster.second) {
+                if (glm::length(mesh.vertices[index] - mean) < glm::length(mesh.vertices[closest] - mean)) {
+                    closest = index;
+                }
+            }
+            for (unsigned int index : cluster.second) {
+                representative[index] = closest;
+            }
+        }
+    }
+
+    ChunkMesh chunk;
+    std::map<unsigned int, unsigned int> localIndex;
+    for (unsigned int triangle : triangles) {
+        unsigned int corners[3];
+        for (unsigned int corner = 0; corner < 3; corner++) {
+            corners[corner] = representative[mesh.indices[triangle * 3 + corner]];
+        }
+        // Collapsed triangles are dropped
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2]) {
+            continue;
+        }
+        for (unsigned int index : corners) {
+            auto local = localIndex.find(index);
+            if (local == localIndex.end()) {
+                local = localIndex.insert({ index, (unsigned int) chunk.vertices.size() }).first;
+                chunk.vertices.push_back(terrainVertex(mesh, index));
+            }
+            chunk.indices.push_back(local->second);
+        }
+    }
+    return chunk;
+}
+
+static bool chunkFileMatches(std::string const &path, unsigned long long hash) {
+    std::ifstream file(path, std::ios::binary);
+    uint32_t magic, grid, levels;
+    unsigned long long fileHash;
+    return readValue(file, magic) && magic == chunkFileMagic
+        && readValue(file, fileHash) && fileHash == hash
+        && readValue(file, grid) && grid == terrainChunkGrid
+        && readValue(file, levels) && levels == terrainLodLevels;
+}
+
+void buildTerrainChunks(Mesh& mesh, std::string const &path) {
+    unsigned long long hash = hashTerrainMesh(mesh);
+    if (chunkFileMatches(path, hash)) {
+        return;
+    }
+
+    glm::vec3 meshMin(INFINITY);
+    glm::vec3 meshMax(-INFINITY);
+    for (glm::vec3 position : mesh.vertices) {
+        meshMin = glm::min(meshMin, position);
+        meshMax = glm::max(meshMax, position);
+    }
+    glm::vec2 cell = glm::max(glm::vec2(meshMax.x - meshMin.x, meshMax.z - meshMin.z) / float(terrainChunkGrid), glm::vec2(1e-6f));
+
+    // Every triangle goes to the chunk containing its centroid
+    const unsigned int chunkCount = terrainChunkGrid * terrainChunkGrid;
+    std::vector<std::vector<unsigned int>> chunkTriangles(chunkCount);
+    for (unsigned int triangle = 0; triangle < mesh.indices.size() / 3; triangle++) {
+        glm::vec3 centroid = (mesh.vertices[mesh.indices[triangle * 3]] +
+                              mesh.vertices[mesh.indices[triangle * 3 + 1]] +
+                              mesh.vertices[mesh.indices[triangle * 3 + 2]]) / 3.0f;
+        int x = std::min(std::max(int((centroid.x - meshMin.x) / cell.x), 0), int(terrainChunkGrid) - 1);
+        int z = std::min(std::max(int((centroid.z - meshMin.z) / cell.y), 0), int(terrainChunkGrid) - 1);
+        chunkTriangles[x + z * terrainChunkGrid].push_back(triangle);
+    }
+
+    // Chunk owning each position, -1 for positions on a border. Welded by position,
+    // since UV seams give one position several vertices.
+    std::map<PositionKey, int> owners;
+    for (unsigned int chunk = 0; chunk < chunkCount; chunk++) {
+        for (unsigned int triangle : chunkTriangles[chunk]) {
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                auto owner = owners.insert({ positionKey(mesh.vertices[mesh.indices[triangle * 3 + corner]]), int(chunk) }).first;
+                if (owner->second != int(chunk)) {
+                    owner->second = -1;
+                }
+            }
+        }
+    }
+
+    std::vector<ChunkMesh> levels(chunkCount * terrainLodLevels);
+    float chunkExtent = std::max(cell.x, cell.y);
+    for (unsigned int chunk = 0; chunk < chunkCount; chunk++) {
+        for (unsigned int level = 0; level < terrainLodLevels; level++) {
+            float cellSize = level == 0 ? 0.0f : chunkExtent / float(terrainLodFinestCells >> (level - 1));
+            levels[chunk * terrainLodLevels + level] = simplifyChunk(mesh, chunkTriangles[chunk], owners, cellSize);
+        }
+    }
+
+    std::string temporaryPath = temporaryFilePath(path);
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "Could not write terrain chunks to " << path << std::endl;
+        return;
+    }
+    writeValue(file, chunkFileMagic);
+    writeValue(file, hash);
+    writeValue(file, uint32_t(terrainChunkGrid));
+    writeValue(file, uint32_t(terrainLodLevels));
+
+    // Chunk table, the data follows it in the same order
+    unsigned long long offset = 20 + chunkCount * (24 + terrainLodLevels * 16);
+    for (unsigned int chunk = 0; chunk < chunkCount; chunk++) {
+        glm::vec3 boundsMin(INFINITY);
+        glm::vec3 boundsMax(-INFINITY);
+        for (TerrainVertex& vertex : levels[chunk * terrainLodLevels].vertices) {
+            boundsMin = glm::min(boundsMin, vertex.position);
+            boundsMax = glm::max(boundsMax, vertex.position);
+        }
+        writeValue(file, boundsMin);
+        writeValue(file, boundsMax);
+
+        for (unsigned int level = 0; level < terrainLodLevels; level++) {
+            ChunkMesh& chunkMesh = levels[chunk * terrainLodLevels + level];
+            writeValue(file, offset);
+            writeValue(file, uint32_t(chunkMesh.vertices.size()));
+            writeValue(file, uint32_t(chunkMesh.indices.size()));
+            offset += chunkMesh.vertices.size() * sizeof(TerrainVertex) + chunkMesh.indices.size() * sizeof(unsigned int);
+        }
+    }
+    for (ChunkMesh& chunkMesh : levels) {
+        file.write(reinterpret_cast<const char*>(chunkMesh.vertices.data()), chunkMesh.vertices.size() * sizeof(TerrainVertex));
+        file.write(reinterpret_cast<const char*>(chunkMesh.indices.data()), chunkMesh.indices.size() * sizeof(unsigned int));
+    }
+    file.close();
+    if (!replaceFile(temporaryPath, path)) {
+        std::cout << "Could not write terrain chunks to " << path << std::endl;
+        return;
+    }
+
+    std::cout << "Built " << chunkCount << " terrain chunks with " << terrainLodLevels << " levels of detail" << std::endl;
+}
+
+bool initTerrainChunks(TerrainChunks& terrain, std::string const &path, SceneNode* parent, unsigned int textureID) {
+    terrain.path = path;
+    terrain.file.close();
+    terrain.file.clear();
+    terrain.file.open(path, std::ios::binary);
+    terrain.loads = 0;
+    terrain.unloads = 0;
+    terrain.visibleChunks = 0;
+    terrain.visibleTriangles = 0;
+
+    uint32_t magic, grid, levels;
+    unsigned long long hash;
+    if (!readValue(terrain.file, magic) || magic != chunkFileMagic || !readValue(terrain.file, hash)
+        || !readValue(terrain.file, grid) || grid != terrainChunkGrid
+        || !readValue(terrain.file, levels) || levels != terrainLodLevels) {
+        std::cout << "Could not read terrain chunks from " << path << std::endl;
+        return false;
+    }
+
+    terrain.file.seekg(0, std::ios::end);
+    unsigned long long fileSize = (unsigned long long) terrain.file.tellg();
+    terrain.file.seekg(sizeof(magic) + sizeof(hash) + sizeof(grid) + sizeof(levels));
+
+    // The whole table is checked before any node is added, a truncated file leaves the graph as it was
+    std::vector<TerrainChunk> chunks(grid * grid);
+    for (TerrainChunk& chunk : chunks) {
+        if (!readValue(terrain.file, chunk.boundsMin) || !readValue(terrain.file, chunk.boundsMax)) {
+            std::cout << "Terrain chunk table in " << path << " is truncated" << std::endl;
+            return false;
+        }
+        for (TerrainChunkLevel& level : chunk.levels) {
+            uint32_t vertexCount, indexCount;
+            if (!readValue(terrain.file, level.fileOffset) || !readValue(terrain.file, vertexCount)
+                || !readValue(terrain.file, indexCount)) {
+                std::cout << "Terrain chunk table in " << path << " is truncated" << std::endl;
+                return false;
+            }
+            unsigned long long size = (unsigned long long) vertexCount * sizeof(TerrainVertex)
+                                    + (unsigned long long) indexCount * sizeof(unsigned int);
+            if (level.fileOffset > fileSize || size > fileSize - level.fileOffset) {
+                std::cout << "Terrain chunk table in " << path << " points past the end of the file" << std::endl;
+                return false;
+            }
+            level.vertexCount = vertexCount;
+            level.indexCount = indexCount;
+            level.vertexArray = 0;
+            level.vertexBuffer = 0;
+            level.indexBuffer = 0;
+        }
+        chunk.resident = false;
+    }
+
+    terrain.chunks = std::move(chunks);
+    for (TerrainChunk& chunk : terrain.chunks) {
+        chunk.node = createSceneNode();
+        chunk.node->nodeType = TEXTURE_MAP;
+        chunk.node->textureID = textureID;
+        // The coarse levels average vertices of the full one, so its bounds hold them all
+        chunk.node->hasBounds = true;
+        chunk.node->boundsMin = chunk.boundsMin;
+        chunk.node->boundsMax = chunk.boundsMax;
+        parent->children.push_back(chunk.node);
+    }
+    return true;
+}
+
+static void loadChunk(TerrainChunks& terrain, TerrainChunk& chunk) {
+    for (TerrainChunkLevel& level : chunk.levels) {
+        if (level.indexCount == 0) {
+            continue;
+        }
+        std::vector<TerrainVertex> vertices(level.vertexCount);
+        std::vector<unsigned int> indices(level.indexCount);
+        terrain.file.clear();
+        terrain.file.seekg(level.fileOffset);
+        terrain.file.read(reinterpret_cast<char*>(vertices.data()), vertices.size() * sizeof(TerrainVertex));
+        terrain.file.read(reinterpret_cast<char*>(indices.data()), indices.size() * sizeof(unsigned int));
+
+        glGenVertexArrays(1, &level.vertexArray);
+        glBindVertexArray(level.vertexArray);
+
+        glGenBuffers(1, &level.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, level.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TerrainVertex), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*) offsetof(TerrainVertex, position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_TRUE, sizeof(TerrainVertex), (void*) offsetof(TerrainVertex, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*) offsetof(TerrainVertex, textureCoordinates));
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*) offsetof(TerrainVertex, tangent));
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*) offsetof(TerrainVertex, bitangent));
+        glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*) offsetof(TerrainVertex, ambientOcclusion));
+        for (unsigned int attribute : { 0, 1, 2, 3, 4, 6 }) {
+            glEnableVertexAttribArray(attribute);
+        }
+
+        glGenBuffers(1, &level.indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    }
+    glBindVertexArray(0);
+    chunk.resident = true;
+    terrain.loads++;
+}
+
+static void unloadChunk(TerrainChunks& terrain, TerrainChunk& chunk) {
+    for (TerrainChunkLevel& level : chunk.levels) {
+        if (level.vertexArray != 0) {
+            glDeleteVertexArrays(1, &level.vertexArray);
+            glDeleteBuffers(1, &level.vertexBuffer);
+            glDeleteBuffers(1, &level.indexBuffer);
+            level.vertexArray = 0;
+            level.vertexBuffer = 0;
+            level.indexBuffer = 0;
+        }
+    }
+    chunk.resident = false;
+    terrain.unloads++;
+}
+
+void updateTerrainChunks(TerrainChunks& terrain, glm::mat4 modelMatrix, glm::mat4 viewProjection,
+                         glm::vec3 cameraPosition, float viewDistance, unsigned int loadBudget) {
+    std::vector<glm::vec3> worldMin(terrain.chunks.size());
+    std::vector<glm::vec3> worldMax(terrain.chunks.size());
+    std::vector<float> distances(terrain.chunks.size());
+
+    for (size_t i = 0; i < terrain.chunks.size(); i++) {
+        TerrainChunk& chunk = terrain.chunks[i];
+        worldMin[i] = glm::vec3(INFINITY);
+        worldMax[i] = glm::vec3(-INFINITY);
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 local((corner & 1) ? chunk.boundsMax.x : chunk.boundsMin.x,
+                            (corner & 2) ? chunk.boundsMax.y : chunk.boundsMin.y,
+                            (corner & 4) ? chunk.boundsMax.z : chunk.boundsMin.z);
+            glm::vec3 world = glm::vec3(modelMatrix * glm::vec4(local, 1.0f));
+            worldMin[i] = glm::min(worldMin[i], world);
+            worldMax[i] = glm::max(worldMax[i], world);
+        }
+        glm::vec3 offset = glm::max(glm::max(worldMin[i] - cameraPosition, cameraPosition - worldMax[i]), glm::vec3(0.0f));
+        distances[i] = glm::length(offset) / viewDistance;
+    }
+
+    // Stream out far chunks, then stream in the nearest missing ones within the budget
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < terrain.chunks.size(); i++) {
+        TerrainChunk& chunk = terrain.chunks[i];
+        if (chunk.resident && distances[i] > terrainStreamOutDistance) {
+            unloadChunk(terrain, chunk);
+        } else if (!chunk.resident && distances[i] < terrainStreamInDistance && chunk.levels[0].indexCount > 0) {
+            missing.push_back(i);
+        }
+    }
+    std::sort(missing.begin(), missing.end(), [&](size_t a, size_t b) { return distances[a] < distances[b]; });
+    for (size_t i = 0; i < missing.size() && i < loadBudget; i++) {
+        loadChunk(terrain, terrain.chunks[missing[i]]);
+    }
+
+    // Every resident chunk keeps its geometry, each pass culls the chunk nodes against its own
+    // view. Only the counters for the log use the camera frustum.
+    terrain.visibleChunks = 0;
+    terrain.visibleTriangles = 0;
+    for (size_t i = 0; i < terrain.chunks.size(); i++) {
+        TerrainChunk& chunk = terrain.chunks[i];
+        chunk.node->vertexArrayObjectID = -1;
+        chunk.node->VAOIndexCount = 0;
+        if (!chunk.resident) {
+            continue;
+        }
+
+        // One level coarser every time the distance doubles
+        unsigned int level = 0;
+        float threshold = terrainLodDistance;
+        while (level + 1 < terrainLodLevels && distances[i] > threshold) {
+            level++;
+            threshold *= 2.0f;
+        }
+        // Small chunks can collapse completely at the coarse levels
+        while (level > 0 && chunk.levels[level].indexCount == 0) {
+            level--;
+        }
+
+        TerrainChunkLevel& selected = chunk.levels[level];
+        chunk.node->vertexArrayObjectID = selected.vertexArray;
+        chunk.node->VAOIndexCount = selected.indexCount;
+        if (!nodeOutsideFrustum(chunk.node, viewProjection * modelMatrix)) {
+            terrain.visibleChunks++;
+            terrain.visibleTriangles += selected.indexCount / 3;
+        }
+    }
+}
+
+void setTerrainObjectID(TerrainChunks& terrain, unsigned int objectID) {
+    for (TerrainChunk& chunk : terrain.chunks) {
+        chunk.node->objectID = objectID;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <utilities/mesh.h>
+
+#include "sceneGraph.hpp"
+
+// The terrain is split into a grid of this many chunks per side, in mesh space
+const unsigned int terrainChunkGrid = 8;
+
+// Level 0 is the source mesh, every further level clusters vertices on a grid half as fine as the previous
+const unsigned int terrainLodLevels = 4;
+const unsigned int terrainLodFinestCells = 16;  // cluster cells per chunk side at level 1
+
+// Distances as fractions of the view distance. A chunk switches to the next level every time
+// the distance doubles, and is read from disk once it comes within the stream in distance.
+const float terrainLodDistance = 0.125f;
+const float terrainStreamInDistance = 1.0f;
+const float terrainStreamOutDistance = 1.2f;  // further than stream in, so chunks on the border do not thrash
+
+// Chunks read from disk per frame, so a fast camera does not stall on streaming
+const unsigned int terrainLoadsPerFrame = 4;
+
+// Interleaved in one buffer, with the same attribute locations as generateBuffer
+struct TerrainVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 textureCoordinates;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    float ambientOcclusion;
+};
+
+struct TerrainChunkLevel {
+    unsigned long long fileOffset;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+
+    // Zero while the chunk is streamed out
+    unsigned int vertexArray;
+    unsigned int vertexBuffer;
+    unsigned int indexBuffer;
+};
+
+struct TerrainChunk {
+    // Mesh space bounds of the full detail level
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    TerrainChunkLevel levels[terrainLodLevels];
+    bool resident;
+
+    // Child of the terrain node, points at the VAO of the selected level or has none while streamed out
+    SceneNode* node;
+};
+
+struct TerrainChunks {
+    std::string path;
+    std::ifstream file;
+    std::vector<TerrainChunk> chunks;
+
+    // Counters for the log
+    unsigned int loads;
+    unsigned int unloads;
+    unsigned int visibleChunks;
+    unsigned int visibleTriangles;
+};
+
+// Splits the mesh into chunks with all LOD levels and writes them to the given file.
+// Does nothing if the file already holds chunks built from the same mesh.
+void buildTerrainChunks(Mesh& mesh, std::string const &path);
+
+// Reads the chunk table and adds a node per chunk under the parent, chunk data is loaded on demand.
+// False, with nothing added, when the file was built for another grid or its table is damaged.
+bool initTerrainChunks(TerrainChunks& terrain, std::string const &path, SceneNode* parent, unsigned int textureID);
+
+// Streams chunks in and out around the camera and picks the level of detail of each resident chunk
+void updateTerrainChunks(TerrainChunks& terrain, glm::mat4 modelMatrix, glm::mat4 viewProjection,
+                         glm::vec3 cameraPosition, float viewDistance, unsigned int loadBudget = terrainLoadsPerFrame);
+
+void setTerrainObjectID(TerrainChunks& terrain, unsigned int objectID);
@@ -0,0 +1,37 @@
+#include "fileutils.h"
+#include <cstdio>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+std::string temporaryFilePath(std::string const &path) {
+    // Unique per process, a crashed writer leaves a stray file but never a broken cache
+    return path + "." + std::to_string(getpid()) + ".tmp";
+}
+
+bool replaceFile(std::string const &temporaryPath, std::string const &path) {
+#ifdef _WIN32
+    // Windows does not rename over an existing file
+    std::remove(path.c_str());
+#endif
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool fileStamp(std::string const &path, unsigned long long &size, long long &modified) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    size = (unsigned long long) info.st_size;
+    modified = (long long) info.st_mtime;
+    return true;
+}
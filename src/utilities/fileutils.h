@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+// Cache files are written next to their final path and renamed over it once complete, so other
+// processes starting at the same time never read one half written
+std::string temporaryFilePath(std::string const &path);
+bool replaceFile(std::string const &temporaryPath, std::string const &path);
+
+// Size and modification time, for noticing that a source file changed. Returns false if it does not exist.
+bool fileStamp(std::string const &path, unsigned long long &size, long long &modified);
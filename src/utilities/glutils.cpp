@@ -29,6 +29,12 @@ unsigned int generateBuffer(Mesh &mesh) {
 
     generateAttribute(3, 3, mesh.tangents, false);
     generateAttribute(4, 3, mesh.bitangents, false);
+    // Meshes without a bake are fully open, a disabled attribute would read as 0
+    if (mesh.ambientOcclusion.size() == mesh.vertices.size()) {
+        generateAttribute(6, 1, mesh.ambientOcclusion, false);
+    } else {
+        generateAttribute(6, 1, std::vector<float>(mesh.vertices.size(), 1.0f), false);
+    }
     
     unsigned int indexBufferID;
     glGenBuffers(1, &indexBufferID);
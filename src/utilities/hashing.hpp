@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// FNV-1a, for the change detection and cache keys. Start from hashSeed and chain the calls.
+const unsigned long long hashSeed = 14695981039346656037ULL;
+
+inline unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The value's bytes, so only for types without padding or pointers
+template <class T>
+unsigned long long hashValue(unsigned long long hash, const T& value) {
+    return hashBytes(hash, &value, sizeof(T));
+}
+
+template <class T>
+unsigned long long hashValues(unsigned long long hash, const std::vector<T>& values) {
+    return hashBytes(hash, values.data(), values.size() * sizeof(T));
+}
@@ -43,14 +43,18 @@ PNGImage loadPNGFile(std::string fileName)
 }
 
 unsigned int generateTextureID(PNGImage image){
+	return generateTextureID(image.width, image.height, image.pixels.data());
+}
+
+unsigned int generateTextureID(unsigned int width, unsigned int height, const unsigned char* pixels){
 	unsigned int textureID;
 
 	// generate texture
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_2D, textureID);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 
-				image.width, image.height, 0, 
-				GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+				width, height, 0, 
+				GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 	
 	// minimize undersampling and oversampling
 	glGenerateMipmap(GL_TEXTURE_2D);
@@ -12,4 +12,7 @@ typedef struct PNGImage {
 
 PNGImage loadPNGFile(std::string fileName);
 
-unsigned int generateTextureID(PNGImage texture);
\ No newline at end of file
+unsigned int generateTextureID(PNGImage texture);
+
+// Same, for RGBA pixels that live elsewhere, such as a mapped asset cache
+unsigned int generateTextureID(unsigned int width, unsigned int height, const unsigned char* pixels);
\ No newline at end of file
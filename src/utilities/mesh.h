@@ -9,6 +9,7 @@ struct Mesh {
     std::vector<glm::vec2> textureCoordinates;
     std::vector<glm::vec3> tangents;
     std::vector<glm::vec3> bitangents;
+    std::vector<float> ambientOcclusion;  // baked per vertex, 1 where nothing blocks the ambient light
 
     std::vector<unsigned int> indices;
 };
\ No newline at end of file
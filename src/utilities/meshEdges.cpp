@@ -0,0 +1,98 @@
+#include "meshEdges.hpp"
+#include <glad/glad.h>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+// Faces sharing one edge, found through the welded vertex indices
+struct EdgeAdjacency {
+    unsigned int start;
+    unsigned int end;
+    unsigned int faces[2];
+    unsigned int faceCount;
+};
+
+std::vector<MeshEdge> extractMeshEdges(Mesh& mesh, float creaseAngle) {
+    // Weld by position, otherwise UV and normal seams would show up as boundaries
+    std::map<std::tuple<float, float, float>, unsigned int> weldLookup;
+    std::vector<unsigned int> welded(mesh.vertices.size());
+    for (unsigned int i = 0; i < mesh.vertices.size(); i++) {
+        glm::vec3 position = mesh.vertices[i];
+        welded[i] = weldLookup.emplace(std::make_tuple(position.x, position.y, position.z), i).first->second;
+    }
+
+    std::vector<glm::vec3> faceNormals;
+    std::vector<EdgeAdjacency> adjacency;
+    std::unordered_map<uint64_t, unsigned int> edgeLookup;
+
+    for (unsigned int triangle = 0; triangle + 2 < mesh.indices.size(); triangle += 3) {
+        unsigned int corners[3] = {
+            welded[mesh.indices[triangle]], welded[mesh.indices[triangle + 1]], welded[mesh.indices[triangle + 2]]
+        };
+        glm::vec3 normal = glm::cross(mesh.vertices[corners[1]] - mesh.vertices[corners[0]],
+                                      mesh.vertices[corners[2]] - mesh.vertices[corners[0]]);
+        if (glm::dot(normal, normal) == 0.0f) {
+            continue;
+        }
+        unsigned int face = faceNormals.size();
+        faceNormals.push_back(glm::normalize(normal));
+
+        for (unsigned int i = 0; i < 3; i++) {
+            unsigned int a = corners[i];
+            unsigned int b = corners[(i + 1) % 3];
+            uint64_t key = (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b));
+
+            auto found = edgeLookup.find(key);
+            if (found == edgeLookup.end()) {
+                edgeLookup[key] = adjacency.size();
+                adjacency.push_back({a, b, {face, face}, 1});
+            } else {
+                EdgeAdjacency& edge = adjacency[found->second];
+                if (edge.faceCount == 1) {
+                    edge.faces[1] = face;
+                }
+                edge.faceCount++;
+            }
+        }
+    }
+
+    float creaseCosine = std::cos(creaseAngle);
+    std::vector<MeshEdge> edges;
+    for (EdgeAdjacency& edge : adjacency) {
+        glm::vec3 normal0 = faceNormals[edge.faces[0]];
+        glm::vec3 normal1 = faceNormals[edge.faces[1]];
+        float cosine = glm::dot(normal0, normal1);
+
+        // Boundary and non-manifold edges are drawn like creases
+        bool feature = edge.faceCount != 2 || cosine < creaseCosine;
+
+        // Edges inside a flat region can only be silhouettes when seen exactly edge on
+        if (!feature && cosine > 0.9999f) {
+            continue;
+        }
+
+        MeshEdge meshEdge;
+        meshEdge.start = glm::vec4(mesh.vertices[edge.start], feature ? 1.0f : 0.0f);
+        meshEdge.end = glm::vec4(mesh.vertices[edge.end], 0.0f);
+        meshEdge.normal0 = glm::vec4(normal0, 0.0f);
+        meshEdge.normal1 = glm::vec4(normal1, 0.0f);
+        edges.push_back(meshEdge);
+    }
+    return edges;
+}
+
+EdgeBuffer generateEdgeBuffer(Mesh& mesh) {
+    std::vector<MeshEdge> edges = extractMeshEdges(mesh);
+
+    unsigned int bufferID;
+    glGenBuffers(1, &bufferID);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferID);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, edges.size() * sizeof(MeshEdge), edges.data(), GL_STATIC_DRAW);
+
+    EdgeBuffer edgeBuffer;
+    edgeBuffer.bufferID = bufferID;
+    edgeBuffer.edgeCount = edges.size();
+    return edgeBuffer;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.h"
+
+// Dihedral angle above which an edge between two faces is always drawn
+const float meshEdgeCreaseAngle = glm::radians(60.0f);
+
+// One edge as laid out in the std430 edge buffer read by silhouettes.comp
+struct MeshEdge {
+    glm::vec4 start;    // object space, w is 1 for crease and boundary edges that are always drawn
+    glm::vec4 end;
+    glm::vec4 normal0;  // normals of the two adjacent faces, equal for boundary edges
+    glm::vec4 normal1;
+};
+
+struct EdgeBuffer {
+    int bufferID;
+    unsigned int edgeCount;
+};
+
+std::vector<MeshEdge> extractMeshEdges(Mesh& mesh, float creaseAngle = meshEdgeCreaseAngle);
+EdgeBuffer generateEdgeBuffer(Mesh& mesh);
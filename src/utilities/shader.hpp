@@ -6,10 +6,15 @@
 #include <glad/glad.h>
 
 // Standard headers
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "hashing.hpp"
+#include "shaderCache.hpp"
 
 
 namespace Gloom
@@ -23,16 +28,33 @@ namespace Gloom
         GLint  mStatus;
         GLint  mLength;
 
+        // Stages are only compiled at link time, and only when the program binary cache misses
+        std::vector<std::string> mFilenames;
+        std::vector<std::string> mSources;
+        std::string              mDefines;
+        std::vector<GLuint>      mShaders;
+        unsigned long long       mCacheKey;
+        bool                     mPending;
+
     public:
         Shader() {
             mProgram = glCreateProgram();
+            mCacheKey = hashSeed;
+            mPending = false;
         }
 
         // Public member functions
-        void   activate()   { glUseProgram(mProgram); }
+        void   activate()   { finish(); glUseProgram(mProgram); }
         void   deactivate() { glUseProgram(0); }
-        GLuint get()        { return mProgram; }
-        void   destroy()    { glDeleteProgram(mProgram); }
+        GLuint get()        { finish(); return mProgram; }
+        void   destroy()    { unregister(); glDeleteProgram(mProgram); }
+
+        /* Adds a #define to every stage attached afterwards, used to build
+           shader variants with features compiled in or out */
+        void define(std::string const &name, std::string const &value = "1")
+        {
+            mDefines += "#define " + name + " " + value + "\n";
+        }
 
         /* Attach a shader to the current shader program */
         void attach(std::string const &filename)
@@ -50,40 +72,80 @@ namespace Gloom
             auto src = std::string(std::istreambuf_iterator<char>(fd),
                                   (std::istreambuf_iterator<char>()));
 
-            // Create shader object
-            const char * source = src.c_str();
-            auto shader = create(filename);
-            glShaderSource(shader, 1, &source, nullptr);
-            glCompileShader(shader);
-
-            // Display errors
-            glGetShaderiv(shader, GL_COMPILE_STATUS, &mStatus);
-            if (!mStatus)
+            // Defines go right after #version, which has to stay the first statement.
+            // The #line directive keeps error messages pointing at the right line of the file.
+            if (!mDefines.empty())
             {
-                glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &mLength);
-                std::unique_ptr<char[]> buffer(new char[mLength]);
-                glGetShaderInfoLog(shader, mLength, nullptr, buffer.get());
-                fprintf(stderr, "%s\n%s", filename.c_str(), buffer.get());
+                auto version = src.find("#version");
+                auto lineEnd = version == std::string::npos ? std::string::npos : src.find('\n', version);
+                if (lineEnd != std::string::npos)
+                {
+                    int line = 2 + int(std::count(src.begin(), src.begin() + lineEnd, '\n'));
+                    src.insert(lineEnd + 1, mDefines + "#line " + std::to_string(line) + "\n");
+                }
             }
 
-            assert(mStatus);
-
-            // Attach shader and free allocated memory
-            glAttachShader(mProgram, shader);
-            glDeleteShader(shader);
+            // The file name is part of the key since it decides the stage
+            mCacheKey = hashShaderSource(mCacheKey, filename);
+            mCacheKey = hashShaderSource(mCacheKey, src);
+            mFilenames.push_back(filename);
+            mSources.push_back(src);
         }
 
 
-        /* Links all attached shaders together into a shader program */
+        /* Links all attached shaders together into a shader program.
+           Does not wait for the driver, the result is checked on first use */
         void link()
         {
-            // Link all attached shaders
+            if (loadProgramBinary(mProgram, mCacheKey))
+            {
+                mSources.clear();
+                return;
+            }
+
+            // Compile every stage without querying its status in between,
+            // so a parallel compiling driver can work on all of them at once
+            for (size_t i = 0; i < mSources.size(); i++)
+            {
+                const char * source = mSources[i].c_str();
+                auto shader = create(mFilenames[i]);
+                glShaderSource(shader, 1, &source, nullptr);
+                glCompileShader(shader);
+                glAttachShader(mProgram, shader);
+                mShaders.push_back(shader);
+            }
+            mSources.clear();
+
+            glProgramParameteri(mProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
             glLinkProgram(mProgram);
+            mPending = true;
+            pendingShaders().push_back(this);
+        }
+
+
+        /* Waits for a pending link, reports errors and stores the binary in the cache */
+        void finish()
+        {
+            if (!mPending) return;
+            mPending = false;
+            unregister();
 
             // Display errors
             glGetProgramiv(mProgram, GL_LINK_STATUS, &mStatus);
             if (!mStatus)
             {
+                for (size_t i = 0; i < mShaders.size(); i++)
+                {
+                    GLint compiled;
+                    glGetShaderiv(mShaders[i], GL_COMPILE_STATUS, &compiled);
+                    if (!compiled)
+                    {
+                        glGetShaderiv(mShaders[i], GL_INFO_LOG_LENGTH, &mLength);
+                        std::unique_ptr<char[]> buffer(new char[mLength]);
+                        glGetShaderInfoLog(mShaders[i], mLength, nullptr, buffer.get());
+                        fprintf(stderr, "%s\n%s", mFilenames[i].c_str(), buffer.get());
+                    }
+                }
                 glGetProgramiv(mProgram, GL_INFO_LOG_LENGTH, &mLength);
                 std::unique_ptr<char[]> buffer(new char[mLength]);
                 glGetProgramInfoLog(mProgram, mLength, nullptr, buffer.get());
@@ -91,6 +153,28 @@ namespace Gloom
             }
 
             assert(mStatus);
+            if (mStatus)
+            {
+                storeProgramBinary(mProgram, mCacheKey);
+            }
+
+            // Free the stages, the program keeps its own copy
+            for (GLuint shader : mShaders)
+            {
+                glDetachShader(mProgram, shader);
+                glDeleteShader(shader);
+            }
+            mShaders.clear();
+        }
+
+
+        /* Waits for every program that is still linking, so they all end up in the cache */
+        static void finishAll()
+        {
+            while (!pendingShaders().empty())
+            {
+                pendingShaders().back()->finish();
+            }
         }
 
 
@@ -107,6 +191,7 @@ namespace Gloom
         /* Convenience function to get a uniforms ID from a string
            containing its name */
         GLint getUniformFromName(std::string const &uniformName) {
+            finish();
             return glGetUniformLocation(this->get(), uniformName.c_str());
         }
 
@@ -114,6 +199,8 @@ namespace Gloom
         /* Used for debugging shader programs (expensive to run) */
         bool isValid()
         {
+            finish();
+
             // Validate linked shader program
             glValidateProgram(mProgram);
 
@@ -147,6 +234,26 @@ namespace Gloom
         }
 
     private:
+        // Programs linked but not yet checked, shared by every translation unit
+        static std::vector<Shader*> & pendingShaders()
+        {
+            static std::vector<Shader*> shaders;
+            return shaders;
+        }
+
+        void unregister()
+        {
+            auto & shaders = pendingShaders();
+            for (size_t i = 0; i < shaders.size(); i++)
+            {
+                if (shaders[i] == this)
+                {
+                    shaders.erase(shaders.begin() + i);
+                    return;
+                }
+            }
+        }
+
         // Disable copying and assignment
         Shader(Shader const &) = delete;
         Shader & operator =(Shader const &) = delete;
@@ -0,0 +1,166 @@
+#include "shaderCache.hpp"
+#include "fileutils.h"
+#include "hashing.hpp"
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// Bumped whenever the file layout changes
+static const uint32_t cacheMagic = 0x31435347; // "GSC1"
+
+struct ProgramBinary {
+    GLenum format;
+    std::vector<char> data;
+};
+
+struct ShaderCache {
+    bool enabled = false;
+    bool modified = false;
+    std::string path;
+    unsigned long long driverHash = 0;
+    std::map<unsigned long long, ProgramBinary> binaries;
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+};
+
+static ShaderCache cache;
+
+unsigned long long hashShaderSource(unsigned long long hash, std::string const &text) {
+    return hashBytes(hash, text.data(), text.size());
+}
+
+template <class T>
+static bool readValue(std::ifstream &file, T &value) {
+    return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <class T>
+static void writeValue(std::ofstream &file, T value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void initShaderCache(std::string const &path) {
+    // Let the driver compile and link on its own threads, status queries then only block on the program asked about
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    } else if (GLAD_GL_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount == 0) {
+        std::cout << "Shader cache disabled, the driver has no program binary formats" << std::endl;
+        return;
+    }
+
+    cache.enabled = true;
+    cache.path = path;
+    cache.driverHash = hashSeed;
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        cache.driverHash = hashShaderSource(cache.driverHash, reinterpret_cast<const char*>(glGetString(name)));
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    uint32_t magic, count;
+    unsigned long long driverHash;
+    if (!readValue(file, magic) || magic != cacheMagic || !readValue(file, driverHash) || !readValue(file, count)) {
+        return;
+    }
+    if (driverHash != cache.driverHash) {
+        std::cout << "Shader cache was built by another driver, recompiling" << std::endl;
+        cache.modified = true;
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        unsigned long long key;
+        uint32_t format, size;
+        if (!readValue(file, key) || !readValue(file, format) || !readValue(file, size)) {
+            break;
+        }
+        ProgramBinary& binary = cache.binaries[key];
+        binary.format = format;
+        binary.data.resize(size);
+        if (!file.read(binary.data.data(), size)) {
+            cache.binaries.erase(key);
+            break;
+        }
+    }
+}
+
+bool loadProgramBinary(GLuint program, unsigned long long key) {
+    if (!cache.enabled) {
+        return false;
+    }
+
+    auto entry = cache.binaries.find(key);
+    if (entry != cache.binaries.end()) {
+        ProgramBinary& binary = entry->second;
+        glProgramBinary(program, binary.format, binary.data.data(), GLsizei(binary.data.size()));
+
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status) {
+            cache.hits++;
+            return true;
+        }
+        // Rejected, for example after a driver update that kept the version string
+        cache.binaries.erase(entry);
+        cache.modified = true;
+    }
+    cache.misses++;
+    return false;
+}
+
+void storeProgramBinary(GLuint program, unsigned long long key) {
+    if (!cache.enabled) {
+        return;
+    }
+
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size == 0) {
+        return;
+    }
+
+    ProgramBinary& binary = cache.binaries[key];
+    binary.data.resize(size);
+    glGetProgramBinary(program, size, nullptr, &binary.format, binary.data.data());
+    cache.modified = true;
+}
+
+void saveShaderCache() {
+    if (!cache.enabled) {
+        return;
+    }
+    std::cout << "Shader cache: " << cache.hits << " programs loaded from binaries, "
+              << cache.misses << " compiled from source" << std::endl;
+    if (!cache.modified) {
+        return;
+    }
+
+    // Several render processes may save at once, each replaces the file in one step
+    std::string temporaryPath = temporaryFilePath(cache.path);
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "Could not write the shader cache to " << cache.path << std::endl;
+        return;
+    }
+    writeValue(file, cacheMagic);
+    writeValue(file, cache.driverHash);
+    writeValue(file, uint32_t(cache.binaries.size()));
+    for (auto& entry : cache.binaries) {
+        writeValue(file, entry.first);
+        writeValue(file, uint32_t(entry.second.format));
+        writeValue(file, uint32_t(entry.second.data.size()));
+        file.write(entry.second.data.data(), entry.second.data.size());
+    }
+    file.close();
+    if (!replaceFile(temporaryPath, cache.path)) {
+        std::cout << "Could not write the shader cache to " << cache.path << std::endl;
+    }
+    cache.modified = false;
+}
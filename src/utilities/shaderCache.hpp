@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <string>
+
+// Program binaries from earlier runs, keyed on a hash of the shader sources.
+// Binaries are only valid for the driver that produced them, so the whole
+// cache is discarded when the vendor, renderer or version string changes.
+void initShaderCache(std::string const &path);
+void saveShaderCache();
+
+// FNV-1a, chained over every stage of a program
+unsigned long long hashShaderSource(unsigned long long hash, std::string const &text);
+
+// Returns false on a miss or when the driver rejects the binary, the caller then compiles from source
+bool loadProgramBinary(GLuint program, unsigned long long key);
+void storeProgramBinary(GLuint program, unsigned long long key);
@@ -0,0 +1,92 @@
+#include "tonalArtMap.hpp"
+#include <glad/glad.h>
+#include <vector>
+
+// Spacing between parallel strokes, kept constant in texels on every mip level so
+// strokes stay one texel wide at any distance and each level holds a subset of the
+// strokes of the level above it.
+static const unsigned int strokeSpacing = 8;
+
+// Brightness below which each stroke direction appears (horizontal, vertical, diagonal, anti-diagonal)
+static const float strokeThresholds[4] = { 0.5f, 0.35f, 0.2f, 0.15f };
+
+static bool onStroke(unsigned int direction, unsigned int x, unsigned int y, unsigned int size) {
+    switch (direction) {
+        case 0: return y % strokeSpacing == 0;
+        case 1: return x % strokeSpacing == 0;
+        case 2: return (x + y) % strokeSpacing == 0;
+        default: return (x + size - y) % strokeSpacing == 0;
+    }
+}
+
+std::vector<std::vector<unsigned char>> buildTonalArtMapLevels() {
+    unsigned int levelCount = 1;
+    while ((tonalArtMapSize >> levelCount) > 0) {
+        levelCount++;
+    }
+
+    std::vector<std::vector<unsigned char>> levels;
+    for (unsigned int level = 0; level < levelCount; level++) {
+        unsigned int size = tonalArtMapSize >> level;
+        std::vector<unsigned char> pixels(size * size * tonalArtMapLayers, 255);
+
+        for (unsigned int layer = 0; layer < tonalArtMapLayers; layer++) {
+            unsigned char* tone = &pixels[layer * size * size];
+
+            if (size >= strokeSpacing) {
+                // Draw the strokes of every direction whose threshold lies above this tone
+                float brightness = tonalArtMapMaxBrightness * float(layer) / float(tonalArtMapLayers);
+                for (unsigned int direction = 0; direction < 4; direction++) {
+                    if (brightness >= strokeThresholds[direction]) {
+                        continue;
+                    }
+                    for (unsigned int y = 0; y < size; y++) {
+                        for (unsigned int x = 0; x < size; x++) {
+                            if (onStroke(direction, x, y, size)) {
+                                tone[y * size + x] = 0;
+                            }
+                        }
+                    }
+                }
+            } else {
+                // Too small to hold a stroke, average the level above to keep the tone
+                const unsigned char* source = &levels.back()[layer * size * size * 4];
+                for (unsigned int y = 0; y < size; y++) {
+                    for (unsigned int x = 0; x < size; x++) {
+                        unsigned int sum = source[(2 * y) * 2 * size + 2 * x]
+                                         + source[(2 * y) * 2 * size + 2 * x + 1]
+                                         + source[(2 * y + 1) * 2 * size + 2 * x]
+                                         + source[(2 * y + 1) * 2 * size + 2 * x + 1];
+                        tone[y * size + x] = (unsigned char) (sum / 4);
+                    }
+                }
+            }
+        }
+        levels.push_back(pixels);
+    }
+    return levels;
+}
+
+unsigned int generateTonalArtMap() {
+    std::vector<std::vector<unsigned char>> levels = buildTonalArtMapLevels();
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels.size(), GL_R8, tonalArtMapSize, tonalArtMapSize, tonalArtMapLayers);
+
+    // Small mip levels have rows narrower than the default 4 byte alignment
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int level = 0; level < levels.size(); level++) {
+        unsigned int size = tonalArtMapSize >> level;
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, size, size, tonalArtMapLayers, GL_RED, GL_UNSIGNED_BYTE, levels[level].data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    return textureID;
+}
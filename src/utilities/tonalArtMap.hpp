@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+// Crosshatching tones, layer 0 is the darkest. Each layer covers an equal slice of
+// brightness up to tonalArtMapMaxBrightness, everything brighter uses the last (blank) layer.
+const unsigned int tonalArtMapLayers = 12;
+const float        tonalArtMapMaxBrightness = 0.6f;
+
+// Width and height of one tile at mip level 0, in texels
+const unsigned int tonalArtMapSize = 64;
+
+// Texture unit lighting.frag samples the tonal art map from
+const unsigned int tonalArtMapTextureUnit = 2;
+
+// Every mip level, each holding the tiles of all layers one after another
+std::vector<std::vector<unsigned char>> buildTonalArtMapLevels();
+
+unsigned int generateTonalArtMap();
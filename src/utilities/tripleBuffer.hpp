@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+// Hands whole values from one writer thread to one reader thread without locks. Each side owns
+// a slot and the third is in the middle. Publishing swaps the writer's slot with the middle one
+// and acquiring swaps the reader's, so neither side waits and the reader always gets the newest
+// value, skipping any it was too slow for.
+template <class T>
+struct TripleBuffer {
+    T slots[3];
+    unsigned int backIndex = 0;   // the writer's
+    unsigned int frontIndex = 1;  // the reader's
+    std::atomic<unsigned int> middle{2};  // slot index, with tripleBufferFresh when the reader has not taken it
+};
+
+const unsigned int tripleBufferFresh = 4;
+
+// Writer side, the slot to fill before publishing. It holds an older value, not the last one published.
+template <class T>
+T& tripleBufferBack(TripleBuffer<T>& buffer) {
+    return buffer.slots[buffer.backIndex];
+}
+
+template <class T>
+void publishTripleBuffer(TripleBuffer<T>& buffer) {
+    buffer.backIndex = buffer.middle.exchange(buffer.backIndex | tripleBufferFresh, std::memory_order_acq_rel) & 3;
+}
+
+// Reader side, moves the newest published value to the front. False when nothing new was published.
+template <class T>
+bool acquireTripleBuffer(TripleBuffer<T>& buffer) {
+    if (!(buffer.middle.load(std::memory_order_relaxed) & tripleBufferFresh)) {
+        return false;
+    }
+    buffer.frontIndex = buffer.middle.exchange(buffer.frontIndex, std::memory_order_acq_rel) & 3;
+    return true;
+}
+
+template <class T>
+T const& tripleBufferFront(TripleBuffer<T> const &buffer) {
+    return buffer.slots[buffer.frontIndex];
+}
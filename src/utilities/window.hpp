@@ -11,9 +11,58 @@ const int         windowWidth     = 1366;
 const int         windowHeight    = 768;
 const std::string windowTitle     = "Glowbox";
 const GLint       windowResizable = GL_FALSE;
-const int         windowSamples   = 4;
+const int         windowSamples   = 0;  // the scene is drawn into single sampled buffers and anti-aliased with FXAA
+
+// Headless frames advance the animation by a fixed step, this is also the frame rate of video output
+const int         headlessFrameRate = 60;
+
+// Values of --hatching-style, compiled into lighting.frag as HATCHING_STYLE
+enum HatchingStyle {
+    HATCHING_SMOOTH         = 0,
+    HATCHING_TONAL_ART_MAP  = 1
+};
+
+// Values of --debug-view, compiled into lighting.frag and framebuffer.frag as DEBUG_VIEW
+enum DebugView {
+    DEBUG_VIEW_NONE          = 0,
+    DEBUG_VIEW_LIGHTING      = 1,  // lighting without hatching
+    DEBUG_VIEW_POSITION      = 2,  // reconstructed world position
+    DEBUG_VIEW_NORMALS       = 3,
+    DEBUG_VIEW_OUTLINES      = 4,  // outlines only
+    DEBUG_VIEW_EDGE_DISTANCE = 5,  // distance to the nearest edge
+    DEBUG_VIEW_DEPTH         = 6   // linear depth
+};
 
 struct CommandLineOptions {
     bool enableMusic;
     bool enableAutoplay;
+    bool enableDepthPrepass;
+    int extraLights;
+    float outlineWidth;
+    float outlineWidthFar;
+    float edgeThreshold;
+    float depthEdgeScale;
+    bool enableGeometricLines;
+    bool logFrames;
+    bool enablePicking;
+    bool checkQueries;  // compare the ray queries with brute force at startup
+    bool disableFXAA;
+    int hatchingStyle;
+    int debugView;
+    bool enableVertexPulling;
+    bool enableChunkedTerrain;
+    bool softwareRaster;
+    unsigned int rasterThreads;  // 0 for one per core
+    bool headless;
+    int headlessFrames;
+    int firstFrame;
+    int workers;
+    int renderWidth;
+    int renderHeight;
+    std::string outputPattern;
+    std::string outputFormat;
+    int encoderThreads;
+    std::string serverSocket;
+    std::string gbufferPattern;  // headless frames also export their G-buffer here
+    std::string regradePath;     // outline this exported G-buffer again instead of rendering
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "workerPool.hpp"
+#include <algorithm>
+
+static void runItems(WorkerPool& pool) {
+    for (unsigned int i = pool.next++; i < pool.count; i = pool.next++) {
+        (*pool.body)(i);
+    }
+}
+
+// Starts from the job count at creation, so it never runs a job from before it existed
+static void runWorker(WorkerPool& pool, unsigned long long lastJob) {
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    while (true) {
+        pool.wake.wait(lock, [&]() { return pool.stopping || pool.job != lastJob; });
+        if (pool.stopping) {
+            return;
+        }
+        lastJob = pool.job;
+        lock.unlock();
+        runItems(pool);
+        lock.lock();
+        if (--pool.busy == 0) {
+            pool.finished.notify_one();
+        }
+    }
+}
+
+void initWorkerPool(WorkerPool& pool, unsigned int threadCount) {
+    stopWorkerPool(pool);
+    pool.threadCount = threadCount == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : threadCount;
+    pool.stopping = false;
+    for (unsigned int i = 1; i < pool.threadCount; i++) {
+        pool.threads.emplace_back(runWorker, std::ref(pool), pool.job);
+    }
+}
+
+void stopWorkerPool(WorkerPool& pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stopping = true;
+    }
+    pool.wake.notify_all();
+    for (std::thread& thread : pool.threads) {
+        thread.join();
+    }
+    pool.threads.clear();
+    pool.threadCount = 1;
+}
+
+WorkerPool::~WorkerPool() {
+    stopWorkerPool(*this);
+}
+
+void parallelFor(WorkerPool& pool, unsigned int count, std::function<void(unsigned int)> const &body) {
+    if (pool.threads.empty() || count <= 1) {
+        for (unsigned int i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.body = &body;
+        pool.count = count;
+        pool.next = 0;
+        pool.busy = pool.threads.size();
+        pool.job++;
+    }
+    pool.wake.notify_all();
+    runItems(pool);
+
+    // The workers still read the body until they leave the job
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.finished.wait(lock, [&]() { return pool.busy == 0; });
+    pool.body = nullptr;
+}
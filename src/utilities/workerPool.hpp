@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads started once and kept waiting for parallelFor calls, so loops that run again and again
+// do not pay for creating threads every time. The calling thread works along with them.
+struct WorkerPool {
+    unsigned int threadCount = 1;  // the workers and the caller
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;      // workers wait here for the next job
+    std::condition_variable finished;  // parallelFor waits here for the workers to leave the job
+    std::function<void(unsigned int)> const* body = nullptr;
+    unsigned int count = 0;
+    std::atomic<unsigned int> next{0};
+    unsigned int busy = 0;       // workers still in the current job
+    unsigned long long job = 0;  // bumped for every job, so each worker runs it once
+    bool stopping = false;
+
+    ~WorkerPool();
+};
+
+// Zero threads uses one per core, one thread runs everything on the caller
+void initWorkerPool(WorkerPool& pool, unsigned int threadCount);
+
+// Joins the workers, the pool runs everything on the caller afterwards
+void stopWorkerPool(WorkerPool& pool);
+
+// Runs body(i) for every i below count on the pool and returns when all are done. Items are
+// handed out one at a time, so uneven items still balance. Not reentrant, body must not call
+// parallelFor on the same pool.
+void parallelFor(WorkerPool& pool, unsigned int count, std::function<void(unsigned int)> const &body);
@@ -0,0 +1,142 @@
+#include "vertexPulling.hpp"
+#include <algorithm>
+#include <iostream>
+
+void initVertexPool(VertexPool& pool) {
+    glGenBuffers(1, &pool.vertexBuffer);
+    glGenBuffers(1, &pool.indexBuffer);
+    glGenBuffers(1, &pool.drawBuffer);
+    glGenBuffers(1, &pool.commandBuffer);
+    glGenBuffers(1, &pool.drawIndexBuffer);
+    pool.drawIndexCapacity = 0;
+
+    glGenVertexArrays(1, &pool.vertexArray);
+    glBindVertexArray(pool.vertexArray);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, pool.drawIndexBuffer);
+    glVertexAttribIPointer(drawIndexAttribute, 1, GL_UNSIGNED_INT, sizeof(unsigned int), nullptr);
+    glVertexAttribDivisor(drawIndexAttribute, 1);
+    glEnableVertexAttribArray(drawIndexAttribute);
+    glBindVertexArray(0);
+}
+
+int addPulledMesh(VertexPool& pool, Mesh& mesh) {
+    PulledMesh pulled;
+    pulled.baseVertex = pool.vertices.size();
+    pulled.firstIndex = pool.indices.size();
+    pulled.indexCount = mesh.indices.size();
+
+    // Attributes the mesh does not have are left at zero, like a disabled vertex attribute
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        PulledVertex vertex;
+        glm::vec3 normal = i < mesh.normals.size() ? mesh.normals[i] : glm::vec3(0.0f);
+        glm::vec2 textureCoordinates = i < mesh.textureCoordinates.size() ? mesh.textureCoordinates[i] : glm::vec2(0.0f);
+        vertex.positionU = glm::vec4(mesh.vertices[i], textureCoordinates.x);
+        vertex.normalV = glm::vec4(normal, textureCoordinates.y);
+        float ambientOcclusion = i < mesh.ambientOcclusion.size() ? mesh.ambientOcclusion[i] : 1.0f;
+        vertex.tangent = glm::vec4(i < mesh.tangents.size() ? mesh.tangents[i] : glm::vec3(0.0f), ambientOcclusion);
+        vertex.bitangent = glm::vec4(i < mesh.bitangents.size() ? mesh.bitangents[i] : glm::vec3(0.0f), 0.0f);
+        pool.vertices.push_back(vertex);
+    }
+    // Indices stay relative to the mesh, the base vertex of each draw offsets them
+    pool.indices.insert(pool.indices.end(), mesh.indices.begin(), mesh.indices.end());
+
+    pool.meshes.push_back(pulled);
+    return int(pool.meshes.size()) - 1;
+}
+
+void uploadVertexPool(VertexPool& pool) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pool.vertexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, pool.vertices.size() * sizeof(PulledVertex), pool.vertices.data(), GL_STATIC_DRAW);
+
+    glBindVertexArray(pool.vertexArray);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, pool.indices.size() * sizeof(unsigned int), pool.indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    std::cout << "Vertex pool: " << pool.meshes.size() << " meshes, " << pool.vertices.size() << " vertices, "
+              << pool.indices.size() << " indices" << std::endl;
+}
+
+static void collectPulledNodes(SceneNode* node, std::vector<SceneNode*>& nodes) {
+    if (node->nodeType != POINT_LIGHT && node->pulledMeshID != -1) {
+        nodes.push_back(node);
+    }
+    for (SceneNode* child : node->children) {
+        collectPulledNodes(child, nodes);
+    }
+}
+
+static bool isTextured(SceneNode* node) {
+    return node->nodeType == TEXTURE_MAP;
+}
+
+void buildPulledBatches(VertexPool& pool, SceneNode* rootNode) {
+    std::vector<SceneNode*> nodes;
+    collectPulledNodes(rootNode, nodes);
+
+    // Group by material so each group becomes one multi-draw
+    std::stable_sort(nodes.begin(), nodes.end(), [](SceneNode* a, SceneNode* b) {
+        if (isTextured(a) != isTextured(b)) {
+            return isTextured(b);
+        }
+        return isTextured(a) && a->textureID < b->textureID;
+    });
+
+    pool.draws.clear();
+    pool.commands.clear();
+    pool.batches.clear();
+    for (SceneNode* node : nodes) {
+        PulledDraw draw;
+        draw.MVP = node->currentTransformationMatrix;
+        draw.modelMatrix = node->modelMatrix;
+        draw.normalMatrix = glm::mat4(glm::mat3(glm::transpose(glm::inverse(node->modelMatrix))));
+        draw.objectID = glm::uvec4(node->objectID, 0, 0, 0);
+
+        PulledMesh& mesh = pool.meshes[node->pulledMeshID];
+        DrawElementsCommand command;
+        command.count = mesh.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = mesh.firstIndex;
+        command.baseVertex = GLint(mesh.baseVertex);
+        command.baseInstance = pool.draws.size();
+
+        bool textured = isTextured(node);
+        unsigned int textureID = textured ? node->textureID : 0;
+        if (pool.batches.empty() || pool.batches.back().textured != textured || pool.batches.back().textureID != textureID) {
+            pool.batches.push_back({ textured, textureID, (unsigned int) pool.commands.size(), 0 });
+        }
+        pool.batches.back().commandCount++;
+
+        pool.draws.push_back(draw);
+        pool.commands.push_back(command);
+    }
+
+    // The draw index attribute reads entry baseInstance, so the buffer needs one entry per draw
+    if (pool.draws.size() > pool.drawIndexCapacity) {
+        pool.drawIndexCapacity = std::max<unsigned int>(pool.draws.size(), 2 * pool.drawIndexCapacity);
+        std::vector<unsigned int> drawIndices(pool.drawIndexCapacity);
+        for (unsigned int i = 0; i < pool.drawIndexCapacity; i++) {
+            drawIndices[i] = i;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, pool.drawIndexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(unsigned int), drawIndices.data(), GL_STATIC_DRAW);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pool.drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(pool.draws.size(), 1) * sizeof(PulledDraw), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, pool.draws.size() * sizeof(PulledDraw), pool.draws.data());
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, pool.commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, pool.commands.size() * sizeof(DrawElementsCommand), pool.commands.data(), GL_STREAM_DRAW);
+}
+
+// Expects the pulling shader variant for the batch's material to be active
+void drawPulledBatch(VertexPool& pool, PulledBatch& batch) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, pulledVertexBinding, pool.vertexBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, pulledDrawBinding, pool.drawBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, pool.commandBuffer);
+    glBindVertexArray(pool.vertexArray);
+
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*) (batch.firstCommand * sizeof(DrawElementsCommand)),
+                                batch.commandCount, 0);
+}
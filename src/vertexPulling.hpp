@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <utilities/mesh.h>
+
+#include "sceneGraph.hpp"
+
+// Shader storage bindings read by simple.vert when VERTEX_PULLING is defined
+const unsigned int pulledVertexBinding = 6;
+const unsigned int pulledDrawBinding   = 7;
+
+// Instanced attribute holding the draw index. Every indirect command sets its base
+// instance to its own index, so this works without gl_DrawID.
+const unsigned int drawIndexAttribute = 5;
+
+// One vertex as laid out in the std430 vertex buffer. Every mesh is converted to this
+// layout, so meshes with different attributes can share one multi-draw.
+struct PulledVertex {
+    glm::vec4 positionU;  // xyz position, w texture coordinate u
+    glm::vec4 normalV;    // xyz normal, w texture coordinate v
+    glm::vec4 tangent;    // xyz tangent, w ambient occlusion
+    glm::vec4 bitangent;
+};
+
+// Per draw data, replaces the per node uniforms of the VAO path
+struct PulledDraw {
+    glm::mat4 MVP;
+    glm::mat4 modelMatrix;
+    glm::mat4 normalMatrix;  // upper 3x3 is used
+    glm::uvec4 objectID;     // x is used, padded for std430
+};
+
+// Layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+struct DrawElementsCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// Where a mesh lives in the shared buffers
+struct PulledMesh {
+    unsigned int baseVertex;
+    unsigned int firstIndex;
+    unsigned int indexCount;
+};
+
+// Consecutive commands sharing a material, submitted with one multi-draw
+struct PulledBatch {
+    bool textured;
+    unsigned int textureID;
+    unsigned int firstCommand;
+    unsigned int commandCount;
+};
+
+struct VertexPool {
+    // Every mesh in one vertex and one index buffer
+    std::vector<PulledVertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<PulledMesh> meshes;
+
+    unsigned int vertexBuffer;
+    unsigned int indexBuffer;
+    unsigned int drawBuffer;
+    unsigned int commandBuffer;
+    unsigned int drawIndexBuffer;
+    unsigned int drawIndexCapacity;
+
+    // Holds only the index buffer and the draw index attribute, it never changes between draws
+    unsigned int vertexArray;
+
+    // Rebuilt whenever the G-buffer is redrawn
+    std::vector<PulledDraw> draws;
+    std::vector<DrawElementsCommand> commands;
+    std::vector<PulledBatch> batches;
+};
+
+void initVertexPool(VertexPool& pool);
+int addPulledMesh(VertexPool& pool, Mesh& mesh);
+void uploadVertexPool(VertexPool& pool);
+
+// Collects the nodes with a pulled mesh, grouped by material, and uploads their draw data
+void buildPulledBatches(VertexPool& pool, SceneNode* rootNode);
+void drawPulledBatch(VertexPool& pool, PulledBatch& batch);